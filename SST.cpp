@@ -1,127 +1,291 @@
 #include "SST.h"
+#include "prefixfilter.h"
 
 // Constructor
-SST::SST(int levelnum, string &prefix, bool istemp, vector<function<int(int)>> *hashFunctions) {
-    // Set the levelnum and istemp attributes
+SST::SST(int levelnum, int slot, string &prefix) {
     this->levelnum = levelnum;
-    this->istemp = istemp;
-    this->hashFunctions = hashFunctions;
+    this->slot = slot;
+    this->filepath = prefix + fileName(levelnum, slot);
+}
 
-    this->filepath = prefix + "L" + to_string(levelnum);
-    if (istemp) {
-        this->filepath += "Temp";
-    }
-    ofstream sstFile(this->filepath.c_str());
-    sstFile.close();
+SST::SST(int levelnum, string &prefix, string &file) {
+    this->levelnum = levelnum;
+    this->filepath = prefix + file;
+    // The slot follows the underscore of the file name
+    size_t separator = file.find('_');
+    this->slot = separator == string::npos ? 0 : atoi(file.c_str() + separator + 1);
 }
 
 // Destructor
 SST::~SST() {
+    for (Filter *filter : this->filters) {
+        delete filter;
+    }
+    for (Filter *filter : this->rangeFilters) {
+        delete filter;
+    }
     // Attempt to remove the file
     if (std::remove(this->filepath.c_str()) != 0) {
         std::cerr << "Error deleting file." << std::endl;
     }
 }
 
-void SST::buildKeyArray() {
-    // Open the file
-    int fd = open(this->filepath.c_str(), O_RDONLY);
-    if (fd == -1) {
-        cerr << "Failed to open file: " << this->filepath << endl;
-        return;
+vector<int> SST::getKeyArray() {
+    return this->keyArray;
+}
+
+void SST::setFilter(Filter *filter, Filter *rangeFilter) {
+    for (Filter *old : this->filters) {
+        delete old;
     }
-    // Iterate through each page and read the first integer
-    for (int i = 0; i < this->filesize; i += PAGE_SIZE) {
-        // Read the first integer
-        int firstInt;
-        int intRead = pread(fd, &firstInt, sizeof(int), i);
-        if (intRead == -1) {
-            cerr << "Failed to read file by construct key array" << endl;
-        }
-        // Store the first integer in the array
-        this->keyArray.push_back(firstInt);
+    for (Filter *old : this->rangeFilters) {
+        delete old;
     }
-    // Close the file
-    close(fd);
-    return;
+    this->filters.assign(1, filter);
+    this->filterKeys.assign(1, numeric_limits<int>::min());
+    this->rangeFilters.assign(1, rangeFilter);
 }
 
-void SST::generateFileSize() {
-    int fd = open(this->filepath.c_str(), O_RDONLY);
-    this->filesize = lseek(fd, 0, SEEK_END);
+bool SST::readFooter(const string &filepath, SSTFooter &footer) {
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    bool valid = size >= (off_t) sizeof(SSTFooter)
+        && pread(fd, &footer, sizeof(SSTFooter), size - sizeof(SSTFooter)) == (ssize_t) sizeof(SSTFooter)
+        && footer.magic == SST_MAGIC && footer.version == SST_FORMAT_VERSION;
     close(fd);
+    return valid;
 }
 
-vector<int> SST::getKeyArray() {
-    return this->keyArray;
-}
-
-void SST::buildBloomFilter() {
-    // read the file and iterate all KV_pairs
+bool SST::loadMetadata() {
+    SSTFooter footer;
+    if (!readFooter(this->filepath, footer)) {
+        cerr << "Not an SST file: " << this->filepath << endl;
+        return false;
+    }
     int fd = open(this->filepath.c_str(), O_RDONLY);
-    KV_Pair* buffer = new KV_Pair[PAGE_SIZE / KV_PAIR_SIZE];
-
-    // resize the bloomFIlterSize
-    int bloomFilterSize = this->filesize / KV_PAIR_SIZE * BITS_PER_ENTRY;
-    bloomFilter.resize(bloomFilterSize);
-
-    // Calculate the number of pages
-    int num_pages = this->filesize / PAGE_SIZE + (this->filesize % PAGE_SIZE != 0);
-    // Iterate through each page
-    for (int i = 0; i < num_pages; ++i) {        
-        // read a whole page into buffer
-        int errorcode = read(fd, buffer, PAGE_SIZE);
-        if (errorcode == -1) {
-            cerr << "Failed to read file by build bloom filter" << endl;
-            return;
+    // Blocks are read straight into the vectors that keep them in memory
+    this->keyArray.resize(footer.numFences);
+    ssize_t indexSize = footer.numFences * sizeof(int32_t);
+    bool valid = pread(fd, this->keyArray.data(), indexSize, footer.indexOffset) == indexSize;
+    // Packed pages have their offsets behind the fence keys
+    valid = valid && footer.pageFormat >= ROW_PAGE && footer.pageFormat <= PACKED_PAGE
+        && footer.compression >= NO_COMPRESSION && footer.compression <= LZ_COMPRESSION;
+    this->pageFormat = PageFormat(footer.pageFormat);
+    this->compression = CompressionType(footer.compression);
+    this->allocatedBitsPerKey = footer.allocatedBitsPerKey;
+    this->pageOffsets.resize(this->hasPageOffsets() ? footer.numFences : 0);
+    ssize_t offsetsSize = this->pageOffsets.size() * sizeof(int32_t);
+    valid = valid && pread(fd, this->pageOffsets.data(), offsetsSize, footer.indexOffset + indexSize) == offsetsSize;
+    for (Filter *filter : this->filters) {
+        delete filter;
+    }
+    for (Filter *filter : this->rangeFilters) {
+        delete filter;
+    }
+    this->filters.clear();
+    this->filterKeys.clear();
+    this->rangeFilters.clear();
+    int64_t offset = footer.filterOffset;
+    string data;
+    for (int i = 0; i < footer.numFilters && valid; i++) {
+        int32_t header[3];
+        valid = pread(fd, header, sizeof(header), offset) == sizeof(header);
+        offset += sizeof(header);
+        data.resize(header[2]);
+        valid = valid && pread(fd, &data[0], header[2], offset) == header[2];
+        offset += header[2];
+        Filter *filter = Filter::create(FilterType(header[1]), 0, 1);
+        valid = valid && filter->deserialize(data.data(), data.size());
+        if (filter->getType() == PREFIX_BLOOM_FILTER && !this->rangeFilters.empty() && this->rangeFilters.back() == NULL) {
+            this->rangeFilters.back() = filter;
+            continue;
         }
-        int numOfKVPairsInBuffer = PAGE_SIZE / sizeof(KV_Pair);
-        if (i == num_pages - 1) { // this is the last page
-            if (filesize % PAGE_SIZE != 0) { // this page is NOT FULL
-                numOfKVPairsInBuffer = (filesize % PAGE_SIZE) / sizeof(KV_Pair);
+        this->filters.push_back(filter);
+        this->filterKeys.push_back(header[0]);
+        this->rangeFilters.push_back(NULL);
+    }
+    close(fd);
+    if (!valid) {
+        cerr << "Failed to read metadata of " << this->filepath << endl;
+        return false;
+    }
+    this->buildIndex();
+    this->filesize = footer.dataSize;
+    this->numPairs = footer.numPairs;
+    this->numTombstones = footer.numTombstones;
+    this->lastKey = footer.maxKey;
+    return true;
+}
+
+bool SST::writeMetadata(int fd) {
+    vector<char> metadata;
+    // Index block
+    metadata.insert(metadata.end(), reinterpret_cast<const char *>(this->keyArray.data()),
+                    reinterpret_cast<const char *>(this->keyArray.data() + this->keyArray.size()));
+    metadata.insert(metadata.end(), reinterpret_cast<const char *>(this->pageOffsets.data()),
+                    reinterpret_cast<const char *>(this->pageOffsets.data() + this->pageOffsets.size()));
+    // Filter block
+    int64_t filterOffset = this->filesize + metadata.size();
+    int numFilters = 0;
+    for (size_t i = 0; i < this->filters.size(); i++) {
+        for (Filter *runFilter : { this->filters[i], this->rangeFilters[i] }) {
+            if (runFilter == NULL) {
+                continue;
             }
+            string filter;
+            runFilter->serialize(filter);
+            int32_t header[3] = { this->filterKeys[i], runFilter->getType(), (int32_t) filter.size() };
+            metadata.insert(metadata.end(), reinterpret_cast<const char *>(header), reinterpret_cast<const char *>(header + 3));
+            metadata.insert(metadata.end(), filter.begin(), filter.end());
+            numFilters++;
         }
-        for (int j = 0; j < numOfKVPairsInBuffer; j++) {
-            int key = buffer[j].key;
-            // Iterate all hash functions
-            for (const auto& hashfun : *hashFunctions) {
-                int hashValue = hashfun(key);
-                bloomFilter[abs(hashValue % bloomFilterSize)] = true;
-            }
+    }
+    size_t filterMemory = this->getFilterMemory();
+    // Footer
+    SSTFooter footer;
+    // No padding bytes of the struct go to disk uninitialized
+    memset(&footer, 0, sizeof(footer));
+    footer.indexOffset = this->filesize;
+    footer.filterOffset = filterOffset;
+    footer.dataSize = this->filesize;
+    footer.numPairs = this->numPairs;
+    footer.numTombstones = this->numTombstones;
+    footer.numFences = this->keyArray.size();
+    footer.numFilters = numFilters;
+    footer.minKey = this->keyArray.empty() ? 0 : this->keyArray[0];
+    footer.maxKey = this->lastKey;
+    footer.filterBitsPerKey = this->numPairs == 0 ? 0 : filterMemory * 8 / this->numPairs;
+    footer.pageFormat = this->pageFormat;
+    footer.compression = this->compression;
+    footer.allocatedBitsPerKey = this->allocatedBitsPerKey;
+    footer.version = SST_FORMAT_VERSION;
+    footer.magic = SST_MAGIC;
+    metadata.insert(metadata.end(), reinterpret_cast<const char *>(&footer), reinterpret_cast<const char *>(&footer + 1));
+    // Metadata replaces whatever followed the data pages
+    if (pwrite(fd, metadata.data(), metadata.size(), this->filesize) != (ssize_t) metadata.size()
+        || ftruncate(fd, this->filesize + metadata.size()) != 0 || fsync(fd) != 0) {
+        cerr << "Failed to write metadata of " << this->filepath << endl;
+        return false;
+    }
+    return true;
+}
+
+int SST::getFirstKey() {
+    return this->keyArray.empty() ? 0 : this->keyArray[0];
+}
+
+int SST::getLastKey() {
+    return this->lastKey;
+}
+
+string SST::fileName(int levelnum, int slot) {
+    string file = "L" + to_string(levelnum);
+    return slot == 0 ? file : file + "_" + to_string(slot);
+}
+
+int SST::getFileId() {
+    return this->slot * SST_MAX_LEVELS + this->levelnum;
+}
+
+bool SST::relink(int levelnum, int slot, string &prefix) {
+    // A second link replaces the empty file that reserved the slot in one step
+    string filepath = prefix + fileName(levelnum, slot);
+    string temppath = filepath + ".tmp";
+    if (link(this->filepath.c_str(), temppath.c_str()) != 0 || std::rename(temppath.c_str(), filepath.c_str()) != 0) {
+        cerr << "Failed to link file: " << this->filepath << endl;
+        return false;
+    }
+    this->filepath = filepath;
+    this->levelnum = levelnum;
+    this->slot = slot;
+    return true;
+}
+
+bool SST::isPageAligned() {
+    return this->numPairs % PAIRS_PER_PAGE == 0;
+}
+
+// A copy of a filter through its serialized form, NULL stays NULL
+static Filter *copyFilter(Filter *filter) {
+    if (filter == NULL) {
+        return NULL;
+    }
+    string data;
+    filter->serialize(data);
+    Filter *copy = Filter::create(filter->getType(), 0, 1);
+    copy->deserialize(data.data(), data.size());
+    return copy;
+}
+
+bool SST::append(SST *other) {
+    // Copy the data pages of other behind the last page in large chunks
+    int fd = open(this->filepath.c_str(), O_WRONLY);
+    int other_fd = open(other->filepath.c_str(), O_RDONLY);
+    bool copied = fd != -1 && other_fd != -1;
+    const int chunk_size = 256 * PAGE_SIZE;
+    char *buffer = new char[chunk_size];
+    for (int offset = 0; offset < other->filesize && copied; offset += chunk_size) {
+        int bytes = min(chunk_size, other->filesize - offset);
+        copied = pread(other_fd, buffer, bytes, offset) == bytes && pwrite(fd, buffer, bytes, this->filesize + offset) == bytes;
+    }
+    delete[] buffer;
+    if (other_fd != -1) {
+        close(other_fd);
+    }
+    if (!copied) {
+        cerr << "Failed to append " << other->filepath << " to " << this->filepath << endl;
+        if (fd != -1) {
+            close(fd);
         }
+        return false;
+    }
+    // Pages of other follow the pages of this SST, so their fence keys simply follow ours
+    this->keyArray.insert(this->keyArray.end(), other->keyArray.begin(), other->keyArray.end());
+    for (int offset : other->pageOffsets) {
+        this->pageOffsets.push_back(this->filesize + offset);
     }
-    
-    // Postprocesses
+    this->buildIndex();
+    // Keys of other are all larger, its filters cover the keys after its first key. Other keeps its
+    // filters, it is still in use until this SST replaces it
+    for (size_t i = 0; i < other->filters.size(); i++) {
+        this->filters.push_back(copyFilter(other->filters[i]));
+        this->filterKeys.push_back(i == 0 ? other->keyArray[0] : other->filterKeys[i]);
+        this->rangeFilters.push_back(copyFilter(other->rangeFilters[i]));
+    }
+    this->filesize += other->filesize;
+    this->numPairs += other->numPairs;
+    this->numTombstones += other->numTombstones;
+    this->lastKey = other->lastKey;
+    // The data of other overwrote our metadata blocks, write them again behind the new end
+    bool written = this->writeMetadata(fd);
     close(fd);
-    delete[] buffer;
+    return written;
 }
 
-void SST::setBloomFilter(vector<bool>& bloomFilter) {
-    this->bloomFilter = bloomFilter;
+int SST::binarySearchPage(int key) {
+    return this->learnedIndex ? this->learned.search(key) : this->fenceIndex.search(key);
 }
 
-int SST::binarySearchPage(int key) {
-    int left = 0;
-    int right = this->keyArray.size() - 1;
-    int result = -1;  // Default value if no such number is found
-
-    while (left <= right) {
-        int mid = left + (right - left) / 2;
-        
-        if (this->keyArray[mid] <= key) {
-            result = mid;  // Update result and continue searching in the right half
-            left = mid + 1;
-        } else {
-            right = mid - 1;  // Search in the left half
-        }
+void SST::buildIndex() {
+    if (this->learnedIndex) {
+        this->learned.build(this->keyArray);
+    } else {
+        this->fenceIndex.build(this->keyArray);
     }
+}
 
-    return result;
+size_t SST::getIndexMemory() {
+    return this->learnedIndex ? this->learned.getMemoryUsage() : this->fenceIndex.getMemoryUsage();
 }
 
 int SST::getPotentialPageNumberOfASST(int key, int type) {   
-    // If this is a GET and it doesn't pass bloom filter test, we return -1 directly
-    if (type == GET && !bloomFilterCheck(key)) { 
+    // If this is a GET and it doesn't pass bloom filter test, we return -1 directly.
+    // Keys outside the key range do not need the filter
+    if (type == GET && (this->keyArray.empty() || key < this->keyArray[0] || key > this->lastKey
+                        || !bloomFilterCheck(key))) {
         return -1;
     }
 
@@ -145,26 +309,267 @@ int SST::getPotentialPageNumberOfASST(int key, int type) {
 }
 
 bool SST::bloomFilterCheck(int key) {
-    int bloomFilterSize = this->filesize / KV_PAIR_SIZE * BITS_PER_ENTRY;
-    for (const auto& hashfun : *hashFunctions) {
-        int hashValue = hashfun(key);
-        if (!bloomFilter[abs(hashValue % bloomFilterSize)]) {
-            return false;
-        }
+    // Find the filter of the run the key would be in
+    int idx = upper_bound(this->filterKeys.begin(), this->filterKeys.end(), key) - this->filterKeys.begin() - 1;
+    if (idx < 0) {
+        return false;
+    }
+    if (!this->filters[idx]->mayContain(key)) {
+        this->filterNegatives++;
+        return false;
     }
     return true;
 }
 
+bool SST::rangeFilterCheck(int lowerbound, int upperbound) {
+    // Only the part of the range inside the key range of the SST can have keys
+    if (this->keyArray.empty()) {
+        return false;
+    }
+    lowerbound = max(lowerbound, this->keyArray[0]);
+    upperbound = min(upperbound, this->lastKey);
+    if (lowerbound > upperbound) {
+        return false;
+    }
+    // Check the part of the range each run covers
+    int first = max(0, int(upper_bound(this->filterKeys.begin(), this->filterKeys.end(), lowerbound) - this->filterKeys.begin()) - 1);
+    int last = upper_bound(this->filterKeys.begin(), this->filterKeys.end(), upperbound) - this->filterKeys.begin() - 1;
+    for (int idx = first; idx <= last; idx++) {
+        Filter *filter = this->rangeFilters[idx];
+        int runLower = max(lowerbound, this->filterKeys[idx]);
+        int runUpper = idx + 1 < (int) this->filterKeys.size() ? min(upperbound, this->filterKeys[idx + 1] - 1) : upperbound;
+        if (filter == NULL || static_cast<PrefixBloomFilter *>(filter)->mayContainRange(runLower, runUpper)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int SST::getNumPairs() {
+    return this->numPairs;
+}
+
+int SST::getNumTombstones() {
+    return this->numTombstones;
+}
+
+int SST::getNumPages() {
+    return this->keyArray.size();
+}
+
+int SST::getPairsInPage(int pagenum) {
+    // Only the last page may not be full
+    return min(PAIRS_PER_PAGE, this->numPairs - pagenum * PAIRS_PER_PAGE);
+}
+
+int SST::getPageOffset(int pagenum) {
+    return this->pageOffsets.empty() ? pagenum * PAGE_SIZE : this->pageOffsets[pagenum];
+}
+
+int SST::getPageSize(int pagenum) {
+    if (this->pageOffsets.empty()) {
+        return this->getPairsInPage(pagenum) * KV_PAIR_SIZE;
+    }
+    int end = pagenum + 1 < (int) this->pageOffsets.size() ? this->pageOffsets[pagenum + 1] : this->filesize;
+    return end - this->pageOffsets[pagenum];
+}
+
+bool SST::hasPageOffsets() {
+    return this->pageFormat == PACKED_PAGE || this->compression != NO_COMPRESSION;
+}
+
+int SST::maxPageSize() {
+    int size = this->pageFormat == PACKED_PAGE ? PACKED_PAGE_MAX_SIZE : PAGE_SIZE;
+    return this->compression == NO_COMPRESSION ? size : LZCodec::maxCompressedSize(size);
+}
+
+bool SST::readPage(int fd, int pagenum, char *data) {
+    int offset = this->getPageOffset(pagenum);
+    int size = this->getPageSize(pagenum);
+    int pairs = this->getPairsInPage(pagenum);
+    if (!this->hasPageOffsets()) {
+        return pread(fd, data, size, offset) == size;
+    }
+    alignas(64) char stored[LZ_MAX_COMPRESSED_SIZE(PACKED_PAGE_MAX_SIZE) + PACKED_PAGE_PADDING];
+    if (size > this->maxPageSize() || pread(fd, stored, size, offset) != size) {
+        return false;
+    }
+    const char *packed = stored;
+    int packedSize = size;
+    alignas(64) char decompressed[PACKED_PAGE_MAX_SIZE + PACKED_PAGE_PADDING];
+    if (this->compression != NO_COMPRESSION) {
+        // Pages that are not packed decompress straight into data
+        if (this->pageFormat != PACKED_PAGE) {
+            return LZCodec::decompress(stored, size, data, PAGE_SIZE) == pairs * KV_PAIR_SIZE;
+        }
+        packed = decompressed;
+        packedSize = LZCodec::decompress(stored, size, decompressed, PACKED_PAGE_MAX_SIZE);
+    }
+    return packedSize >= 0 && Page::unpack(packed, packedSize, data) == pairs;
+}
+
+Page SST::viewPage(const char *data, int pagenum) {
+    // Packed pages are read as PAX pages
+    return Page(data, this->getPairsInPage(pagenum), this->pageFormat == PACKED_PAGE ? PAX_PAGE : this->pageFormat);
+}
+
+size_t SST::getFilterMemory() {
+    size_t memory = 0;
+    for (Filter *filter : this->filters) {
+        memory += filter->getMemoryUsage();
+    }
+    return memory;
+}
+
+size_t SST::getRangeFilterMemory() {
+    size_t memory = 0;
+    for (Filter *filter : this->rangeFilters) {
+        memory += filter == NULL ? 0 : filter->getMemoryUsage();
+    }
+    return memory;
+}
+
+double SST::expectedFalsePositiveRate() {
+    double rate = 0;
+    size_t memory = this->getFilterMemory();
+    for (Filter *filter : this->filters) {
+        rate += filter->falsePositiveRate() * filter->getMemoryUsage() / max(size_t(1), memory);
+    }
+    return rate;
+}
+
+// --- SST builder ---
+SSTBuilder::SSTBuilder(SST *sst, int expectedPairs, FilterType filterType, double bitsPerKey, double rangeBitsPerKey) {
+    this->sst = sst;
+    this->fd = open(sst->filepath.c_str(), O_WRONLY | O_TRUNC);
+    if (this->fd == -1) {
+        cerr << "Failed to open file: " << sst->filepath << endl;
+    }
+    // Buffer whole pages, a memtable flush fits in one buffer and is written with a single call.
+    // Packed or compressed pages may be a little larger than other pages
+    int expectedPages = max(1, (expectedPairs * KV_PAIR_SIZE + PAGE_SIZE - 1) / PAGE_SIZE);
+    this->bufferSize = max(min(expectedPages * PAGE_SIZE, SST_WRITE_BUFFER_SIZE), sst->maxPageSize());
+    this->page = NULL;
+    this->encoded = NULL;
+    if (posix_memalign(reinterpret_cast<void **>(&this->buffer), PAGE_SIZE, this->bufferSize) != 0
+        || posix_memalign(reinterpret_cast<void **>(&this->page), 64, PAGE_SIZE) != 0
+        || posix_memalign(reinterpret_cast<void **>(&this->encoded), 64, PACKED_PAGE_MAX_SIZE) != 0) {
+        cerr << "Failed to allocate write buffer" << endl;
+    }
+    this->bufferUsed = 0;
+    this->written = 0;
+    this->numPairs = 0;
+    this->numTombstones = 0;
+    this->lastKey = 0;
+    this->filter = Filter::create(filterType, expectedPairs, bitsPerKey);
+    sst->allocatedBitsPerKey = bitsPerKey;
+    this->rangeFilter = rangeBitsPerKey > 0 ? Filter::create(PREFIX_BLOOM_FILTER, expectedPairs, rangeBitsPerKey) : NULL;
+}
+
+SSTBuilder::~SSTBuilder() {
+    free(this->buffer);
+    free(this->page);
+    free(this->encoded);
+    delete this->filter;
+    delete this->rangeFilter;
+}
+
+void SSTBuilder::add(int key, int val) {
+    // The first key of each page goes to the key array
+    if (this->numPairs % PAIRS_PER_PAGE == 0) {
+        this->keyArray.push_back(key);
+    }
+    this->filter->add(key);
+    if (this->rangeFilter != NULL) {
+        this->rangeFilter->add(key);
+    }
+    PageFormat format = this->sst->pageFormat == PACKED_PAGE ? PAX_PAGE : this->sst->pageFormat;
+    Page::put(this->page, this->numPairs % PAIRS_PER_PAGE, key, val, format);
+    this->numPairs++;
+    this->numTombstones += val == numeric_limits<int>::min();
+    this->lastKey = key;
+    if (this->numPairs % PAIRS_PER_PAGE == 0) {
+        finishPage();
+    }
+}
+
+void SSTBuilder::finishPage() {
+    int pairs = (this->numPairs - 1) % PAIRS_PER_PAGE + 1;
+    if (this->bufferSize - this->bufferUsed < this->sst->maxPageSize()) {
+        flushBuffer();
+    }
+    this->pageOffsets.push_back(this->written + this->bufferUsed);
+    const char *data = this->page;
+    int size = pairs * KV_PAIR_SIZE;
+    if (this->sst->pageFormat == PACKED_PAGE) {
+        Page::finish(this->page, pairs, PAX_PAGE);
+        size = Page::pack(Page(this->page, pairs, PAX_PAGE), this->encoded);
+        data = this->encoded;
+    } else {
+        Page::finish(this->page, pairs, this->sst->pageFormat);
+    }
+    // Each page is compressed on its own, so a read only decompresses the page it needs
+    if (this->sst->compression != NO_COMPRESSION) {
+        this->bufferUsed += LZCodec::compress(data, size, this->buffer + this->bufferUsed);
+    } else {
+        memcpy(this->buffer + this->bufferUsed, data, size);
+        this->bufferUsed += size;
+    }
+}
+
+void SSTBuilder::flushBuffer() {
+    if (this->bufferUsed == 0) {
+        return;
+    }
+    if (pwrite(this->fd, this->buffer, this->bufferUsed, this->written) != this->bufferUsed) {
+        cerr << "Failed to write file: " << this->sst->filepath << endl;
+    }
+    this->written += this->bufferUsed;
+    this->bufferUsed = 0;
+}
+
+void SSTBuilder::finish() {
+    // A last page that is not full is still being filled
+    if (this->numPairs % PAIRS_PER_PAGE != 0) {
+        finishPage();
+    }
+    flushBuffer();
+    this->sst->filesize = this->written;
+    this->sst->numPairs = this->numPairs;
+    this->sst->numTombstones = this->numTombstones;
+    this->sst->lastKey = this->lastKey;
+    this->sst->keyArray = this->keyArray;
+    // Offsets of pages of PAGE_SIZE bytes follow from their number
+    if (this->sst->hasPageOffsets()) {
+        this->sst->pageOffsets = this->pageOffsets;
+    } else {
+        this->sst->pageOffsets.clear();
+    }
+    this->sst->buildIndex();
+    this->filter->build();
+    if (this->rangeFilter != NULL) {
+        this->rangeFilter->build();
+    }
+    this->sst->setFilter(this->filter, this->rangeFilter);
+    this->filter = NULL;
+    this->rangeFilter = NULL;
+    this->sst->writeMetadata(this->fd);
+    close(this->fd);
+}
+
+
 // Functions for debug testing
 void SST::printSST() {
     int fd = open(this->filepath.c_str(), O_RDONLY);
-    int num_pairs = this->filesize / KV_PAIR_SIZE;
-    for (int i = 0; i < num_pairs; i++) {
-        int key, val;
-        pread(fd, &key, sizeof(int), i * KV_PAIR_SIZE);
-        pread(fd, &val, sizeof(int), i * KV_PAIR_SIZE  + sizeof(int));
-        cout << "(" << key << "," << val << ") ";
+    alignas(64) char data[PAGE_SIZE];
+    for (int pagenum = 0; pagenum < this->getNumPages(); pagenum++) {
+        this->readPage(fd, pagenum, data);
+        Page page = this->viewPage(data, pagenum);
+        for (int i = 0; i < page.size(); i++) {
+            cout << "(" << page.key(i) << "," << page.val(i) << ") ";
+        }
     }
+    close(fd);
     cout << endl;
 }
 
@@ -177,9 +582,10 @@ void SST::printKeyArray() {
 }
 
 void SST::printBloomFilter() {
-    cout << "Bloom Filter of " << this->filepath << ": ";
-    for (auto bit : this->bloomFilter) {
-        cout << bit;
+    cout << "Filters of " << this->filepath << ": ";
+    for (size_t i = 0; i < this->filters.size(); i++) {
+        cout << " from " << this->filterKeys[i] << " type " << this->filters[i]->getType()
+             << " " << this->filters[i]->getMemoryUsage() << " bytes ";
     }
     cout << endl;
 }
@@ -11,21 +11,64 @@
 #include <map>
 #include <functional>
 #include "memtable.h"
+#include "filter.h"
+#include "fenceindex.h"
+#include "learnedindex.h"
+#include "page.h"
+#include "lzcodec.h"
 #include <cstdlib>
+#include <cstdint>
+#include <atomic>
 
 using namespace std;
-#define PAGE_SIZE 4096
-#define KV_PAIR_SIZE 8
 #define GET 1
 #define LOWER 2
 #define UPPER 3
 #define BITS_PER_ENTRY 5
-#define HASH_FUNCTION_NUM 3
+// Largest buffer the SST builder fills before writing it out
+#define SST_WRITE_BUFFER_SIZE (4 << 20)
+// Identifies an SST file and the version of its layout
+#define SST_MAGIC 0x4c534d5353544631ULL
+#define SST_FORMAT_VERSION 7
+// More levels than a tree of int keys ever has, file ids of different slots never meet
+#define SST_MAX_LEVELS 64
+
+// An SST file is laid out as
+//   [data pages]   sorted (key, val) pairs, PAIRS_PER_PAGE per page in the layout of pageFormat, each
+//                  page compressed on its own if the SST has a compression. Pages are PAGE_SIZE
+//                  bytes, except the last one and packed or compressed pages
+//   [index block]  first key of every page, then the offset of every page if pages vary in size
+//   [filter block] per filter: smallest key, filter type, size, the filter. A range filter
+//                  follows the filter of its run
+//   [footer]       fixed size, always the last bytes of the file
+// so the metadata of an SST is read without touching its data pages.
+struct SSTFooter {
+    int64_t indexOffset;
+    int64_t filterOffset;
+    int32_t dataSize;
+    int32_t numPairs;
+    // Pairs whose value is a tombstone
+    int32_t numTombstones;
+    int32_t numFences;
+    int32_t numFilters;
+    int32_t minKey;
+    int32_t maxKey;
+    // Filter memory per key, rounded down
+    int32_t filterBitsPerKey;
+    int32_t pageFormat;
+    int32_t compression;
+    // Bits per key the filters were built for
+    double allocatedBitsPerKey;
+    uint32_t version;
+    uint64_t magic;
+};
 
 class SST {
 public:
-    // Constructor
-    SST(int levelnum, string &prefix, bool istemp, vector<function<int(int)>> *hashFunctions);
+    // Constructor for the file of a level in the given slot, which has to exist
+    SST(int levelnum, int slot, string &prefix);
+    // Constructor for an existing file of a level, load its metadata with loadMetadata
+    SST(int levelnum, string &prefix, string &file);
     // Destructor
     ~SST();
 
@@ -33,20 +76,53 @@ public:
     string filepath;
     int levelnum;
     int filesize = 0;
-    bool istemp;
-    int hashFunctionNum;
+    // Tells apart the files of a level, which hold its runs. Slot 0 is the file L<n>, slot k L<n>_<k>
+    int slot;
+    // Lookups of keys in the key range of the SST that it does not have, the ones the filters
+    // rejected and the ones they let through. Counted by bloomFilterCheck and the caller, readers
+    // of the SSTs count them at the same time
+    atomic<long long> filterNegatives{0};
+    atomic<long long> filterFalsePositives{0};
+    // Search the fence keys with a learned index instead of the fence index, set before the
+    // key array is built or loaded
+    bool learnedIndex = false;
+    // Layout of the data pages, set before the SST is built. A loaded SST takes the one of its file
+    PageFormat pageFormat = PAX_PAGE;
+    // Compression of the data pages, set and loaded like pageFormat
+    CompressionType compression = NO_COMPRESSION;
+    // Bits per key the filters were built for, the share of the filter memory of the level the SST
+    // was written for. Set by the SST builder and loaded like pageFormat
+    double allocatedBitsPerKey = 0;
 
-    // Build key array of SST for binary search
-    void buildKeyArray();
     // Set key array
     vector<int> getKeyArray();
-    // Generate file size
-    void generateFileSize();
-    // Build bloom filter of a SST
-    void buildBloomFilter();
-    // Set bloom filter
-    void setBloomFilter(vector<bool>& bloomFilter);
-    // Helper function for binary search the potential page
+    // Set the filter and the range filter, which may be NULL. The SST owns them from now on
+    void setFilter(Filter *filter, Filter *rangeFilter = NULL);
+    // Load file size, key array and filters from the metadata blocks of the file.
+    // Return false if the file is not an SST of the current format
+    bool loadMetadata();
+    // Read the footer of an SST file, return false if it has none
+    static bool readFooter(const string &filepath, SSTFooter &footer);
+    // Smallest and largest key in the SST
+    int getFirstKey();
+    int getLastKey();
+    // Name of the file of a level in a slot
+    static string fileName(int levelnum, int slot);
+    // Pages in the buffer pool are keyed by this number, which no other file of the database has
+    int getFileId();
+    // Give the file the name of a reserved slot of another level and use that name from now on,
+    // keeps the data and metadata. The old name stays until the caller removes it, a crash before
+    // the manifest records the new name finds the file under the old one. Return false if the
+    // file keeps its name
+    bool relink(int levelnum, int slot, string &prefix);
+    // Append the pages of an SST whose keys are all larger, this SST must end with a full page.
+    // Key array and filters of other are appended as well and the metadata blocks are rewritten.
+    // Only done to new SSTs, the manifest never names a file while it changes. Other keeps its
+    // filters. Return false if the file could not be written, the SST is then only good to delete
+    bool append(SST *other);
+    // True if the last page of the SST is full so another SST can be appended
+    bool isPageAligned();
+    // Helper function for searching the potential page, the last page whose first key is not larger
     int binarySearchPage(int key);
     // Get the potential page according to it's type
     // GET = int 1 for get operation
@@ -54,6 +130,28 @@ public:
     // UPPER = int 3 for upperbound in scan operation
     int getPotentialPageNumberOfASST(int key, int type);
     bool bloomFilterCheck(int key); 
+    // False if the SST has no key in [lowerbound, upperbound], answered from the key range and the
+    // range filters without reading a page
+    bool rangeFilterCheck(int lowerbound, int upperbound);
+    int getNumPairs();
+    // Pairs that delete their key, a merge into the deepest level drops them
+    int getNumTombstones();
+    int getNumPages();
+    // Number of pairs in a data page
+    int getPairsInPage(int pagenum);
+    // Read a data page from the open file into PAGE_SIZE bytes at data, packed pages are unpacked
+    // and compressed pages decompressed.
+    // Return false if the page could not be read
+    bool readPage(int fd, int pagenum, char *data);
+    // View of a page read into data by readPage
+    Page viewPage(const char *data, int pagenum);
+    // Bytes of the index over the fence keys, without the fence keys
+    size_t getIndexMemory();
+    // Bytes of all filters, and of all range filters
+    size_t getFilterMemory();
+    size_t getRangeFilterMemory();
+    // False positive rate the filters should have, each filter weighted by its memory
+    double expectedFalsePositiveRate();
     // Print sst for testing puropse
     void printSST();
     void printKeyArray();
@@ -61,9 +159,75 @@ public:
     void printBuffer(KV_Pair* buffer);
 
 private:
+    friend class SSTBuilder;
+    int numPairs = 0;
+    int numTombstones = 0;
+    int lastKey = 0;
+    vector<int> keyArray;
+    // Offset of every page in the file, only kept if pages vary in size. Other pages are PAGE_SIZE bytes
+    vector<int> pageOffsets;
+    // Search tree or learned index over keyArray, rebuilt whenever keyArray changes
+    FenceIndex fenceIndex;
+    LearnedIndex learned;
+    // One filter per run of keys, SSTs appended to this one bring their own filters
+    vector<Filter *> filters;
+    // Smallest key covered by each filter
+    vector<int> filterKeys;
+    // Range filter of each run, NULL if the run has none
+    vector<Filter *> rangeFilters;
+
+    // Write index block, filter block and footer behind the data pages of an open file and sync it,
+    // the file is complete once the footer is on disk. Return false if it is not
+    bool writeMetadata(int fd);
+    // Bytes of a data page in the file and where it starts
+    int getPageSize(int pagenum);
+    int getPageOffset(int pagenum);
+    // True if pages are packed or compressed, so the index block has their offsets
+    bool hasPageOffsets();
+    // Most bytes a data page takes in the file
+    int maxPageSize();
+    // Build the index that binarySearchPage uses over keyArray
+    void buildIndex();
+};
+
+// Writes the sorted pairs of a new SST in one pass. Pairs are collected a page at a time, each page
+// goes to a page aligned buffer in the layout of the SST that is written out in large chunks, while
+// the file size, key array, page offsets and filter are built from the pairs on the way and written
+// behind the data, so the file never has to be read back.
+class SSTBuilder {
+public:
+    // expectedPairs sizes the write buffer and the filter, it may be larger than the number of pairs added.
+    // A range filter is built unless rangeBitsPerKey is 0
+    SSTBuilder(SST *sst, int expectedPairs, FilterType filterType = BLOOM_FILTER, double bitsPerKey = BITS_PER_ENTRY,
+               double rangeBitsPerKey = BITS_PER_ENTRY);
+    ~SSTBuilder();
+    // Add a pair, keys have to be added in increasing order
+    void add(int key, int val);
+    // Write what is left in the buffer and the metadata blocks, install file size, key array and filter in the SST
+    void finish();
+
+private:
+    SST *sst;
+    int fd;
+    char *buffer;
+    int bufferSize;
+    // Page being filled, laid out as a PAX page when pages are packed, and the page before it is compressed
+    char *page;
+    char *encoded;
+    int bufferUsed;
+    // Bytes written to the file so far
+    int written;
+    int numPairs;
+    int numTombstones;
+    int lastKey;
     vector<int> keyArray;
-    vector<bool> bloomFilter;
-    vector<function<int(int)>> *hashFunctions;
+    vector<int> pageOffsets;
+    Filter *filter;
+    Filter *rangeFilter;
+
+    // Move the page being filled to the buffer
+    void finishPage();
+    void flushBuffer();
 };
 
 #endif  // SST_H
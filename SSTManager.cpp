@@ -1,292 +1,904 @@
 #include "SSTManager.h"
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include <thread>
+#include <set>
+#include <dirent.h>
 
-SSTManager::SSTManager() {
-    this->buildAllHashFunctions();
+// Levels without runs
+static const vector<Run> noRuns;
+
+SSTManager::SSTManager() {}
+
+SSTManager::~SSTManager() {
+    delete this->manifest;
+}
+
+bool SSTManager::recover(string& prefix) {
+    if (this->manifest == NULL) {
+        this->manifest = new Manifest(prefix);
+    }
+    vector<ManifestEntry> entries;
+    if (!this->manifest->readLatest(entries)) {
+        return false;
+    }
+    for (auto &entry : entries) {
+        SST *sst = new SST(entry.level, prefix, entry.file);
+        sst->learnedIndex = this->learned_index;
+        // The footer has to agree with the manifest, otherwise the file is not the one recorded
+        if (!sst->loadMetadata() || sst->filesize != entry.dataSize
+            || (sst->filesize > 0 && (sst->getFirstKey() != entry.minKey || sst->getLastKey() != entry.maxKey))) {
+            cerr << "SST does not match the manifest: " << sst->filepath << endl;
+            continue;
+        }
+        // Runs of a level are recorded newest first, the SSTs of a run in key order
+        vector<Run> &runs = this->sstTable[entry.level];
+        if ((int) runs.size() <= entry.run) {
+            runs.resize(entry.run + 1);
+        }
+        runs[entry.run].push_back(sst);
+        this->growTo(entry.level);
+    }
+    // Outputs of merges and new names of moved SSTs that the manifest never recorded
+    set<string> named;
+    for (auto &entry : entries) {
+        named.insert(entry.file);
+    }
+    DIR *dir = opendir(prefix.c_str());
+    for (struct dirent *file = dir == NULL ? NULL : readdir(dir); file != NULL; file = readdir(dir)) {
+        string name = file->d_name;
+        if (name[0] == 'L' && named.count(name) == 0) {
+            std::remove((prefix + name).c_str());
+        }
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    return true;
+}
+
+void SSTManager::logManifest(string& prefix) {
+    if (this->manifest == NULL) {
+        this->manifest = new Manifest(prefix);
+    }
+    vector<ManifestEntry> entries;
+    for (int level = 1; level <= this->max_level; level++) {
+        const vector<Run> &runs = this->getRuns(level);
+        for (size_t run = 0; run < runs.size(); run++) {
+            for (SST *sst : runs[run]) {
+                ManifestEntry entry;
+                entry.level = level;
+                entry.run = run;
+                entry.file = sst->filepath.substr(prefix.size());
+                entry.dataSize = sst->filesize;
+                entry.minKey = sst->getFirstKey();
+                entry.maxKey = sst->getLastKey();
+                entries.push_back(entry);
+            }
+        }
+    }
+    // A crash before the record is on disk recovers the levels of the last one, which may still
+    // name the obsolete files
+    if (!this->manifest->append(entries)) {
+        return;
+    }
+    for (SST *sst : this->obsolete) {
+        delete sst;
+    }
+    for (string &file : this->obsoleteFiles) {
+        std::remove(file.c_str());
+    }
+    this->obsolete.clear();
+    this->obsoleteFiles.clear();
 }
 
-SSTManager::~SSTManager() {}
+void SSTManager::retireSST(SST *sst, BufferPool *bufferpool) {
+    this->evictSST(sst, bufferpool);
+    this->obsolete.push_back(sst);
+}
 
 void SSTManager::createSST(Memtable *memtable, string& prefix, BufferPool *bufferpool) {
-    auto it = this->sstTable.find(1);
-    // If L1 is not empty, convert memtable to L1Temp file for merge
-    if (it != this->sstTable.end()) {
-        SST *sst = new SST(1, prefix, true, &hashFunctions);
-        ofstream sstFile(sst->filepath);
-        memtable->scanToFile(memtable->root, &sstFile);
-        sstFile.close();
-        sst->generateFileSize();
-        // Iterating through the level
-        int level = 1;
-        bool stop = false;
-        while (!stop) {
-            // Merge current level
-            SST *nextsst = mergeSST(this->getSST(level), sst, level, prefix);
-            // Erase curr level SSTs
-            this->deleteSST(level, bufferpool);
-            sst->~SST();
-            // If next level is empty
-            if (!nextsst->istemp) {
-                // Put the merged sst in next level
-                nextsst->buildKeyArray();
-                nextsst->buildBloomFilter();
-                this->sstTable[level + 1] = nextsst;
-                // Update max level
-                if (max_level < level + 1) {
-                    max_level = level + 1;
-                }
-                // Terminate merge algorithm
-                stop = true;
-            } else {
-                sst = nextsst;
-                sst->generateFileSize();
-                level++;
-            }  
+    // The memtable becomes the newest run of L1, merged runs move down until a level keeps them
+    Run run = this->writeMemtable(memtable, prefix);
+    for (SST *sst : run) {
+        this->flushed_bytes += sst->filesize;
+    }
+    this->addRun(run, 1, prefix, bufferpool);
+    // Levels are final after the merges, record them for the next open
+    this->logManifest(prefix);
+}
+
+void SSTManager::addFlushedRun(Run &run, string& prefix) {
+    if (run.empty()) {
+        return;
+    }
+    for (SST *sst : run) {
+        this->flushed_bytes += sst->filesize;
+    }
+    vector<Run> &runs = this->sstTable[1];
+    runs.insert(runs.begin(), run);
+    this->growTo(1);
+    this->logManifest(prefix);
+}
+
+CompactionJob *SSTManager::pickCompaction(string& prefix, BufferPool *bufferpool) {
+    int best = 0;
+    double bestScore = 1;
+    bool moved = false;
+    for (int level = 1; level <= this->max_level; level++) {
+        if (this->compacting.count(level) > 0 || this->compacting.count(level + 1) > 0) {
+            continue;
+        }
+        // SSTs over the capacity of a split leveled level come from one run, so they form a run of
+        // the next level together
+        if (this->getRuns(level).size() == 1 && this->isSplit() && this->isLeveled(level)) {
+            Run moving;
+            for (Run victim = this->takeOverflow(level); !victim.empty(); victim = this->takeOverflow(level)) {
+                moving.push_back(victim[0]);
+            }
+            if (!moving.empty()) {
+                sort(moving.begin(), moving.end(), [](SST *a, SST *b) { return a->getFirstKey() < b->getFirstKey(); });
+                this->moveRun(moving, level + 1, prefix, bufferpool);
+                vector<Run> &next = this->sstTable[level + 1];
+                next.insert(next.begin(), moving);
+                this->growTo(level + 1);
+                moved = true;
+            }
+        }
+        // Levels furthest over their number of runs go first, gets check every run
+        double score = double(this->getRuns(level).size()) / this->runLimit(level);
+        if (score > bestScore) {
+            best = level;
+            bestScore = score;
         }
+    }
+    if (moved) {
+        this->logManifest(prefix);
+    }
+    if (best == 0) {
+        return NULL;
+    }
+    CompactionJob *job = new CompactionJob();
+    job->levelnum = best;
+    const vector<Run> &runs = this->getRuns(best);
+    bool leveled = this->isLeveled(best);
+    job->partial = leveled && this->isSplit();
+    if (job->partial) {
+        // Newer runs merge with the SSTs of the oldest run they overlap, the others stay
+        job->inputs.assign(runs.begin(), runs.end() - 1);
+        int minKey = numeric_limits<int>::max(), maxKey = numeric_limits<int>::min();
+        for (const Run &run : job->inputs) {
+            minKey = min(minKey, run.front()->getFirstKey());
+            maxKey = max(maxKey, run.back()->getLastKey());
+        }
+        const Run &oldest = runs.back();
+        int first = findSST(oldest, minKey);
+        int last = first;
+        while (last < (int) oldest.size() && oldest[last]->getFirstKey() <= maxKey) {
+            last++;
+        }
+        job->overlapped.assign(oldest.begin() + first, oldest.begin() + last);
+        job->outputLevel = best;
     } else {
-        // Create SST if first level is empty
-        SST *sst = new SST(1, prefix, false, &hashFunctions);
-        ofstream sstFile(sst->filepath);
-        memtable->scanToFile(memtable->root, &sstFile);
-        sstFile.close();
-        this->sstTable[1] = sst;
-        sst->generateFileSize();
-        sst->buildKeyArray();
-        sst->buildBloomFilter();
-        // Set max level of LSM Tree
-        if (this->max_level == 0) {
-            this->max_level = 1;
+        // A leveled level keeps the merged run unless it is over capacity, a tiered level hands it on
+        job->inputs = runs;
+        double numPairs = 0;
+        for (const Run &run : runs) {
+            numPairs += getNumPairs(run);
         }
+        job->outputLevel = leveled && numPairs <= this->levelCapacity(best) ? best : best + 1;
+    }
+    job->takenRuns = job->inputs.size();
+    if (!job->overlapped.empty()) {
+        job->inputs.push_back(job->overlapped);
     }
+    job->dropTombstones = this->isDeepest(best);
+    job->filterBits = this->filterBitsForLevel(job->outputLevel);
+    job->inputBytes = 0;
+    job->outputBytes = 0;
+    for (const Run &run : job->inputs) {
+        for (SST *sst : run) {
+            job->inputBytes += sst->filesize;
+        }
+    }
+    this->compacting.insert(best);
+    this->compacting.insert(best + 1);
+    return job;
 }
 
-void SSTManager::deleteSST(int levelnum, BufferPool *bufferpool) {
-    // Evict all the pages in the buffer pool
-    SST *sst = getSST(levelnum);
-    int numPages = sst->filesize / PAGE_SIZE + (sst->filesize % PAGE_SIZE != 0);
-    for (int page = 0; page < numPages; page++) {
+void SSTManager::runCompaction(CompactionJob *job, string& prefix) {
+    // A single run keeps its SSTs, the install moves them if they change level
+    if (job->inputs.size() == 1) {
+        job->output = job->inputs[0];
+        return;
+    }
+    job->output = this->mergeSST(job->inputs, job->outputLevel, prefix, job->dropTombstones, job->filterBits);
+    for (SST *sst : job->output) {
+        job->outputBytes += sst->filesize;
+    }
+}
+
+void SSTManager::installCompaction(CompactionJob *job, string& prefix, BufferPool *bufferpool) {
+    // Flushes may have added newer runs to L1 in the meantime, the taken runs are found by their SSTs
+    vector<Run> &runs = this->sstTable[job->levelnum];
+    for (int i = 0; i < job->takenRuns; i++) {
+        runs.erase(find(runs.begin(), runs.end(), job->inputs[i]));
+    }
+    this->moveRun(job->output, job->outputLevel, prefix, bufferpool);
+    if (job->partial) {
+        Run &oldest = runs.back();
+        int first = job->overlapped.empty() ? (job->output.empty() ? 0 : findSST(oldest, job->output.front()->getFirstKey()))
+                                            : find(oldest.begin(), oldest.end(), job->overlapped.front()) - oldest.begin();
+        oldest.erase(oldest.begin() + first, oldest.begin() + first + job->overlapped.size());
+        oldest.insert(oldest.begin() + first, job->output.begin(), job->output.end());
+        if (oldest.empty()) {
+            runs.pop_back();
+        }
+    } else if (job->outputLevel == job->levelnum) {
+        // The merged run is older than the runs flushed while it was written
+        if (!job->output.empty()) {
+            runs.push_back(job->output);
+        }
+    } else if (!job->output.empty()) {
+        vector<Run> &next = this->sstTable[job->outputLevel];
+        next.insert(next.begin(), job->output);
+        this->growTo(job->outputLevel);
+    }
+    for (Run &run : job->inputs) {
+        for (SST *sst : run) {
+            if (find(job->output.begin(), job->output.end(), sst) == job->output.end()) {
+                this->retireSST(sst, bufferpool);
+            }
+        }
+    }
+    this->compacted_bytes += job->outputBytes;
+    this->largest_compaction_bytes = max(this->largest_compaction_bytes, job->outputBytes);
+    this->compacting.erase(job->levelnum);
+    this->compacting.erase(job->levelnum + 1);
+    this->logManifest(prefix);
+}
+
+void SSTManager::addRun(Run &run, int levelnum, string& prefix, BufferPool *bufferpool) {
+    if (run.empty()) {
+        return;
+    }
+    vector<Run> &runs = this->sstTable[levelnum];
+    this->growTo(levelnum);
+    bool leveled = this->isLeveled(levelnum);
+    // A tiered level takes runs until the run that makes size_ratio of them
+    if (runs.empty() || (!leveled && (int) runs.size() + 1 < this->size_ratio)) {
+        this->moveRun(run, levelnum, prefix, bufferpool);
+        runs.insert(runs.begin(), run);
+        if (leveled && this->isSplit()) {
+            this->moveOverflow(levelnum, prefix, bufferpool);
+        }
+        return;
+    }
+    // A split leveled level only rewrites the SSTs the run overlaps
+    if (leveled && this->isSplit() && runs.size() == 1) {
+        this->mergeOverlapping(run, levelnum, prefix, bufferpool);
+        this->moveOverflow(levelnum, prefix, bufferpool);
+        return;
+    }
+    // A leveled level keeps the merged run unless it is over capacity, a tiered level hands it on.
+    // A run handed on that would merge with the next level right away is not written there: the
+    // runs of all the levels it passes are merged at once, and only the level that keeps the result
+    // is written. Whether a level keeps it is predicted from the pairs of all runs merged so far
+    vector<Run> inputs(1, run);
+    double numPairs = getNumPairs(run);
+    int target = levelnum;
+    bool keep = false;
+    while (true) {
+        vector<Run> &levelRuns = this->sstTable[target];
+        bool leveledTarget = this->isLeveled(target);
+        // Levels below the first one may take the merged run as it is, or merge only the SSTs it overlaps
+        if (target > levelnum && (levelRuns.empty() || (!leveledTarget && (int) levelRuns.size() + 1 < this->size_ratio)
+                                  || (leveledTarget && this->isSplit()))) {
+            break;
+        }
+        for (Run &levelRun : levelRuns) {
+            numPairs += getNumPairs(levelRun);
+        }
+        inputs.insert(inputs.end(), levelRuns.begin(), levelRuns.end());
+        levelRuns.clear();
+        if (leveledTarget && numPairs <= this->levelCapacity(target)) {
+            keep = true;
+            break;
+        }
+        target++;
+    }
+    // Tombstones hide nothing if the result is the only run of its level and no level below has runs
+    bool dropTombstones = (keep || this->getRuns(target).empty()) && this->isDeepest(target);
+    Run merged = this->compactRuns(inputs, target, dropTombstones, prefix, bufferpool);
+    if (!keep) {
+        this->addRun(merged, target, prefix, bufferpool);
+    } else if (!merged.empty()) {
+        this->sstTable[target].push_back(merged);
+    }
+}
+
+void SSTManager::mergeOverlapping(Run &run, int levelnum, string& prefix, BufferPool *bufferpool) {
+    Run &levelRun = this->sstTable[levelnum][0];
+    // The SSTs whose key ranges overlap the run follow each other
+    int first = findSST(levelRun, run.front()->getFirstKey());
+    int last = first;
+    while (last < (int) levelRun.size() && levelRun[last]->getFirstKey() <= run.back()->getLastKey()) {
+        last++;
+    }
+    Run merged = run;
+    if (first == last) {
+        // Nothing to merge with, the SSTs of the run move in as they are
+        this->moveRun(merged, levelnum, prefix, bufferpool);
+    } else {
+        vector<Run> inputs = {run, Run(levelRun.begin() + first, levelRun.begin() + last)};
+        merged = this->compactRuns(inputs, levelnum, this->isDeepest(levelnum), prefix, bufferpool);
+    }
+    levelRun.erase(levelRun.begin() + first, levelRun.begin() + last);
+    levelRun.insert(levelRun.begin() + first, merged.begin(), merged.end());
+    if (levelRun.empty()) {
+        this->sstTable[levelnum].clear();
+    }
+}
+
+void SSTManager::moveOverflow(int levelnum, string& prefix, BufferPool *bufferpool) {
+    for (Run moving = this->takeOverflow(levelnum); !moving.empty(); moving = this->takeOverflow(levelnum)) {
+        this->addRun(moving, levelnum + 1, prefix, bufferpool);
+    }
+}
+
+Run SSTManager::takeOverflow(int levelnum) {
+    if (this->getRuns(levelnum).empty() || getNumPairs(this->getRuns(levelnum)[0]) <= this->levelCapacity(levelnum)) {
+        return Run();
+    }
+    Run &levelRun = this->sstTable[levelnum][0];
+    // Take turns over the key range, the SST after the one that moved on last goes next
+    auto pointer = this->compaction_pointers.find(levelnum);
+    int victim = 0;
+    if (pointer != this->compaction_pointers.end() && pointer->second < numeric_limits<int>::max()) {
+        victim = findSST(levelRun, pointer->second + 1);
+        victim = victim == (int) levelRun.size() ? 0 : victim;
+    }
+    this->compaction_pointers[levelnum] = levelRun[victim]->getLastKey();
+    Run moving(1, levelRun[victim]);
+    levelRun.erase(levelRun.begin() + victim);
+    if (levelRun.empty()) {
+        this->sstTable[levelnum].clear();
+    }
+    return moving;
+}
+
+Run SSTManager::compactRuns(vector<Run> &runs, int levelnum, bool dropTombstones, string& prefix, BufferPool *bufferpool) {
+    // Append instead of merging if the keys do not overlap, e.g. for sequential keys
+    long long compacted = this->compacted_bytes;
+    Run merged;
+    SST *concatenated = this->isSplit() ? NULL : this->concatRuns(runs, levelnum, prefix, dropTombstones);
+    if (concatenated != NULL) {
+        merged.push_back(concatenated);
+    }
+    if (merged.empty()) {
+        merged = this->mergeSST(runs, levelnum, prefix, dropTombstones, this->filterBitsForLevel(levelnum));
+        for (SST *sst : merged) {
+            this->compacted_bytes += sst->filesize;
+        }
+    }
+    this->largest_compaction_bytes = max(this->largest_compaction_bytes, this->compacted_bytes - compacted);
+    for (Run &run : runs) {
+        for (SST *sst : run) {
+            if (find(merged.begin(), merged.end(), sst) == merged.end()) {
+                this->retireSST(sst, bufferpool);
+            }
+        }
+    }
+    return merged;
+}
+
+void SSTManager::moveRun(Run &run, int levelnum, string& prefix, BufferPool *bufferpool) {
+    for (SST *sst : run) {
+        if (sst->levelnum != levelnum) {
+            // Cached pages are keyed by the file, which is about to change
+            this->evictSST(sst, bufferpool);
+            string oldFile = sst->filepath;
+            if (sst->relink(levelnum, this->reserveSlot(levelnum, prefix), prefix)) {
+                this->obsoleteFiles.push_back(oldFile);
+            }
+        }
+    }
+}
+
+int SSTManager::reserveSlot(int levelnum, string& prefix) {
+    // Creating the file fails if it exists, so a slot is never taken twice
+    for (int slot = 0; ; slot++) {
+        string filepath = prefix + SST::fileName(levelnum, slot);
+        int fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd != -1) {
+            close(fd);
+            return slot;
+        }
+        if (errno != EEXIST) {
+            cerr << "Failed to create file: " << filepath << endl;
+            return slot;
+        }
+    }
+}
+
+SST *SSTManager::newSST(int levelnum, string& prefix) {
+    SST *sst = new SST(levelnum, this->reserveSlot(levelnum, prefix), prefix);
+    sst->learnedIndex = this->learned_index;
+    sst->pageFormat = this->page_format;
+    sst->compression = this->compressionForLevel(levelnum);
+    return sst;
+}
+
+Run SSTManager::writeMemtable(Memtable *memtable, string& prefix) {
+    // Every new key grew the memtable by one pair, count them if the size was not tracked
+    int numPairs = memtable->getCurrentSize() / KV_PAIR_SIZE;
+    MemtableIterator it(memtable);
+    if (numPairs == 0) {
+        for (it.seekToFirst(); it.valid(); it.next()) {
+            numPairs++;
+        }
+    }
+    RunBuilder builder(this, 1, prefix, numPairs, this->filterBitsForLevel(1));
+    for (it.seekToFirst(); it.valid(); it.next()) {
+        KV_Pair pair = it.get();
+        builder.add(pair.key, pair.val);
+    }
+    return builder.finish();
+}
+
+void SSTManager::evictSST(SST *sst, BufferPool *bufferpool) {
+    for (int page = 0; page < sst->getNumPages(); page++) {
         bufferpool->evictPages(sst, page);
     }
-    // Deconstruct the SST and erase it from SST Table
-    this->sstTable[levelnum]->~SST();
+}
+
+void SSTManager::deleteSST(int levelnum, BufferPool *bufferpool) {
+    // Evict all the pages in the buffer pool, the files go once the manifest drops the level
+    for (SST *sst : this->getSSTs(levelnum)) {
+        this->retireSST(sst, bufferpool);
+    }
     this->sstTable.erase(levelnum);
 }
 
 SST *SSTManager::getSST(int levelnum) {
-    // Retrieve the vector for the specified level
+    const vector<Run> &runs = this->getRuns(levelnum);
+    return runs.empty() || runs[0].empty() ? NULL : runs[0][0];
+}
+
+const vector<Run> &SSTManager::getRuns(int levelnum) {
     auto it = this->sstTable.find(levelnum);
-    if (it != this->sstTable.end()) {
-        return it->second;
-    } else {
-        return NULL;  // Level not found
-    }
-}
-
-SST *SSTManager::mergeSST(SST *sst1, SST *sst2, int levelnum, string& prefix) {
-    bool nextLevelExist = sstTable.find(levelnum + 1) != sstTable.end();
-    SST* mergedSST = new SST(levelnum + 1, prefix, nextLevelExist, &hashFunctions);
-    // Open files for read and write
-    int sst1_fd = open(sst1->filepath.c_str(), O_RDONLY);
-    int sst2_fd = open(sst2->filepath.c_str(), O_RDONLY);
-    int merged_fd = open(mergedSST->filepath.c_str(), O_WRONLY);
-    // Allocate buffer
-    char* buffer1 = new char[PAGE_SIZE];
-    char* buffer2 = new char[PAGE_SIZE];
-    char* mergedBuffer = new char[PAGE_SIZE];
-    // Keep track the page index
-    int page_idx1 = 0;
-    int page_idx2 = 0;
-    int merge_page = 0; 
-    // Keep track the total index of the file
-    int total_idx1 = 0;
-    int total_idx2 = 0;
-    // Keep track the buffer size
-    int buffer1size = 0;
-    int buffer2size = 0;
-    int mergedIdx = 0;
-
-    // Perform merge operation
-    while (total_idx1 < (sst1->filesize / KV_PAIR_SIZE) && total_idx2 < (sst2->filesize / KV_PAIR_SIZE)) { // as long as both file are not ended
-        // Check if we need to swap in a new page for buffer1
-        if (buffer1size == 0) {
-            // Buffer1 is used up, read a new page
-            buffer1size = PAGE_SIZE;
-            pread(sst1_fd, buffer1, PAGE_SIZE, page_idx1 * PAGE_SIZE);
-            page_idx1++;
-        }
-        // Check if we need to swap in a new page for buffer2
-        if (buffer2size == 0) {
-            // Buffer2 is used up, read a new page
-            buffer2size = PAGE_SIZE;
-            pread(sst2_fd, buffer2, PAGE_SIZE, page_idx2 * PAGE_SIZE);
-            page_idx2++;
-        }
-        // Get key from both sst and compare
-        int key1, key2, val1, val2;
-        int idx1 = total_idx1 % (PAGE_SIZE / KV_PAIR_SIZE);
-        int idx2 = total_idx2 % (PAGE_SIZE / KV_PAIR_SIZE);
-        memcpy(&key1, buffer1 + idx1 * KV_PAIR_SIZE, sizeof(int));
-        memcpy(&val1, buffer1 + idx1 * KV_PAIR_SIZE + sizeof(int), sizeof(int));
-        memcpy(&key2, buffer2 + idx2 * KV_PAIR_SIZE, sizeof(int));
-        memcpy(&val2, buffer2 + idx2 * KV_PAIR_SIZE + sizeof(int), sizeof(int));
-        if (key1 < key2) {
-            // Check if value is a tombstone at max level
-            if (val1 != numeric_limits<int>::min() || levelnum != this->max_level) {
-                // Append pair from sst1 to merged buffer
-                memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE, &key1, sizeof(int));
-                memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE + sizeof(int), &val1, sizeof(int));
-                mergedIdx++;
-            }
-            // If tombstone at max level, discard it and update status
-            total_idx1++;
-            buffer1size -= KV_PAIR_SIZE;
-        } else if (key1 > key2) {
-            // Check if value is a tombstone at max level
-            if (val2 != numeric_limits<int>::min() || levelnum != this->max_level) {
-                // Append pair from sst2 to merged buffer
-                memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE, &key2, sizeof(int));
-                memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE + sizeof(int), &val2, sizeof(int));
-                mergedIdx++;
+    return it != this->sstTable.end() ? it->second : noRuns;
+}
+
+vector<SST *> SSTManager::getSSTs(int levelnum) {
+    vector<SST *> ssts;
+    for (const Run &run : this->getRuns(levelnum)) {
+        ssts.insert(ssts.end(), run.begin(), run.end());
+    }
+    return ssts;
+}
+
+int SSTManager::findSST(const Run &run, int key) {
+    return lower_bound(run.begin(), run.end(), key, [](SST *sst, int key) {
+        return sst->getLastKey() < key;
+    }) - run.begin();
+}
+
+long long SSTManager::getNumPairs(const Run &run) {
+    long long numPairs = 0;
+    for (SST *sst : run) {
+        numPairs += sst->getNumPairs();
+    }
+    return numPairs;
+}
+
+// Position of a merge in one of its runs, pages are read through a view in the layout of their SST
+struct RunCursor {
+    const Run *run;
+    // SST of the run being read and its open file
+    size_t sst;
+    int fd;
+    char *buffer;
+    Page page;
+    int idx;
+
+    bool valid() { return this->sst < this->run->size(); }
+    int key() { return this->page.key(this->idx % PAIRS_PER_PAGE); }
+    // Open the SST the cursor is in, skipping empty ones
+    void open() {
+        while (this->valid() && (*this->run)[this->sst]->getNumPairs() == 0) {
+            this->sst++;
+        }
+        this->fd = this->valid() ? ::open((*this->run)[this->sst]->filepath.c_str(), O_RDONLY) : -1;
+        this->idx = 0;
+        this->load();
+    }
+    // Read the page of the current pair when a new page starts
+    void load() {
+        if (this->valid() && this->idx % PAIRS_PER_PAGE == 0) {
+            SST *sst = (*this->run)[this->sst];
+            sst->readPage(this->fd, this->idx / PAIRS_PER_PAGE, this->buffer);
+            this->page = sst->viewPage(this->buffer, this->idx / PAIRS_PER_PAGE);
+        }
+    }
+    // Move to the first pair whose key is not smaller, the fence keys find its page
+    void seek(int key) {
+        this->sst = SSTManager::findSST(*this->run, key);
+        this->open();
+        if (!this->valid()) {
+            return;
+        }
+        int page = (*this->run)[this->sst]->binarySearchPage(key);
+        if (page > 0) {
+            this->idx = page * PAIRS_PER_PAGE;
+            this->load();
+        }
+        while (this->valid() && this->key() < key) {
+            this->next();
+        }
+    }
+    void next() {
+        this->idx++;
+        if (this->idx < (*this->run)[this->sst]->getNumPairs()) {
+            this->load();
+            return;
+        }
+        close(this->fd);
+        this->sst++;
+        this->open();
+    }
+};
+
+// K-way merge of runs, newest first. The cursors are kept in a min heap on their key and the age of
+// their run, so the newest pair of a key comes first and the older pairs of the key are skipped.
+// Each pair costs O(log k) comparisons however many runs and levels are merged
+class MergeIterator {
+public:
+    // Start at the first pair whose key is not smaller than lowerbound
+    MergeIterator(vector<Run> &runs, int lowerbound) : cursors(runs.size()) {
+        for (size_t i = 0; i < runs.size(); i++) {
+            this->cursors[i].run = &runs[i];
+            this->cursors[i].buffer = new char[PAGE_SIZE];
+            this->cursors[i].seek(lowerbound);
+            if (this->cursors[i].valid()) {
+                this->heap.push_back(i);
             }
-            // If tombstone at max level, discard it and update status
-            total_idx2++;
-            buffer2size -= KV_PAIR_SIZE;
-        } else { // when key1 == key 2
-            // Check if value is a tombstone at max level
-            if (val2 != numeric_limits<int>::min() || levelnum != this->max_level) {
-                // Key is present in both pages, use the value from buffer2
-                memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE, &key2, sizeof(int));
-                memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE + sizeof(int), &val2, sizeof(int));
-                mergedIdx++;
+        }
+        make_heap(this->heap.begin(), this->heap.end(), Later(this->cursors));
+    }
+    ~MergeIterator() {
+        for (RunCursor &cursor : this->cursors) {
+            delete[] cursor.buffer;
+        }
+    }
+    bool valid() { return !this->heap.empty(); }
+    KV_Pair pair() {
+        RunCursor &cursor = this->cursors[this->heap[0]];
+        return cursor.page.pair(cursor.idx % PAIRS_PER_PAGE);
+    }
+    // Move past every pair with the current key
+    void next() {
+        int key = this->cursors[this->heap[0]].key();
+        while (!this->heap.empty() && this->cursors[this->heap[0]].key() == key) {
+            pop_heap(this->heap.begin(), this->heap.end(), Later(this->cursors));
+            RunCursor &cursor = this->cursors[this->heap.back()];
+            cursor.next();
+            if (cursor.valid()) {
+                push_heap(this->heap.begin(), this->heap.end(), Later(this->cursors));
+            } else {
+                this->heap.pop_back();
             }
-            // If tombstone at max level, discard it and update status
-            total_idx1++;
-            total_idx2++;
-            buffer1size -= KV_PAIR_SIZE;
-            buffer2size -= KV_PAIR_SIZE;
-        }
-        // Write/append the whole mergedBuffer to mergedFile
-        if (mergedIdx != 0 && mergedIdx % (PAGE_SIZE / KV_PAIR_SIZE) == 0) {
-            pwrite(merged_fd, mergedBuffer, PAGE_SIZE, merge_page * PAGE_SIZE);
-            mergedIdx = 0;
-            merge_page++;
-
-            // update the file size of merged SST
-            mergedSST->filesize += PAGE_SIZE;
-            // TODO: KEY ARRAY
-            // TODO: BLOOM FILTER
-
-        }
-    }
-    // If file1 has some leftovers
-    while (total_idx1 < (sst1->filesize / KV_PAIR_SIZE)) {
-        // Check if we need to swap in a new page for buffer1
-        if (buffer1size == 0) {
-            // Buffer1 is used up, read a new page
-            buffer1size = PAGE_SIZE;
-            pread(sst1_fd, buffer1, PAGE_SIZE, page_idx1 * PAGE_SIZE);
-            page_idx1++;
-        }
-        // Get key from sst1
-        int key1, val1;
-        int idx1 = total_idx1 % (PAGE_SIZE / KV_PAIR_SIZE);
-        memcpy(&key1, buffer1 + idx1 * KV_PAIR_SIZE, sizeof(int));
-        memcpy(&val1, buffer1 + idx1 * KV_PAIR_SIZE + sizeof(int), sizeof(int));
-        // Check if value is a tombstone at max level
-        if (val1 != numeric_limits<int>::min() || levelnum != this->max_level) {
-            // Append pair from sst1 to merged buffer
-            memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE, &key1, sizeof(int));
-            memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE + sizeof(int), &val1, sizeof(int));
-            mergedIdx++;
-        }
-        // If tombstone at max level, discard it and update status
-        total_idx1++;
-        buffer1size -= KV_PAIR_SIZE;
-        // Write/append the whole mergedBuffer to mergedFile
-        if (mergedIdx != 0 && mergedIdx % (PAGE_SIZE / KV_PAIR_SIZE) == 0) {
-            pwrite(merged_fd, mergedBuffer, PAGE_SIZE, merge_page * PAGE_SIZE);
-            mergedIdx = 0;
-            merge_page++;
-            
-            // update the file size of merged SST
-            mergedSST->filesize += PAGE_SIZE;
-            // TODO: KEY ARRAY
-            // TODO: BLOOM FILTER
-        }
-    }
-    // If file2 has some leftovers
-    while (total_idx2 < (sst2->filesize / KV_PAIR_SIZE)) {
-        // Check if we need to swap in a new page for buffer2
-        if (buffer2size == 0) {
-            // Buffer2 is used up, read a new page
-            buffer2size = PAGE_SIZE;
-            pread(sst2_fd, buffer2, PAGE_SIZE, page_idx2 * PAGE_SIZE);
-            page_idx2++;
-        }
-        // Get key from sst2
-        int key2, val2;
-        int idx2 = total_idx2 % (PAGE_SIZE / KV_PAIR_SIZE);
-        memcpy(&key2, buffer2 + idx2 * KV_PAIR_SIZE, sizeof(int));
-        memcpy(&val2, buffer2 + idx2 * KV_PAIR_SIZE + sizeof(int), sizeof(int));
-        // Check if value is a tombstone at max level
-        if (val2 != numeric_limits<int>::min() || levelnum != this->max_level) {
-            // Append pair from sst2 to merged buffer
-            memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE, &key2, sizeof(int));
-            memcpy(mergedBuffer + mergedIdx * KV_PAIR_SIZE + sizeof(int), &val2, sizeof(int));
-            mergedIdx++;
-        }
-        // If tombstone at max level, discard it and update status
-        total_idx2++;
-        buffer2size -= KV_PAIR_SIZE;
-        // Write/append the whole mergedBuffer to mergedFile
-        if (mergedIdx != 0 && mergedIdx % (PAGE_SIZE / KV_PAIR_SIZE) == 0) {
-            pwrite(merged_fd, mergedBuffer, PAGE_SIZE, merge_page * PAGE_SIZE);
-            mergedIdx = 0;
-            merge_page++;
-
-            // update the file size of merged SST
-            mergedSST->filesize += PAGE_SIZE;
-            // TODO: KEY ARRAY
-            // TODO: BLOOM FILTER
-        }
-    }
-    // Write any remaining data in the mergedBuffer to mergedFile
-    if (mergedIdx > 0) {
-        pwrite(merged_fd, mergedBuffer, mergedIdx * KV_PAIR_SIZE, merge_page * PAGE_SIZE);
-
-        // update the file size of merged SST
-        mergedSST->filesize += mergedIdx * KV_PAIR_SIZE;
-        // TODO: KEY ARRAY
-        // TODO: BLOOM FILTER
-    }
-    // Postprocesses
-    close(sst1_fd);
-    close(sst2_fd);
-    close(merged_fd);
-    // Free memory
-    delete[] buffer1;
-    delete[] buffer2;
-    delete[] mergedBuffer;
-    // Return merged SST
-    return mergedSST;
-}
-
-void SSTManager::buildAllHashFunctions() {
-    // Seed values for the hash functions
-    const size_t seeds[HASH_FUNCTION_NUM] = {
-        0xEA529C2C, 0x9275AD99, 0xADFA52D9
+        }
+    }
+
+private:
+    // Heap order, the cursor with the larger key or on equal keys the older run comes later
+    struct Later {
+        vector<RunCursor> &cursors;
+        Later(vector<RunCursor> &cursors) : cursors(cursors) {}
+        bool operator()(int a, int b) {
+            int keyA = this->cursors[a].key(), keyB = this->cursors[b].key();
+            return keyA > keyB || (keyA == keyB && a > b);
+        }
     };
-    // Populate the vector with hash functions
-    for (int i = 0; i < HASH_FUNCTION_NUM; i++) {
-        size_t seed = seeds[i];
-        function<int(int)> hashFunction = [this, seed](int value) {
-            return this->hashWithSeed(value, seed);
-        };
-        this->hashFunctions.push_back(hashFunction);
+    vector<RunCursor> cursors;
+    // Indexes of the cursors that have pairs left
+    vector<int> heap;
+};
+
+// Bounds of parts key ranges over about as many fence keys each, from the smallest key to one past
+// the largest. Every fence key starts a page of an input, so each range gets about as many pages
+static vector<long long> splitKeyRange(const vector<int> &fences, long long parts) {
+    vector<long long> bounds(1, numeric_limits<int>::min());
+    for (long long i = 1; i < parts; i++) {
+        int key = fences[fences.size() * i / parts];
+        // Keys in the fences of several inputs would give empty ranges
+        if (key > bounds.back() && key > fences[0]) {
+            bounds.push_back(key);
+        }
     }
+    bounds.push_back(numeric_limits<int>::max() + 1LL);
+    return bounds;
 }
 
-size_t SSTManager::hashWithSeed(int key, size_t seed) {
-    size_t hashValue = hash<int>{}(key);
-    // Combine the hash code with the seed using XOR (^)
-    return hashValue ^ seed;
-} 
\ No newline at end of file
+Run SSTManager::mergeSST(vector<Run> &runs, int levelnum, string& prefix, bool dropTombstones, double filterBits) {
+    long long numPairs = 0;
+    for (Run &run : runs) {
+        numPairs += getNumPairs(run);
+    }
+    long long subcompactions = min((long long) this->max_subcompactions, numPairs / SUBCOMPACTION_MIN_PAIRS);
+    if (subcompactions <= 1) {
+        return this->mergeRange(runs, levelnum, prefix, dropTombstones, filterBits, numeric_limits<int>::min(),
+                                numeric_limits<int>::max() + 1LL, numPairs);
+    }
+    vector<int> fences;
+    int numSSTs = 0;
+    for (Run &run : runs) {
+        for (SST *sst : run) {
+            vector<int> keys = sst->getKeyArray();
+            fences.insert(fences.end(), keys.begin(), keys.end());
+            numSSTs++;
+        }
+    }
+    sort(fences.begin(), fences.end());
+    vector<long long> bounds = splitKeyRange(fences, subcompactions);
+    vector<Run> segments(bounds.size() - 1);
+    vector<thread> threads;
+    for (size_t i = 0; i < segments.size(); i++) {
+        // A range holds the pages whose fence key it has, and at most one more page per SST that
+        // starts in the range before
+        long long pages = (lower_bound(fences.begin(), fences.end(), bounds[i + 1])
+                           - lower_bound(fences.begin(), fences.end(), bounds[i])) + numSSTs;
+        long long expectedPairs = min(numPairs, pages * PAIRS_PER_PAGE);
+        threads.push_back(thread([&, i, expectedPairs]() {
+            segments[i] = this->mergeRange(runs, levelnum, prefix, dropTombstones, filterBits, bounds[i],
+                                           bounds[i + 1], expectedPairs);
+        }));
+    }
+    // The ranges are disjoint and in key order, so are the SSTs of their runs
+    Run merged;
+    for (size_t i = 0; i < segments.size(); i++) {
+        threads[i].join();
+        merged.insert(merged.end(), segments[i].begin(), segments[i].end());
+    }
+    return merged;
+}
+
+Run SSTManager::mergeRange(vector<Run> &runs, int levelnum, string& prefix, bool dropTombstones, double filterBits,
+                           long long lowerbound, long long upperbound, long long expectedPairs) {
+    // The builder writes the merged pairs and builds key arrays and filters on the way
+    RunBuilder builder(this, levelnum, prefix, expectedPairs, filterBits);
+    // Packed pages are unpacked into the buffers of the cursors
+    for (MergeIterator it(runs, lowerbound); it.valid(); it.next()) {
+        KV_Pair pair = it.pair();
+        if (pair.key >= upperbound) {
+            break;
+        }
+        // Tombstones with nothing left to hide are discarded
+        if (pair.val != numeric_limits<int>::min() || !dropTombstones) {
+            builder.add(pair.key, pair.val);
+        }
+    }
+    // Write remaining data, set file size, key array and bloom filter of the last SST
+    return builder.finish();
+}
+
+SST *SSTManager::concatRuns(vector<Run> &runs, int levelnum, string& prefix, bool dropTombstones) {
+    // Every run has to be a single SST, stored the same way with the compression of the level, and
+    // the SSTs in key order must not overlap. All but the last one have to end with a full page, so
+    // no append fails half way. The filters are taken over, so they have to have the bits per key of
+    // the level already, otherwise the merge builds them again. Only the merge drops tombstones
+    double filterBits = this->filterBitsForLevel(levelnum);
+    vector<SST *> ssts;
+    for (Run &run : runs) {
+        if (run.size() != 1 || run[0]->filesize == 0 || run[0]->pageFormat != runs[0][0]->pageFormat
+            || run[0]->compression != this->compressionForLevel(levelnum)
+            || abs(run[0]->allocatedBitsPerKey - filterBits) > 1e-9
+            || (dropTombstones && run[0]->getNumTombstones() > 0)) {
+            return NULL;
+        }
+        ssts.push_back(run[0]);
+    }
+    sort(ssts.begin(), ssts.end(), [](SST *a, SST *b) { return a->getFirstKey() < b->getFirstKey(); });
+    for (size_t i = 1; i < ssts.size(); i++) {
+        if (ssts[i - 1]->getLastKey() >= ssts[i]->getFirstKey() || !ssts[i - 1]->isPageAligned()) {
+            return NULL;
+        }
+    }
+    // The inputs stay on disk until the manifest records the new SST instead of them. Fence keys
+    // and filters of the inputs are taken over instead of read back from the result
+    SST *concatenated = this->newSST(levelnum, prefix);
+    concatenated->learnedIndex = ssts[0]->learnedIndex;
+    concatenated->pageFormat = ssts[0]->pageFormat;
+    concatenated->allocatedBitsPerKey = filterBits;
+    for (SST *sst : ssts) {
+        if (!concatenated->append(sst)) {
+            // The inputs are untouched, the merge writes the level instead
+            delete concatenated;
+            return NULL;
+        }
+        this->compacted_bytes += sst->filesize;
+    }
+    return concatenated;
+}
+
+SST *SSTManager::concatSST(SST *levelsst, SST *sst, int levelnum, string& prefix, bool dropTombstones) {
+    vector<Run> runs = { Run(1, levelsst), Run(1, sst) };
+    return this->concatRuns(runs, levelnum, prefix, dropTombstones);
+}
+
+vector<double> SSTManager::allocateFilterBits(FilterType type, double bitsPerKey, const vector<double> &levelKeys) {
+    vector<double> bits(levelKeys.size(), 0.0);
+    double totalKeys = 0, minKeys = 0;
+    for (double keys : levelKeys) {
+        totalKeys += keys;
+        minKeys = minKeys == 0 ? keys : min(minKeys, keys);
+    }
+    if (bitsPerKey <= 0 || totalKeys <= 0) {
+        return bits;
+    }
+    // Level i gets the rate min(1, lambda * keys_i), a larger lambda uses less memory.
+    // Search ln lambda for the largest lambda that stays within the memory
+    double low = -200.0, high = -log(minKeys);
+    for (int iteration = 0; iteration < 100; iteration++) {
+        double mid = (low + high) / 2;
+        double memory = 0;
+        for (double keys : levelKeys) {
+            memory += keys * Filter::bitsForFalsePositiveRate(type, min(1.0, exp(mid) * keys));
+        }
+        if (memory > bitsPerKey * totalKeys) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    for (size_t i = 0; i < levelKeys.size(); i++) {
+        bits[i] = Filter::bitsForFalsePositiveRate(type, min(1.0, exp(high) * levelKeys[i]));
+    }
+    return bits;
+}
+
+CompressionType SSTManager::compressionForLevel(int levelnum) {
+    return levelnum >= this->compression_min_level ? this->compression : NO_COMPRESSION;
+}
+
+bool SSTManager::isSplit() {
+    return this->sst_file_size > 0 && this->buffer_pairs > 0;
+}
+
+bool SSTManager::isDeepest(int levelnum) {
+    for (int level = levelnum + 1; level <= this->max_level; level++) {
+        if (!this->getRuns(level).empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SSTManager::isLeveled(int levelnum) {
+    return this->compaction_policy == LEVELING || (this->compaction_policy == LAZY_LEVELING && levelnum >= this->max_level);
+}
+
+double SSTManager::levelCapacity(int levelnum) {
+    return double(this->buffer_pairs) * (this->size_ratio - 1) * pow(this->size_ratio, levelnum - 1);
+}
+
+int SSTManager::runLimit(int levelnum) {
+    return this->isLeveled(levelnum) ? 1 : this->size_ratio - 1;
+}
+
+void SSTManager::growTo(int levelnum) {
+    lock_guard<mutex> guard(this->filter_mutex);
+    this->max_level = max(this->max_level, levelnum);
+}
+
+double SSTManager::filterBitsForLevel(int levelnum) {
+    if (!this->optimize_filter_memory) {
+        return this->filter_bits_per_key;
+    }
+    // Li holds (T - 1) * T^(i - 1) memtables, in one run if it is leveled and in runs of T^(i - 1)
+    // memtables otherwise. A get checks the filter of every run, so each run gets a false positive
+    // rate for its own size and the deepest level, which holds most keys, gets the fewest bits per
+    // key. A new level moves memory to the upper levels
+    lock_guard<mutex> guard(this->filter_mutex);
+    int levels = max(this->max_level, levelnum);
+    if ((int) this->filter_bits.size() != levels) {
+        vector<double> runKeys;
+        vector<int> firstRun;
+        for (int level = 1; level <= levels; level++) {
+            double levelKeys = (this->size_ratio - 1) * pow(this->size_ratio, level - 1);
+            bool leveled = this->compaction_policy == LEVELING || (this->compaction_policy == LAZY_LEVELING && level == levels);
+            int runs = leveled ? 1 : this->size_ratio - 1;
+            firstRun.push_back(runKeys.size());
+            runKeys.insert(runKeys.end(), runs, levelKeys / runs);
+        }
+        vector<double> bits = allocateFilterBits(this->filter_type, this->filter_bits_per_key, runKeys);
+        this->filter_bits.clear();
+        for (int run : firstRun) {
+            this->filter_bits.push_back(bits[run]);
+        }
+    }
+    return this->filter_bits[levelnum - 1];
+}
+
+vector<double> SSTManager::getFilterAllocation() {
+    vector<double> allocation;
+    for (int level = 1; level <= this->max_level; level++) {
+        allocation.push_back(this->filterBitsForLevel(level));
+    }
+    return allocation;
+}
+
+vector<LevelFilterStats> SSTManager::getFilterStats() {
+    vector<LevelFilterStats> stats;
+    for (int level = 1; level <= this->max_level; level++) {
+        vector<SST *> ssts = this->getSSTs(level);
+        if (ssts.empty()) {
+            continue;
+        }
+        // Rates of a tiered level are per run its gets check, each run weighted by its keys
+        LevelFilterStats levelStats;
+        levelStats.level = level;
+        levelStats.numPairs = 0;
+        levelStats.allocatedBitsPerKey = this->filterBitsForLevel(level);
+        levelStats.expectedFalsePositiveRate = 0;
+        levelStats.lookups = 0;
+        size_t memory = 0;
+        long long falsePositives = 0;
+        for (SST *sst : ssts) {
+            levelStats.numPairs += sst->getNumPairs();
+            levelStats.expectedFalsePositiveRate += sst->expectedFalsePositiveRate() * sst->getNumPairs();
+            levelStats.lookups += sst->filterNegatives + sst->filterFalsePositives;
+            memory += sst->getFilterMemory();
+            falsePositives += sst->filterFalsePositives;
+        }
+        levelStats.bitsPerKey = levelStats.numPairs == 0 ? 0 : memory * 8.0 / levelStats.numPairs;
+        levelStats.expectedFalsePositiveRate = levelStats.numPairs == 0 ? 0 : levelStats.expectedFalsePositiveRate / levelStats.numPairs;
+        levelStats.observedFalsePositiveRate = levelStats.lookups == 0 ? 0 : double(falsePositives) / levelStats.lookups;
+        stats.push_back(levelStats);
+    }
+    return stats;
+}
+
+RunBuilder::RunBuilder(SSTManager *manager, int levelnum, string& prefix, long long expectedPairs, double filterBits) {
+    this->manager = manager;
+    this->levelnum = levelnum;
+    this->prefix = prefix;
+    this->expectedPairs = expectedPairs;
+    this->filterBits = filterBits;
+    // SSTs end with full pages, except the last one of the run
+    int pages = max(1, manager->sst_file_size / PAGE_SIZE);
+    this->pairsPerSST = manager->isSplit() ? pages * PAIRS_PER_PAGE : numeric_limits<int>::max();
+    this->numPairs = 0;
+    this->builder = NULL;
+}
+
+RunBuilder::~RunBuilder() {
+    delete this->builder;
+}
+
+void RunBuilder::add(int key, int val) {
+    if (this->builder == NULL || this->numPairs == this->pairsPerSST) {
+        this->finish();
+        SST *sst = this->manager->newSST(this->levelnum, this->prefix);
+        this->run.push_back(sst);
+        // Pairs of the previous SSTs are no longer expected
+        int expected = max(1LL, min(this->expectedPairs, (long long) this->pairsPerSST));
+        this->expectedPairs -= expected;
+        this->builder = new SSTBuilder(sst, expected, this->manager->filter_type, this->filterBits,
+                                       this->manager->range_filter_bits_per_key);
+        this->numPairs = 0;
+    }
+    this->builder->add(key, val);
+    this->numPairs++;
+}
+
+Run RunBuilder::finish() {
+    if (this->builder != NULL) {
+        this->builder->finish();
+        delete this->builder;
+        this->builder = NULL;
+    }
+    return this->run;
+}
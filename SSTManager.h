@@ -3,17 +3,114 @@
 
 #include <iostream>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include <mutex>
 #include "SST.h"
 #include "memtable.h"
 #include "bufferpool.h"
+#include "manifest.h"
 
 using namespace std;
 
+// A merge is split into subcompactions of at least this many pairs, smaller merges run on one thread
+#define SUBCOMPACTION_MIN_PAIRS (64 * PAIRS_PER_PAGE)
+
+// Filters of the runs of a level, see SSTManager::getFilterStats
+struct LevelFilterStats {
+    int level;
+    int numPairs;
+    // Bits per key the allocation gives new SSTs of the level, and the bits per key the SST has
+    double allocatedBitsPerKey;
+    double bitsPerKey;
+    double expectedFalsePositiveRate;
+    // False positives among the lookups of absent keys that checked the filters
+    double observedFalsePositiveRate;
+    long long lookups;
+};
+
+// How the runs of a level are merged as the tree grows. Level n holds up to (T - 1) * T^(n - 1)
+// memtables for the size ratio T, more runs per level write each pair fewer times but gets and
+// scans read more runs (Dostoevsky, Dayan and Idreos 2018)
+enum CompactionPolicy {
+    // Every level has one run, a run that arrives merges with it. The merged run moves on to the
+    // next level when the level is over its capacity
+    LEVELING = 0,
+    // Every level collects up to T - 1 runs, the T-th merges all of them into one run of the next
+    // level. A pair is written once per level
+    TIERING = 1,
+    // Tiering on every level but the deepest, which holds most of the data in one run
+    LAZY_LEVELING = 2
+};
+
+// A sorted run, SSTs with disjoint key ranges in key order
+typedef vector<SST *> Run;
+
+// A merge of the runs of one level picked for a background thread, see SSTManager::pickCompaction.
+// The inputs stay in the levels while the output is written, readers see them until the install
+struct CompactionJob {
+    // Level the runs are taken from and level the merged run goes to
+    int levelnum;
+    int outputLevel;
+    // Runs of levelnum, newest first, followed by the SSTs of the oldest run of a split leveled level
+    // that they overlap, which the output replaces
+    vector<Run> inputs;
+    int takenRuns;
+    Run overlapped;
+    // The output takes the place of the overlapped SSTs in the oldest run of levelnum
+    bool partial;
+    bool dropTombstones;
+    // Bits per key of the filters of the output, chosen when the job is picked
+    double filterBits;
+    Run output;
+    // Data bytes merged and written
+    long long inputBytes;
+    long long outputBytes;
+};
+
 class SSTManager {
 public:
     // Keep track of max level of LSM Tree
     int max_level = 0;
+    // Filter built for new SSTs
+    FilterType filter_type = BLOOM_FILTER;
+    // Filter memory of the whole tree, in bits per key over the keys of all levels
+    double filter_bits_per_key = BITS_PER_ENTRY;
+    // Divide the filter memory among the levels so that a get for an absent key, which checks the
+    // filter of every level, sees the fewest false positives in total. Otherwise every level gets
+    // filter_bits_per_key
+    bool optimize_filter_memory = true;
+    // Bits per bucket of the range filters that let scans skip SSTs, 0 builds none
+    double range_filter_bits_per_key = BITS_PER_ENTRY;
+    // Find pages with a learned index over the fence keys instead of the fence index
+    bool learned_index = false;
+    // Layout of the pages of new SSTs
+    PageFormat page_format = PAX_PAGE;
+    // Compression of the pages of new SSTs from compression_min_level on, upper levels are read
+    // most often and stay uncompressed
+    CompressionType compression = NO_COMPRESSION;
+    int compression_min_level = 3;
+    // Merge policy and size ratio T between the capacities of adjacent levels. Leveling or tiering
+    // with a size ratio of 2 merge the levels like a binary counter
+    CompactionPolicy compaction_policy = LEVELING;
+    int size_ratio = 2;
+    // Pairs of a full memtable, the capacity of L1 is size_ratio - 1 of them. Without it a leveled
+    // level moves every merged run on to the next level
+    int buffer_pairs = 0;
+    // Bytes of pairs per SST, runs are split into SSTs of this size with disjoint key ranges. A run
+    // that reaches a leveled level then merges only with the SSTs it overlaps, and a level over its
+    // capacity moves one SST at a time on to the next level, so a merge touches a bounded number of
+    // SSTs whatever the size of the tree. 0 keeps every run in one SST, which needs buffer_pairs
+    int sst_file_size = 0;
+    // Split a merge into up to this many subcompactions over disjoint key ranges that run on their
+    // own threads. Each one writes the SSTs of its range, and the merged run is their SSTs in key
+    // order. 1 merges on the calling thread
+    int max_subcompactions = 1;
+    // Data bytes written by flushes and by merges, merged over flushed bytes is the write amplification
+    long long flushed_bytes = 0;
+    long long compacted_bytes = 0;
+    // Data bytes written by the largest single merge
+    long long largest_compaction_bytes = 0;
 
     // Constructor
     SSTManager();
@@ -21,27 +118,162 @@ public:
     // Destructor
     ~SSTManager();
 
-    // Convert memtable to new SST, merge if needed
+    // Rebuild the levels of an existing database from its manifest, only the metadata blocks of
+    // the SSTs are read. SST files the manifest does not name were left by a crash before it
+    // recorded them and are removed. Return false if the database has no manifest yet
+    bool recover(string& prefix);
+
+    // Convert memtable to a new run of L1 and merge runs as the compaction policy asks for
     void createSST(Memtable *memtable, string& prefix, BufferPool *bufferpool);
+    // Write the memtable to a new run of L1 in one pass, the levels are not touched
+    Run writeMemtable(Memtable *memtable, string& prefix);
 
-    // Delete SST metadata in a specific level
+    // Merging in the background. A flush only adds its run to L1, and merges are picked, run and
+    // installed in three steps. Picking and installing change the levels and need the lock of the
+    // readers, running a merge reads its inputs and writes new SSTs without it. Levels a merge
+    // takes runs from or adds a run to are not picked again until its install, so merges of other
+    // levels run at the same time
+    // Add a run written by writeMemtable as the newest run of L1
+    void addFlushedRun(Run &run, string& prefix);
+    // Pick the level furthest over its number of runs among the levels no merge is using, NULL if
+    // no level needs a merge. SSTs of a split level over its capacity move on to the next level
+    // right away, their data stays as it is
+    CompactionJob *pickCompaction(string& prefix, BufferPool *bufferpool);
+    // Merge the inputs of a job into its output
+    void runCompaction(CompactionJob *job, string& prefix);
+    // Replace the inputs of a job by its output and delete the SSTs that are not kept
+    void installCompaction(CompactionJob *job, string& prefix, BufferPool *bufferpool);
+    // Runs a level holds under the compaction policy before they are merged
+    int runLimit(int levelnum);
+
+    // Delete the SSTs of all runs of a level, their files are removed by the next manifest record
     void deleteSST(int levelnum, BufferPool *bufferpool);
 
-    // Get SST metadata for a specific level
+    // Get the first SST of the newest run of a level, the only SST unless the level is tiered or split
     SST *getSST(int levelnum);
+    // Runs of a level from newest to oldest
+    const vector<Run> &getRuns(int levelnum);
+    // SSTs of all runs of a level
+    vector<SST *> getSSTs(int levelnum);
+    // Index of the SST of a run that may have key, the first one whose last key is not smaller.
+    // The size of the run if key is larger than all keys
+    static int findSST(const Run &run, int key);
+    static long long getNumPairs(const Run &run);
+
+    // Merge runs, newest first, into a new run of a level with filterBits bits per key. The newest pair
+    // of a key wins, tombstones are dropped if no older pairs are left below. Large merges are split
+    // into subcompactions at fence keys of the runs
+    Run mergeSST(vector<Run> &runs, int levelnum, string& prefix, bool dropTombstones, double filterBits);
 
-    // Merge two SST
-    SST *mergeSST(SST *sst1, SST *sst2, int levelnum, string& prefix);
+    // Combine the run of a level with a newer run when their keys do not overlap. The pages of both
+    // are copied into a new SST of levelnum as they are, without merging them or building their
+    // filters again. Both are left to the caller to delete. Return NULL if the keys overlap, the
+    // smaller file does not end with a full page, the pages of both are not stored the way
+    // levelnum stores them, e.g. without the compression of the level, their filters were built
+    // for other bits per key than levelnum gets, or tombstones are to be dropped and there are some
+    SST *concatSST(SST *levelsst, SST *sst, int levelnum, string& prefix, bool dropTombstones);
+    // Combine runs of one SST each whose keys do not overlap into a new SST of levelnum like
+    // concatSST. The SSTs of the runs are left to the caller to delete. Return NULL if the runs
+    // cannot all be appended
+    SST *concatRuns(vector<Run> &runs, int levelnum, string& prefix, bool dropTombstones);
+
+    // Bits per key for the filters of new SSTs of each level, index 0 is L1
+    vector<double> getFilterAllocation();
+    // Allocation and false positive rates of the filters of every level that has an SST
+    vector<LevelFilterStats> getFilterStats();
+    // Bits per key for each level that minimize the sum of the false positive rates of all levels,
+    // given the number of keys of each level and bitsPerKey over all keys. Each level gets a false
+    // positive rate proportional to its number of keys (Monkey, Dayan et al. 2017), levels whose
+    // rate would reach 1 get no filter memory
+    static vector<double> allocateFilterBits(FilterType type, double bitsPerKey, const vector<double> &levelKeys);
 
 private:
-    // A hash map that manage all metadata of all SSTs
-    unordered_map<int, SST*> sstTable;
-    // A List of all hash functions that bloom filters will be used
-    vector<function<int(int)>> hashFunctions;
+    friend class RunBuilder;
+    // A hash map from every level to its runs, newest first
+    unordered_map<int, vector<Run>> sstTable;
+    // Last key of the SST each split leveled level moved on last, the next one follows it
+    unordered_map<int, int> compaction_pointers;
+    // Levels that background merges take runs from or add runs to
+    unordered_set<int> compacting;
+    // Log of the SSTs of all levels, appended after every flush
+    Manifest *manifest = NULL;
+    // SSTs and old names of relinked SSTs the levels no longer use. The newest record of the
+    // manifest may still name them, their files are removed once a record without them is on disk
+    vector<SST *> obsolete;
+    vector<string> obsoleteFiles;
+    // Bits per key for new SSTs of each level, computed for as many levels as the tree has. Flushes
+    // and merges in the background build filters while max_level grows, both are guarded
+    vector<double> filter_bits;
+    mutex filter_mutex;
+
+    // Bits per key for the filter of a new SST of a level
+    double filterBitsForLevel(int levelnum);
+    // Compression of the pages of a new SST of a level
+    CompressionType compressionForLevel(int levelnum);
+    // True if the level holds a single run under the compaction policy
+    bool isLeveled(int levelnum);
+    // Pairs a level holds before a leveled level moves its run on
+    double levelCapacity(int levelnum);
+    // Raise max_level to a new deepest level
+    void growTo(int levelnum);
+    // True if runs are split into SSTs of sst_file_size
+    bool isSplit();
+    // True if no level below has a run, so tombstones of a merge into the level hide nothing
+    bool isDeepest(int levelnum);
+    // Add a run to a level, merge it with the runs of the level if the policy asks for it and move
+    // merged runs on to the next levels
+    void addRun(Run &run, int levelnum, string& prefix, BufferPool *bufferpool);
+    // Merge a run into the SSTs of the single run of a split level that it overlaps
+    void mergeOverlapping(Run &run, int levelnum, string& prefix, BufferPool *bufferpool);
+    // Move SSTs of a split level over its capacity on to the next level, one at a time
+    void moveOverflow(int levelnum, string& prefix, BufferPool *bufferpool);
+    // Remove the next SST to move on from the single run of a split level over its capacity, an
+    // empty run if the level is within its capacity
+    Run takeOverflow(int levelnum);
+    // Merge the pairs of runs with keys in [lowerbound, upperbound) into a new run of a level,
+    // expectedPairs sizes the write buffers and filters
+    Run mergeRange(vector<Run> &runs, int levelnum, string& prefix, bool dropTombstones, double filterBits,
+                   long long lowerbound, long long upperbound, long long expectedPairs);
+    // Combine runs, newest first, into one run of a level and delete the SSTs it does not keep
+    Run compactRuns(vector<Run> &runs, int levelnum, bool dropTombstones, string& prefix, BufferPool *bufferpool);
+    // Move the SSTs of a run to free slots of a level, their data stays as it is
+    void moveRun(Run &run, int levelnum, string& prefix, BufferPool *bufferpool);
+    // Create an empty SST in the first free slot of a level, set up for the level
+    SST *newSST(int levelnum, string& prefix);
+    // Reserve the first free slot of a level by creating its file
+    int reserveSlot(int levelnum, string& prefix);
+    // Record the SSTs of all levels in the manifest, then remove the files of obsolete SSTs
+    void logManifest(string& prefix);
+    // Take an SST out of use, its file is removed once the manifest no longer names it
+    void retireSST(SST *sst, BufferPool *bufferpool);
+    // Evict all the pages of an SST from the buffer pool
+    void evictSST(SST *sst, BufferPool *bufferpool);
 
-    size_t hashWithSeed(int key, size_t seed);
-    void buildAllHashFunctions();
+};
+
+// Writes the sorted pairs of a new run of a level in one pass, starts a new SST whenever the one
+// being written holds sst_file_size bytes of pairs
+class RunBuilder {
+public:
+    // expectedPairs sizes the write buffers and filters, it may be larger than the number of pairs added
+    RunBuilder(SSTManager *manager, int levelnum, string& prefix, long long expectedPairs, double filterBits);
+    ~RunBuilder();
+    // Add a pair, keys have to be added in increasing order
+    void add(int key, int val);
+    // Finish the last SST, return the SSTs of the run
+    Run finish();
 
+private:
+    SSTManager *manager;
+    int levelnum;
+    string prefix;
+    long long expectedPairs;
+    double filterBits;
+    // Pairs per SST, rounded to full pages, and pairs in the SST being written
+    int pairsPerSST;
+    int numPairs;
+    Run run;
+    SSTBuilder *builder;
 };
 
 #endif  // SST_MANAGER_H
@@ -0,0 +1,133 @@
+#include "bloomfilter.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <immintrin.h>
+
+bool BloomFilter::useAVX2 = __builtin_cpu_supports("avx2");
+
+// Constructor
+BloomFilter::BloomFilter(int numKeys, double bitsPerKey) {
+    // ln 2 * bits per key probes give the lowest false positive rate
+    this->numProbes = max(1, min(BLOOM_MAX_PROBES, int(round(bitsPerKey * 0.69))));
+    uint64_t numBits = uint64_t(ceil(max(1, numKeys) * max(0.0, bitsPerKey)));
+    // At least one block, with few bits per key it passes almost every key
+    this->resize(max(uint64_t(1), (numBits + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS));
+}
+
+FilterType BloomFilter::getType() const {
+    return BLOOM_FILTER;
+}
+
+size_t BloomFilter::getMemoryUsage() const {
+    return this->numBlocks * BLOOM_BLOCK_WORDS * sizeof(uint64_t);
+}
+
+double BloomFilter::falsePositiveRate() const {
+    const uint64_t *blocks = this->blocks();
+    double rate = 0;
+    for (uint64_t b = 0; b < this->numBlocks; b++) {
+        int bits = 0;
+        for (int w = 0; w < BLOOM_BLOCK_WORDS; w++) {
+            bits += __builtin_popcountll(blocks[b * BLOOM_BLOCK_WORDS + w]);
+        }
+        rate += pow(double(bits) / BLOOM_BLOCK_BITS, this->numProbes);
+    }
+    return rate / this->numBlocks;
+}
+
+void BloomFilter::resize(size_t numBlocks) {
+    this->numBlocks = numBlocks;
+    this->storage.assign((numBlocks + 1) * BLOOM_BLOCK_WORDS, 0);
+}
+
+void BloomFilter::serialize(string &out) const {
+    int32_t numProbes = this->numProbes;
+    out.append(reinterpret_cast<const char *>(&numProbes), sizeof(numProbes));
+    out.append(reinterpret_cast<const char *>(this->blocks()), this->getMemoryUsage());
+}
+
+bool BloomFilter::deserialize(const char *data, size_t size) {
+    int32_t numProbes;
+    if (size < sizeof(numProbes) || (size - sizeof(numProbes)) % (BLOOM_BLOCK_WORDS * sizeof(uint64_t)) != 0) {
+        return false;
+    }
+    memcpy(&numProbes, data, sizeof(numProbes));
+    this->numProbes = numProbes;
+    this->resize((size - sizeof(numProbes)) / (BLOOM_BLOCK_WORDS * sizeof(uint64_t)));
+    memcpy(const_cast<uint64_t *>(this->blocks()), data + sizeof(numProbes), this->getMemoryUsage());
+    return true;
+}
+
+const uint64_t *BloomFilter::blocks() const {
+    // Round the start of the storage up to the next cache line
+    uintptr_t start = (reinterpret_cast<uintptr_t>(this->storage.data()) + 63) & ~uintptr_t(63);
+    return reinterpret_cast<const uint64_t *>(start);
+}
+
+const uint64_t *BloomFilter::block(uint64_t h) const {
+    // High half of the hash picks the block, fast range instead of a modulo
+    return this->blocks() + ((h >> 32) * this->numBlocks >> 32) * BLOOM_BLOCK_WORDS;
+}
+
+// The low half of the hash gives the probe bits inside the block by double hashing
+static inline uint32_t firstBit(uint64_t h) {
+    return uint32_t(h);
+}
+
+static inline uint32_t bitStep(uint64_t h) {
+    return uint32_t(h >> 9) | 1;
+}
+
+void BloomFilter::add(int key) {
+    uint64_t h = hash(key, 0);
+    uint64_t *block = const_cast<uint64_t *>(this->block(h));
+    uint32_t bit = firstBit(h), step = bitStep(h);
+    for (int i = 0; i < this->numProbes; i++, bit += step) {
+        uint32_t pos = bit % BLOOM_BLOCK_BITS;
+        block[pos / 64] |= uint64_t(1) << (pos % 64);
+    }
+}
+
+__attribute__((target("avx2")))
+static bool containsAVX2(const uint64_t *block, uint32_t bit, uint32_t step, int numProbes) {
+    // Positions of four probes per vector, probes past numProbes test bit 0 of the first
+    // probe's word again so they never fail
+    const __m256i ones = _mm256_set1_epi64x(1);
+    const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+    __m256i found = ones;
+    for (int i = 0; i < numProbes; i += 4) {
+        __m256i probe = _mm256_add_epi64(lanes, _mm256_set1_epi64x(i));
+        __m256i pos = _mm256_and_si256(_mm256_add_epi64(_mm256_set1_epi64x(bit), _mm256_mul_epu32(probe, _mm256_set1_epi64x(step))),
+                                       _mm256_set1_epi64x(BLOOM_BLOCK_BITS - 1));
+        __m256i active = _mm256_cmpgt_epi64(_mm256_set1_epi64x(numProbes), probe);
+        // Gather the words of the probes and shift each probe bit down to bit 0
+        __m256i words = _mm256_i64gather_epi64(reinterpret_cast<const long long *>(block), _mm256_srli_epi64(pos, 6), 8);
+        __m256i bits = _mm256_srlv_epi64(words, _mm256_and_si256(pos, _mm256_set1_epi64x(63)));
+        found = _mm256_and_si256(found, _mm256_or_si256(bits, _mm256_andnot_si256(active, ones)));
+    }
+    // Every lane keeps bit 0 only if all its probes were set
+    return _mm256_testc_si256(found, ones);
+}
+
+static bool containsSWAR(const uint64_t *block, uint32_t bit, uint32_t step, int numProbes) {
+    // And the probe bits together without branching
+    uint64_t found = 1;
+    for (int i = 0; i < numProbes; i++, bit += step) {
+        uint32_t pos = bit % BLOOM_BLOCK_BITS;
+        found &= block[pos / 64] >> (pos % 64);
+    }
+    return found & 1;
+}
+
+bool BloomFilter::mayContain(int key) const {
+    if (this->numBlocks == 0) {
+        return false;
+    }
+    uint64_t h = hash(key, 0);
+    const uint64_t *block = this->block(h);
+    if (useAVX2) {
+        return containsAVX2(block, firstBit(h), bitStep(h), this->numProbes);
+    }
+    return containsSWAR(block, firstBit(h), bitStep(h), this->numProbes);
+}
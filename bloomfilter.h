@@ -0,0 +1,48 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <vector>
+#include "filter.h"
+
+using namespace std;
+// A block is one cache line of 512 bits
+#define BLOOM_BLOCK_WORDS 8
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+#define BLOOM_MAX_PROBES 8
+
+// Cache line blocked bloom filter. A key selects one block with a 64 bit hash and sets its probe
+// bits inside that block, so a check costs a single cache miss. All probe bits of a key are
+// tested at once, with AVX2 where the CPU has it and a SWAR loop over the block otherwise.
+class BloomFilter : public Filter {
+public:
+    // Constructor for a filter sized for numKeys keys with bitsPerKey bits each
+    BloomFilter(int numKeys, double bitsPerKey);
+    // A copy would not keep the blocks on a cache line
+    BloomFilter(const BloomFilter &other) = delete;
+    BloomFilter &operator=(const BloomFilter &other) = delete;
+
+    FilterType getType() const;
+    void add(int key);
+    bool mayContain(int key) const;
+    size_t getMemoryUsage() const;
+    // Average over the blocks of the chance that all probe bits are set
+    double falsePositiveRate() const;
+    // Number of probes, then the blocks
+    void serialize(string &out) const;
+    bool deserialize(const char *data, size_t size);
+    // Test the probe bits with AVX2, defaults to whether the CPU supports it
+    static bool useAVX2;
+
+private:
+    // One spare block so the blocks can start on a cache line
+    vector<uint64_t> storage;
+    uint64_t numBlocks;
+    int numProbes;
+
+    const uint64_t *blocks() const;
+    void resize(size_t numBlocks);
+    // Block of a hashed key
+    const uint64_t *block(uint64_t h) const;
+};
+
+#endif  // BLOOM_FILTER_H
@@ -2,11 +2,14 @@
 
 BufferPool::BufferPool() {
     this->referenced.reset(); // Initialize bitmap to all zeros
+    this->occupied.reset();
+    this->loading.reset();
+    this->pins.fill(0);
     this->hand = 0;
 
     // Allocate memory for each item in the buffer
     for (int i = 0; i < BUFFER_SIZE; ++i) {
-        this->data[i] = static_cast<KV_Pair *>(malloc(PAGE_SIZE));
+        this->data[i] = static_cast<char *>(malloc(PAGE_SIZE));
     }
 
     for (int i = 0; i < BUFFER_SIZE; ++i) {
@@ -22,8 +25,10 @@ BufferPool::~BufferPool() {
 }
 
 int BufferPool::findEmptySlot() {
+    // An unreferenced slot may still hold a page, only a slot without a page is empty. A slot whose
+    // page failed to load is empty once its readers gave it up
     for (int i = 0; i < BUFFER_SIZE; ++i) {
-        if (!this->referenced[i]) {
+        if (!this->occupied[i] && this->pins[i] == 0) {
             return i;
         }
     }
@@ -31,8 +36,9 @@ int BufferPool::findEmptySlot() {
 }
 
 int BufferPool::clockEvict() {
-    while (1) {
-        if (!this->referenced[this->hand]) { // If referenced[hand] = 0, means evict this page
+    // Two rounds clear every reference bit, if no page was evicted by then they are all pinned
+    for (int step = 0; step < 2 * BUFFER_SIZE; step++) {
+        if (this->pins[this->hand] == 0 && !this->referenced[this->hand]) { // If referenced[hand] = 0, means evict this page
             // Evict this page
             int evictedIndex = this->hand;
             // Reset the evicted page
@@ -51,6 +57,7 @@ int BufferPool::clockEvict() {
         // Move the hand to the next position
         this->hand = (this->hand + 1) % BUFFER_SIZE;
     }
+    return -1;
 }
 
 int BufferPool::hashKey(int level, int pagenum) {
@@ -65,58 +72,99 @@ int BufferPool::hashKey(int level, int pagenum) {
 }
 
 void BufferPool::evictPages(SST *file, int pagenum) {
+    lock_guard<mutex> guard(this->latch);
     // Check if page is in buffer
     int pageIdx;
-    if (this->dictionary.get(file->levelnum, pagenum, pageIdx)) {
+    if (this->dictionary.get(file->getFileId(), pagenum, pageIdx)) {
         // Mark this page unreferenced
         this->referenced[pageIdx] = 0;
         // Remove hash key from dictionary
-        this->dictionary.remove(file->levelnum, pagenum);
+        this->dictionary.remove(file->getFileId(), pagenum);
         // Reset the reference in hashedKeysInBuffer
         this->hashedKeysInBuffer[pageIdx] = {};
+        this->occupied[pageIdx] = 0;
+        this->released_cv.notify_all();
     }
 }
 
-vector<KV_Pair *> BufferPool::fetchPage(SST *file, int pagenum) {
-    // Creating hash key
-    vector<KV_Pair *> result = {};
+bool BufferPool::fetchPage(SST *file, int pagenum, Page &page) {
+    unique_lock<mutex> guard(this->latch);
+    pair<int, int> hashedKey = make_pair(file->getFileId(), pagenum);
     int pageIndex;
-    if (this->dictionary.get(file->levelnum, pagenum, pageIndex)) {
-        this->referenced[pageIndex] = 1; // Mark as referenced
-    } else {
+    while (true) {
+        if (this->dictionary.get(hashedKey.first, hashedKey.second, pageIndex)) {
+            this->referenced[pageIndex] = 1; // Mark as referenced
+            this->pins[pageIndex]++;
+            // Another reader may still be reading the page from disk
+            this->loaded_cv.wait(guard, [this, pageIndex]() { return !this->loading[pageIndex]; });
+            // The reader that failed to read it gave up the slot
+            if (this->hashedKeysInBuffer[pageIndex] != hashedKey) {
+                this->pins[pageIndex]--;
+                this->released_cv.notify_all();
+                return false;
+            }
+            // The SST knows the number of pairs and the layout of the page
+            page = file->viewPage(data[pageIndex], pagenum);
+            return true;
+        }
         // Page not in the buffer, fetch from disk
         pageIndex = findEmptySlot();
         if (pageIndex == -1) { // If buffer is full,
             // evict a page using clock algorithm
             pageIndex = clockEvict();
         }
-        // Track buffer information
-        // Update the buffer
-        this->dictionary.insert(file->levelnum, pagenum, pageIndex);
-        this->hashedKeysInBuffer[pageIndex] = make_pair(file->levelnum, pagenum);
-        // pread the real data from disk
-        int fd = open(file->filepath.c_str(), O_RDONLY);
-        if (fd == -1) {
-            cerr << "Error reading file" << endl;
-            close(fd);
+        if (pageIndex != -1) {
+            break;
         }
-        // Copy the page to buffer
-        pread(fd, data[pageIndex], PAGE_SIZE, pagenum * PAGE_SIZE);
-        this->referenced[pageIndex] = 1; // Mark as referenced
+        // Every page is in use, wait until a reader releases one and look again
+        this->released_cv.wait(guard);
+    }
+    // Track buffer information
+    // Update the buffer
+    this->dictionary.insert(hashedKey.first, hashedKey.second, pageIndex);
+    this->hashedKeysInBuffer[pageIndex] = hashedKey;
+    this->occupied[pageIndex] = 1;
+    this->referenced[pageIndex] = 1; // Mark as referenced
+    this->pins[pageIndex] = 1;
+    // Other pages can be fetched while this one is read
+    this->loading[pageIndex] = 1;
+    guard.unlock();
+    // pread the real data from disk
+    // Copy the page to buffer, packed pages are unpacked so the buffer holds pages ready to search
+    int fd = open(file->filepath.c_str(), O_RDONLY);
+    bool loaded = fd != -1 && file->readPage(fd, pagenum, data[pageIndex]);
+    if (fd != -1) {
         close(fd);
     }
-    // Get number of KV_Pair in the vector
-    int num_pairs = PAGE_SIZE / KV_PAIR_SIZE;
-    if (file->filesize % PAGE_SIZE != 0 && pagenum == file->filesize / PAGE_SIZE) {
-        num_pairs = (file->filesize % PAGE_SIZE) / KV_PAIR_SIZE;
+    guard.lock();
+    this->loading[pageIndex] = 0;
+    if (!loaded) {
+        cerr << "Error reading page " << pagenum << " of " << file->filepath << endl;
+        // The slot holds no page, readers waiting for it see that and give up their pins
+        this->dictionary.remove(hashedKey.first, hashedKey.second);
+        this->hashedKeysInBuffer[pageIndex] = {};
+        this->occupied[pageIndex] = 0;
+        this->referenced[pageIndex] = 0;
+        this->pins[pageIndex]--;
+    }
+    this->loaded_cv.notify_all();
+    if (!loaded) {
+        this->released_cv.notify_all();
+        return false;
     }
-    // Construct vector of kv pairs
-    for (int i = 0; i < num_pairs; i++) {
-        KV_Pair * pair = data[pageIndex] + i;
-        result.push_back(pair);
+    page = file->viewPage(data[pageIndex], pagenum);
+    return true;
+}
+
+void BufferPool::releasePage(SST *file, int pagenum) {
+    lock_guard<mutex> guard(this->latch);
+    int pageIndex;
+    if (this->dictionary.get(file->getFileId(), pagenum, pageIndex) && this->pins[pageIndex] > 0) {
+        this->pins[pageIndex]--;
+        if (this->pins[pageIndex] == 0) {
+            this->released_cv.notify_all();
+        }
     }
-    // Return vector of kv pairs
-    return result;
 }
 
 void BufferPool::printBufferContents() {
@@ -129,9 +177,11 @@ void BufferPool::printBufferContents() {
 
 // Accessor functions for testing purporse
 HashTable BufferPool::getDictionary() {
+    lock_guard<mutex> guard(this->latch);
     return this->dictionary;
 }
 
 bitset<BUFFER_SIZE> BufferPool::getReference() {
+    lock_guard<mutex> guard(this->latch);
     return this->referenced;
 }
\ No newline at end of file
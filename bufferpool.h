@@ -5,6 +5,9 @@
 #include <vector>
 #include <unordered_map>
 #include <bitset>
+#include <array>
+#include <mutex>
+#include <condition_variable>
 #include "SST.h"
 #include "memtable.h"
 #include "hashTable.h"
@@ -20,22 +23,37 @@ public:
     int hashKey(int level, int pagenum);
     // Evict pages according to deleted SSTs
     void evictPages(SST *file, int pagenum);
-    // FetchPage takes a SST file and page number as input, get the real page from file and store it in bufferpool
-    vector<KV_Pair *> fetchPage(SST *file, int pagenum);
+    // FetchPage takes a SST file and page number as input, get the real page from file and store it in bufferpool.
+    // The page is read in place and pinned, it stays valid until releasePage. Threads may fetch at
+    // the same time, the first one reads a missing page and the others wait for it. Waits while
+    // every page is pinned. Return false if the page could not be read, it is not pinned then
+    bool fetchPage(SST *file, int pagenum, Page &page);
+    // Unpin a page of fetchPage so it can be evicted again
+    void releasePage(SST *file, int pagenum);
     void printBufferContents();
     // Some accessors are created for testing purpose
     HashTable getDictionary();
     bitset<BUFFER_SIZE> getReference();
 
 private:
-    std::array<KV_Pair *, BUFFER_SIZE> data;
+    std::array<char *, BUFFER_SIZE> data;
     // std::unordered_map<int, int> dictionary; // map hashed key to index
     HashTable dictionary;
     std::array<pair<int, int>, BUFFER_SIZE> hashedKeysInBuffer;
     std::bitset<BUFFER_SIZE> referenced;    // bitmap to track referenced pages
+    std::bitset<BUFFER_SIZE> occupied;      // bitmap to track slots that hold a page
     int hand;  // Clock hand position
+    // Guards all of the above but the pages, which are read from disk without it
+    mutex latch;
+    std::array<int, BUFFER_SIZE> pins;      // readers using each page, a pinned page is not evicted
+    std::bitset<BUFFER_SIZE> loading;       // pages still being read from disk
+    // Signals readers of a page that it was read from disk, or that it could not be
+    condition_variable loaded_cv;
+    // Signals fetches waiting for a slot that a page was unpinned or a slot emptied
+    condition_variable released_cv;
 
     int findEmptySlot();
+    // Return -1 if every page is pinned
     int clockEvict();
 };
 
@@ -0,0 +1,153 @@
+#include "compactionscheduler.h"
+
+using namespace std;
+
+static double millisBetween(chrono::steady_clock::time_point start, chrono::steady_clock::time_point end) {
+    return chrono::duration_cast<chrono::microseconds>(end - start).count() / 1000.0;
+}
+
+CompactionScheduler::CompactionScheduler(SSTManager *manager, BufferPool *bufferpool, string prefix, pthread_rwlock_t &installLock, int threads)
+    : installLock(installLock) {
+    this->manager = manager;
+    this->bufferpool = bufferpool;
+    this->prefix = prefix;
+    this->running = 0;
+    this->stopping = false;
+    for (int i = 0; i < threads; i++) {
+        this->workers.push_back(thread(&CompactionScheduler::work, this));
+    }
+}
+
+CompactionScheduler::~CompactionScheduler() {
+    this->waitForIdle();
+    this->queue_mutex.lock();
+    this->stopping = true;
+    this->queue_mutex.unlock();
+    this->work_cv.notify_all();
+    for (thread &worker : this->workers) {
+        worker.join();
+    }
+}
+
+void CompactionScheduler::flush(Memtable *memtable) {
+    // Writing the run reads only the memtable, readers keep using the levels meanwhile
+    Run run = this->manager->writeMemtable(memtable, this->prefix);
+    unique_lock<WriteLock> install_guard(this->installLock);
+    this->install_cv.wait(install_guard, [this]() {
+        return (int) this->manager->getRuns(1).size() < this->manager->runLimit(1) + COMPACTION_STALL_RUNS;
+    });
+    this->manager->addFlushedRun(run, this->prefix);
+    install_guard.unlock();
+    this->schedule();
+}
+
+int CompactionScheduler::schedule() {
+    vector<CompactionJob *> jobs;
+    this->installLock.lock();
+    for (CompactionJob *job = this->manager->pickCompaction(this->prefix, this->bufferpool); job != NULL;
+         job = this->manager->pickCompaction(this->prefix, this->bufferpool)) {
+        jobs.push_back(job);
+    }
+    this->installLock.unlock();
+    if (jobs.empty()) {
+        return 0;
+    }
+    this->queue_mutex.lock();
+    for (CompactionJob *job : jobs) {
+        this->queue.push_back(make_pair(job, chrono::steady_clock::now()));
+    }
+    this->queue_mutex.unlock();
+    this->work_cv.notify_all();
+    return jobs.size();
+}
+
+void CompactionScheduler::waitForIdle() {
+    while (true) {
+        unique_lock<mutex> queue_guard(this->queue_mutex);
+        this->idle_cv.wait(queue_guard, [this]() {
+            return this->queue.empty() && this->running == 0;
+        });
+        queue_guard.unlock();
+        // Workers pick the next merges after every install, a level is only left over if it waited
+        // for another one
+        if (this->schedule() == 0) {
+            return;
+        }
+    }
+}
+
+int CompactionScheduler::getQueueDepth() {
+    lock_guard<mutex> queue_guard(this->queue_mutex);
+    return this->queue.size();
+}
+
+int CompactionScheduler::getRunningJobs() {
+    lock_guard<mutex> queue_guard(this->queue_mutex);
+    return this->running;
+}
+
+vector<CompactionStats> CompactionScheduler::getJobStats() {
+    lock_guard<mutex> queue_guard(this->queue_mutex);
+    return vector<CompactionStats>(this->stats.begin(), this->stats.end());
+}
+
+CompactionTotals CompactionScheduler::getJobTotals() {
+    lock_guard<mutex> queue_guard(this->queue_mutex);
+    return this->totals;
+}
+
+void CompactionScheduler::work() {
+    while (true) {
+        unique_lock<mutex> queue_guard(this->queue_mutex);
+        this->work_cv.wait(queue_guard, [this]() {
+            return !this->queue.empty() || this->stopping;
+        });
+        // Only stop once every queued job is done
+        if (this->queue.empty()) {
+            return;
+        }
+        CompactionJob *job = this->queue.front().first;
+        chrono::steady_clock::time_point queued = this->queue.front().second;
+        this->queue.pop_front();
+        this->running++;
+        queue_guard.unlock();
+        // The inputs stay in the levels while the merge reads them
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        this->manager->runCompaction(job, this->prefix);
+        chrono::steady_clock::time_point merged = chrono::steady_clock::now();
+        this->installLock.lock();
+        chrono::steady_clock::time_point locked = chrono::steady_clock::now();
+        this->manager->installCompaction(job, this->prefix, this->bufferpool);
+        chrono::steady_clock::time_point installed = chrono::steady_clock::now();
+        this->installLock.unlock();
+        this->install_cv.notify_all();
+        CompactionStats stats;
+        stats.levelnum = job->levelnum;
+        stats.outputLevel = job->outputLevel;
+        stats.inputBytes = job->inputBytes;
+        stats.outputBytes = job->outputBytes;
+        stats.queueMillis = millisBetween(queued, start);
+        stats.mergeMillis = millisBetween(start, merged);
+        stats.installMillis = millisBetween(locked, installed);
+        delete job;
+        // The install may leave the next level with too many runs
+        this->schedule();
+        queue_guard.lock();
+        this->stats.push_back(stats);
+        if (this->stats.size() > COMPACTION_STATS_HISTORY) {
+            this->stats.pop_front();
+        }
+        this->totals.jobs++;
+        this->totals.inputBytes += stats.inputBytes;
+        this->totals.outputBytes += stats.outputBytes;
+        this->totals.queueMillis += stats.queueMillis;
+        this->totals.mergeMillis += stats.mergeMillis;
+        this->totals.installMillis += stats.installMillis;
+        if (this->totals.jobs == 1 || stats.mergeMillis > this->totals.slowest.mergeMillis) {
+            this->totals.slowest = stats;
+        }
+        this->running--;
+        queue_guard.unlock();
+        this->idle_cv.notify_all();
+    }
+}
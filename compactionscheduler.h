@@ -0,0 +1,105 @@
+#ifndef COMPACTION_SCHEDULER_H
+#define COMPACTION_SCHEDULER_H
+
+#include "SSTManager.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <pthread.h>
+
+// Flushes wait while L1 holds this many runs more than the compaction policy keeps there, so gets
+// do not check more and more runs when the merges fall behind the puts
+#define COMPACTION_STALL_RUNS 8
+// Number of finished jobs whose stats are kept, older ones only count in CompactionTotals
+#define COMPACTION_STATS_HISTORY 256
+
+// Data a background merge moved and the time it spent in each step, see CompactionScheduler::getJobStats
+struct CompactionStats {
+    int levelnum;
+    int outputLevel;
+    long long inputBytes;
+    long long outputBytes;
+    // Waiting for a worker, merging without any lock and installing the output while readers wait
+    double queueMillis;
+    double mergeMillis;
+    double installMillis;
+};
+
+// Sums over every finished job since the scheduler started, see CompactionScheduler::getJobTotals
+struct CompactionTotals {
+    long long jobs = 0;
+    long long inputBytes = 0;
+    long long outputBytes = 0;
+    double queueMillis = 0;
+    double mergeMillis = 0;
+    double installMillis = 0;
+    // The job that spent the longest time merging
+    CompactionStats slowest = {};
+};
+
+// Exclusive side of a readers-writer lock, so a condition variable can wait on it
+class WriteLock {
+public:
+    explicit WriteLock(pthread_rwlock_t &rwlock) : rwlock(rwlock) {}
+    void lock() { pthread_rwlock_wrlock(&this->rwlock); }
+    void unlock() { pthread_rwlock_unlock(&this->rwlock); }
+
+private:
+    pthread_rwlock_t &rwlock;
+};
+
+// Runs the merges of the levels on a pool of worker threads, so a flush only writes its memtable to
+// a new run of L1. After every flush and every install, the levels that need a merge are picked by
+// how far they are over their number of runs and queued for the workers. A worker merges without
+// any lock and installs the output under the lock the readers of the SSTs hold, so a reader sees the
+// levels as they were before the merge until the install, and never a part of it.
+class CompactionScheduler {
+public:
+    // Readers hold installLock shared while they use the SSTs, flushes and installs take it exclusive
+    CompactionScheduler(SSTManager *manager, BufferPool *bufferpool, string prefix, pthread_rwlock_t &installLock, int threads);
+    // Finish every merge the levels need, then stop the workers
+    ~CompactionScheduler();
+
+    // Write a memtable to a new run of L1 and queue the merges the levels need. Waits while L1 holds
+    // COMPACTION_STALL_RUNS runs too many
+    void flush(Memtable *memtable);
+    // Queue a merge for every level that needs one and that no merge uses, return the number queued
+    int schedule();
+    // Wait until no level needs a merge
+    void waitForIdle();
+    // Jobs waiting for a worker and jobs being merged or installed
+    int getQueueDepth();
+    int getRunningJobs();
+    // Stats of the last COMPACTION_STATS_HISTORY finished jobs, in the order they finished
+    vector<CompactionStats> getJobStats();
+    // Totals of every finished job
+    CompactionTotals getJobTotals();
+
+private:
+    // Main loop of a worker thread
+    void work();
+
+    SSTManager *manager;
+    BufferPool *bufferpool;
+    string prefix;
+    WriteLock installLock;
+    // Signals flushes that wait for L1 that a merge was installed
+    condition_variable_any install_cv;
+    // Picked jobs with the time they were queued, and the bookkeeping of the workers
+    mutex queue_mutex;
+    deque<pair<CompactionJob *, chrono::steady_clock::time_point>> queue;
+    int running;
+    bool stopping;
+    // Recent jobs, oldest first
+    deque<CompactionStats> stats;
+    CompactionTotals totals;
+    // Signals the workers that a job was queued or they should stop
+    condition_variable work_cv;
+    // Signals waitForIdle that a job finished
+    condition_variable idle_cv;
+    vector<thread> workers;
+};
+
+#endif  // COMPACTION_SCHEDULER_H
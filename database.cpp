@@ -2,9 +2,18 @@
 
 
 // Database Constructor
-Database::Database(string name, size_t table_size) {
+Database::Database(string name, size_t table_size, DatabaseOptions options) {
     this->name = name;
     this->table_size = table_size;
+    this->options = options;
+    this->table = NULL;
+    this->bufferpool = NULL;
+    this->sstManager = NULL;
+    this->compactionScheduler = NULL;
+    this->pending_flushes = 0;
+    this->stop_flush = false;
+    pthread_rwlock_init(&this->table_lock, NULL);
+    pthread_rwlock_init(&this->sst_lock, NULL);
 }
 
 
@@ -33,56 +42,204 @@ bool Database::createDirectory(const char *path) {
     #endif
 }
 
-// Combine two vector two make it sorted without duplicates
-vector<KV_Pair *> combineVectors(vector<KV_Pair *> vec1, vector<KV_Pair *> vec2) {
-    vector<KV_Pair *> results;
-    map<int, KV_Pair *> combined_map;
-    // Add kvpair in vec2 so later on vec1 will override
-    for (KV_Pair *kv_pair : vec2) {
-        combined_map[kv_pair->key] = kv_pair;
+bool Database::isThreaded() {
+    return this->options.concurrent || this->options.max_immutable_tables > 0 || this->options.compaction_threads > 0;
+}
+
+void Database::lockTable(bool exclusive) {
+    if (!isThreaded()) {
+        return;
+    }
+    if (exclusive) {
+        pthread_rwlock_wrlock(&this->table_lock);
+    } else {
+        pthread_rwlock_rdlock(&this->table_lock);
+    }
+}
+
+void Database::unlockTable() {
+    if (isThreaded()) {
+        pthread_rwlock_unlock(&this->table_lock);
+    }
+}
+
+void Database::lockSSTs(bool exclusive) {
+    if (!isThreaded()) {
+        return;
     }
-    // Add kvpair in vec1, if there are duplicates, override
-    for (KV_Pair *kv_pair : vec1) {
-        combined_map[kv_pair->key] = kv_pair;
+    if (exclusive) {
+        pthread_rwlock_wrlock(&this->sst_lock);
+    } else {
+        pthread_rwlock_rdlock(&this->sst_lock);
     }
-    // Add values to results vector
-    for (const auto kv_pair : combined_map) {
-        results.push_back(kv_pair.second);
+}
+
+void Database::unlockSSTs() {
+    if (isThreaded()) {
+        pthread_rwlock_unlock(&this->sst_lock);
     }
-    return results;
 }
 
-// Binary search on vector of key value pairs
-int binarySearchKVPairs(vector<KV_Pair *> &pairs, int key) {
-    int low = 0;
-    int high = pairs.size() - 1;
+void Database::flushMemtable() {
+    // Move memtable to SST, the compaction threads merge the runs if there are any
+    if (this->compactionScheduler != NULL) {
+        this->compactionScheduler->flush(this->table);
+    } else {
+        this->sstManager->createSST(this->table, this->SST_PATH, this->bufferpool);
+    }
+    // Flush the memtable
+    delete this->table;
+    this->table = new Memtable(NULL, this->options.concurrent);
+    this->table->setSize(this->table_size);
+}
 
-    while (low <= high) {
-        int mid = low + (high - low) / 2;
-        KV_Pair *midPair = pairs[mid];
+void Database::makeRoomForWrite() {
+    // Without a flush thread, flush the memtable right away
+    if (this->options.max_immutable_tables == 0) {
+        lockTable(true);
+        // Another writer may have flushed the memtable in between
+        if (this->table->getCurrentSize() >= table_size) {
+            flushMemtable();
+        }
+        unlockTable();
+        return;
+    }
+    while (true) {
+        lockTable(true);
+        // Another writer may have swapped the memtable in between
+        if (this->table->getCurrentSize() < table_size) {
+            unlockTable();
+            return;
+        }
+        unique_lock<mutex> flush_guard(this->flush_mutex);
+        if (this->pending_flushes < this->options.max_immutable_tables) {
+            // Make the full memtable read only and let the flush thread move it to SST
+            this->immutables.push_back(this->table);
+            this->table = new Memtable(NULL, this->options.concurrent);
+            this->table->setSize(this->table_size);
+            this->pending_flushes++;
+            flush_guard.unlock();
+            unlockTable();
+            this->flush_cv.notify_one();
+            return;
+        }
+        // Too many memtables are waiting for the flush thread, stall until one is done
+        unlockTable();
+        this->stall_cv.wait(flush_guard, [this]() {
+            return this->pending_flushes < this->options.max_immutable_tables;
+        });
+    }
+}
 
-        if (midPair->key == key) {
-            // Key found, return the value
-            return midPair->val;
-        } else if (midPair->key < key) {
-            low = mid + 1;
+void Database::flushImmutables() {
+    while (true) {
+        unique_lock<mutex> flush_guard(this->flush_mutex);
+        this->flush_cv.wait(flush_guard, [this]() {
+            return this->pending_flushes > 0 || this->stop_flush;
+        });
+        // Finish every pending flush before stopping
+        if (this->pending_flushes == 0) {
+            return;
+        }
+        flush_guard.unlock();
+        // Oldest immutable memtable goes to SST first
+        lockTable(false);
+        Memtable *immutable = this->immutables.front();
+        unlockTable();
+        if (this->compactionScheduler != NULL) {
+            this->compactionScheduler->flush(immutable);
         } else {
-            high = mid - 1;
+            // Readers keep using the levels while the run is written, only adding it excludes them
+            Run run = this->sstManager->writeMemtable(immutable, this->SST_PATH);
+            lockSSTs(true);
+            this->sstManager->addFlushedRun(run, this->SST_PATH);
+            unlockSSTs();
+        }
+        // Data is in the SSTs now, readers can stop looking at the memtable
+        lockTable(true);
+        this->immutables.pop_front();
+        unlockTable();
+        delete immutable;
+        // Without compaction threads the flush is done once the levels are merged
+        if (this->compactionScheduler == NULL) {
+            compactLevels();
         }
+        flush_guard.lock();
+        this->pending_flushes--;
+        flush_guard.unlock();
+        this->stall_cv.notify_all();
+    }
+}
+
+void Database::waitForFlushes() {
+    unique_lock<mutex> flush_guard(this->flush_mutex);
+    this->stall_cv.wait(flush_guard, [this]() {
+        return this->pending_flushes == 0;
+    });
+}
+
+void Database::compactLevels() {
+    while (true) {
+        lockSSTs(true);
+        CompactionJob *job = this->sstManager->pickCompaction(this->SST_PATH, this->bufferpool);
+        unlockSSTs();
+        if (job == NULL) {
+            return;
+        }
+        // The inputs stay in the levels while the merge reads them
+        this->sstManager->runCompaction(job, this->SST_PATH);
+        lockSSTs(true);
+        this->sstManager->installCompaction(job, this->SST_PATH, this->bufferpool);
+        unlockSSTs();
+        delete job;
+    }
+}
+
+// Merge the sorted pairs in result[split, end) into the sorted pairs in result[0, split).
+// Pairs before split come from newer data and win over pairs with the same key after split.
+// The merged pairs are built behind the input and moved to the front, so a result vector
+// reused across scans does not allocate.
+void mergeOlderPairs(vector<KV_Pair> &result, size_t split) {
+    size_t end = result.size();
+    size_t newer = 0;
+    size_t older = split;
+    while (newer < split || older < end) {
+        KV_Pair pair;
+        if (older == end || (newer < split && result[newer].key <= result[older].key)) {
+            pair = result[newer];
+            // Skip the older version of the same key
+            if (older < end && result[older].key == pair.key) {
+                older++;
+            }
+            newer++;
+        } else {
+            pair = result[older];
+            older++;
+        }
+        result.push_back(pair);
+    }
+    size_t merged = result.size() - end;
+    copy(result.begin() + end, result.end(), result.begin());
+    result.resize(merged);
+}
+
+// Append the pairs of a memtable within the scan range, in key order
+void appendMemtableRange(Memtable *table, int lowerbound, int upperbound, vector<KV_Pair> &result) {
+    MemtableIterator it(table);
+    for (it.seek(lowerbound); it.valid() && it.key() <= upperbound; it.next()) {
+        result.push_back(it.get());
     }
-    // Key not found
-    return -1;
 }
 
 // Filter all the keys with tombstone value
-vector<KV_Pair *> filterTombstone(vector<KV_Pair *> pairs) {
-    vector<KV_Pair *> result;
-    for (const auto &pair : pairs) {
-        if (pair->val != numeric_limits<int>::min()) {
-            result.push_back(pair);
+void filterTombstone(vector<KV_Pair> &pairs) {
+    size_t kept = 0;
+    for (size_t i = 0; i < pairs.size(); i++) {
+        if (pairs[i].val != numeric_limits<int>::min()) {
+            pairs[kept++] = pairs[i];
         }
     }
-    return result;
+    pairs.resize(kept);
 }
 
 
@@ -91,7 +248,7 @@ Database *Database::open(string name) {
     // Create Directory to store SSTs
     createDirectory(string("./SSTs/").c_str());
     // Initialize Memtable
-    Memtable *table = new Memtable(NULL);
+    Memtable *table = new Memtable(NULL, this->options.concurrent);
     this->table = table;
     // Set memtable size
     this->table->setSize(this->table_size);
@@ -103,103 +260,202 @@ Database *Database::open(string name) {
     // Initialize SST Manager
     if (this->sstManager == NULL) {
         this->sstManager = new SSTManager();
+        this->sstManager->filter_type = this->options.filter_type;
+        this->sstManager->filter_bits_per_key = this->options.filter_bits_per_key;
+        this->sstManager->optimize_filter_memory = this->options.optimize_filter_memory;
+        this->sstManager->range_filter_bits_per_key = this->options.range_filter_bits_per_key;
+        this->sstManager->learned_index = this->options.learned_index;
+        this->sstManager->page_format = this->options.page_format;
+        this->sstManager->compression = this->options.compression;
+        this->sstManager->compression_min_level = this->options.compression_min_level;
+        this->sstManager->compaction_policy = this->options.compaction_policy;
+        this->sstManager->size_ratio = this->options.size_ratio;
+        this->sstManager->sst_file_size = this->options.sst_file_size;
+        this->sstManager->max_subcompactions = this->options.max_subcompactions;
+        this->sstManager->buffer_pairs = (this->table_size + KV_PAIR_SIZE - 1) / KV_PAIR_SIZE;
+        // Reload the levels written before the database was opened last time
+        this->sstManager->recover(this->SST_PATH);
+    }
+    // Start merging in the background, levels recovered with too many runs are merged right away
+    if (this->options.compaction_threads > 0) {
+        this->compactionScheduler = new CompactionScheduler(this->sstManager, this->bufferpool, this->SST_PATH,
+                                                            this->sst_lock, this->options.compaction_threads);
+        this->compactionScheduler->schedule();
+    }
+    // Start flushing full memtables in the background
+    if (this->options.max_immutable_tables > 0) {
+        this->stop_flush = false;
+        this->flush_thread = thread(&Database::flushImmutables, this);
     }
     return this;
 }
 
 void Database::close() {
+    // Wait until the flush thread moved every immutable memtable to SST
+    if (this->flush_thread.joinable()) {
+        this->flush_mutex.lock();
+        this->stop_flush = true;
+        this->flush_mutex.unlock();
+        this->flush_cv.notify_one();
+        this->flush_thread.join();
+    }
     // If memtable is not empty, transform to SST
-    if (this->table->root != NULL) {
-        this->sstManager->createSST(this->table, this->SST_PATH, this->bufferpool);
+    if (!this->table->isEmpty()) {
+        if (this->compactionScheduler != NULL) {
+            this->compactionScheduler->flush(this->table);
+        } else {
+            this->sstManager->createSST(this->table, this->SST_PATH, this->bufferpool);
+        }
     }
+    // Finish the merges the levels need before the buffer pool goes away
+    delete this->compactionScheduler;
+    this->compactionScheduler = NULL;
     // Deconstruct memtable and buffer pool
     delete this->table;
     this->bufferpool->~BufferPool();
 }
 
 int Database::get(int key) {
-    // Search node in memtable
-    Node * node = this->table->getNode(this->table->root, key);
+    lockTable(false);
+    // Search key in memtable, then in immutable memtables from newest to oldest
+    int value;
+    if (this->table->get(key, value)) {
+        unlockTable();
+        // Return value, even it is a tombstone
+        return value;
+    }
+    for (auto it = this->immutables.rbegin(); it != this->immutables.rend(); it++) {
+        if ((*it)->get(key, value)) {
+            unlockTable();
+            return value;
+        }
+    }
     // If did not exist, search on all SSTs
-    if (node == NULL) {
-        // Traverse each level SST to search for the key
-        for (int level = 1; level <= this->sstManager->max_level; level++) {
-            SST* sst = this->sstManager->getSST(level);
-            if (sst == NULL) { continue; };
+    value = numeric_limits<int>::min();
+    // Readers share the SSTs, the buffer pool pins the pages each of them uses
+    lockSSTs(false);
+    // Traverse the runs of each level from newest to oldest to search for the key
+    bool found = false;
+    for (int level = 1; level <= this->sstManager->max_level && !found; level++) {
+        for (const Run &run : this->sstManager->getRuns(level)) {
+            // Only the SST of the run whose key range may have the key is searched
+            size_t file = SSTManager::findSST(run, key);
+            if (file == run.size()) { continue; };
+            SST *sst = run[file];
             int potential_page = sst->getPotentialPageNumberOfASST(key, GET);
             if (potential_page != -1) {
-                // Retrieve the page from buffer pool
-                vector<KV_Pair *> pairs = this->bufferpool->fetchPage(sst, potential_page);
-                int value = binarySearchKVPairs(pairs, key);
-                // Return value, even it is a tombstone
-                return value;
+                // Retrieve the page from buffer pool and search it in place, a page that cannot be
+                // read is reported by the buffer pool and skipped
+                Page page;
+                if (!this->bufferpool->fetchPage(sst, potential_page, page)) {
+                    continue;
+                }
+                // Return value, even it is a tombstone. If the page does not have the key,
+                // the bloom filter gave a false positive and the key may be in an older run
+                found = page.find(key, value);
+                this->bufferpool->releasePage(sst, potential_page);
+                if (found) {
+                    break;
+                }
+                sst->filterFalsePositives++;
             }
         }
-        // Key does not exist
-        return numeric_limits<int>::min();
     }
-    // Return value, even it is a tombstone
-    return node->val;
+    unlockSSTs();
+    unlockTable();
+    // Key does not exist if no level has it
+    return value;
 }
 
 void Database::put(int key, int val) {
-    // Check for duplicate keys for memtable
-    Node *node = this->table->getNode(this->table->root, key);
-    if (node != NULL) {
-        // Update value if key is in memtable
-        node->val = val;
-    } else {
-        this->table->root = this->table->insertNode(this->table->root, key, val);
+    lockTable(false);
+    // Memtable handles duplicate keys, only a new key grows the memtable
+    bool full = false;
+    if (this->table->put(key, val)) {
         this->table->increSize(KV_PAIR_SIZE);
-        if (this->table->getCurrentSize() >= table_size) {
-            // Move memtable to SST
-            this->sstManager->createSST(table, this->SST_PATH, this->bufferpool);
-            // Flush the memtable
-            delete this->table;
-            Memtable *new_table = new Memtable(NULL);
-            this->table = new_table;
-            this->table->setSize(this->table_size);
-        }
+        full = this->table->getCurrentSize() >= table_size;
+    }
+    unlockTable();
+    if (full) {
+        makeRoomForWrite();
     }
 }
 
 vector<KV_Pair *> Database::scan(int lowerbound, int upperbound) {
-    // Search in memtable
-    vector<KV_Pair *> result = this->table->scanMemtable(this->table->root, lowerbound, upperbound);
+    scan(lowerbound, upperbound, this->scan_buffer);
+    vector<KV_Pair *> result;
+    result.reserve(this->scan_buffer.size());
+    for (KV_Pair &pair : this->scan_buffer) {
+        result.push_back(&pair);
+    }
+    return result;
+}
+
+void Database::scan(int lowerbound, int upperbound, vector<KV_Pair> &result) {
+    result.clear();
+    // Scan is done once every key in the range has a pair, tombstones included
+    long long range_size = (long long) upperbound - lowerbound + 1;
+    lockTable(false);
+    // Search in memtable, then in immutable memtables from newest to oldest
+    appendMemtableRange(this->table, lowerbound, upperbound, result);
+    for (auto it = this->immutables.rbegin(); it != this->immutables.rend(); it++) {
+        size_t split = result.size();
+        appendMemtableRange(*it, lowerbound, upperbound, result);
+        mergeOlderPairs(result, split);
+    }
     // Return if all key from lowerbound to upperbound is already in the result
-    if (int(result.size()) == (upperbound - lowerbound + 1)) {
+    if ((long long) result.size() == range_size) {
+        unlockTable();
         // Check if a tombstone value is in memtable
-        return filterTombstone(result);
-    }
-    // Search in SSTs
-    for (int level = 1; level <= this->sstManager->max_level; level++) {
-        SST* sst = this->sstManager->getSST(level);
-        if (sst == NULL) { continue; };
-        // Determine potential pages for the scan range
-        int lowerbound_pp = sst->getPotentialPageNumberOfASST(lowerbound, LOWER);
-        int upperbound_pp = sst->getPotentialPageNumberOfASST(upperbound, UPPER);
-        // If there are pages contains the range
-        if (lowerbound_pp != -1) {
-            vector<KV_Pair *> pageResults = {};
-            for(int start = lowerbound_pp; start <= upperbound_pp; start++) {
-                // Retrieve the page from the buffer pool
-                vector<KV_Pair *> pairs = this->bufferpool->fetchPage(sst, start);
-                // Iterate through the key-value pairs and add to result if within the range
-                for (const auto &pair : pairs) {
-                    // If page is in between scan range and not a tombstone, add to result
-                    if (pair->val != numeric_limits<int>::min() && pair->key >= lowerbound && pair->key <= upperbound) {
-                        pageResults.push_back(pair);
+        filterTombstone(result);
+        return;
+    }
+    lockSSTs(false);
+    // Search the runs of each level from newest to oldest
+    bool complete = false;
+    for (int level = 1; level <= this->sstManager->max_level && !complete; level++) {
+        for (const Run &run : this->sstManager->getRuns(level)) {
+            // SSTs of a run are in key order, their pairs follow each other
+            size_t split = result.size();
+            for (size_t file = SSTManager::findSST(run, lowerbound); file < run.size() && run[file]->getFirstKey() <= upperbound; file++) {
+                SST *sst = run[file];
+                // Skip the SST without any page I/O if it has no key in the range
+                if (!sst->rangeFilterCheck(lowerbound, upperbound)) { continue; };
+                // Determine potential pages for the scan range
+                int lowerbound_pp = sst->getPotentialPageNumberOfASST(lowerbound, LOWER);
+                int upperbound_pp = sst->getPotentialPageNumberOfASST(upperbound, UPPER);
+                // If there are pages contains the range
+                if (lowerbound_pp == -1) { continue; };
+                for(int start = lowerbound_pp; start <= upperbound_pp; start++) {
+                    // Retrieve the page from the buffer pool, pairs are copied before it is released. A
+                    // page that cannot be read is reported by the buffer pool and skipped
+                    Page page;
+                    if (!this->bufferpool->fetchPage(sst, start, page)) {
+                        continue;
                     }
+                    // Add the key-value pairs within the range, the first and last page are searched for the
+                    // ends of the range. Tombstones are kept so they hide older values in older runs
+                    int first = start == lowerbound_pp ? page.lowerBound(lowerbound) : 0;
+                    int last = start == upperbound_pp ? page.upperBound(upperbound) : page.size();
+                    for (int i = first; i < last; i++) {
+                        result.push_back(page.pair(i));
+                    }
+                    this->bufferpool->releasePage(sst, start);
                 }
             }
-            result = combineVectors(result, pageResults);
-            // Return if all key from lowerbound to upperbound is already in the result
-            if (int(result.size()) == (upperbound - lowerbound + 1)) {
-                return filterTombstone(result);
+            if (result.size() > split) {
+                mergeOlderPairs(result, split);
+                // Return if all key from lowerbound to upperbound is already in the result
+                complete = (long long) result.size() == range_size;
+                if (complete) {
+                    break;
+                }
             }
         }
     }
-    return filterTombstone(result);
+    unlockSSTs();
+    unlockTable();
+    filterTombstone(result);
 }
 
 void Database::delete_(int key) {
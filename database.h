@@ -4,8 +4,56 @@
 #include "memtable.h"
 #include "bufferpool.h"
 #include "SSTManager.h"
+#include "compactionscheduler.h"
 #include "hashTable.h"
+#include "page.h"
 #include <sys/stat.h>
+#include <pthread.h>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+
+// Settings chosen when a database is constructed
+struct DatabaseOptions {
+    // Let several threads call put, update and delete_ at the same time
+    bool concurrent = false;
+    // Number of full memtables that may wait for the background flush thread before put stalls.
+    // 0 flushes the memtable to SST inside put, without a background thread
+    int max_immutable_tables = 0;
+    // Filter built for new SSTs, a binary fuse filter uses less memory for a lower false positive rate
+    // but keeps the keys of an SST in memory until the SST is written
+    FilterType filter_type = BLOOM_FILTER;
+    // Filter memory in bits per key over all keys, divided among the levels to minimize the false
+    // positives of a get unless optimize_filter_memory is false
+    double filter_bits_per_key = BITS_PER_ENTRY;
+    bool optimize_filter_memory = true;
+    // Bits per bucket of 16 keys for the range filters that let short scans skip levels, 0 builds none
+    double range_filter_bits_per_key = BITS_PER_ENTRY;
+    // Find pages with a learned index over the fence keys, which takes a few segments instead of
+    // a search tree when keys are close to evenly spaced
+    bool learned_index = false;
+    // Layout of the data pages of new SSTs, keys apart from values search fewer cache lines
+    PageFormat page_format = PAX_PAGE;
+    // Compress the pages of SSTs from compression_min_level on with an LZ codec. The deep levels
+    // hold most of the data and are read least often, L1 and L2 stay uncompressed by default
+    CompressionType compression = NO_COMPRESSION;
+    int compression_min_level = 3;
+    // How runs are merged down the levels and the size ratio between adjacent levels. Tiering writes
+    // each pair fewer times for write heavy loads, leveling keeps one run per level for fast gets and
+    // scans, lazy leveling tiers all but the deepest level in between
+    CompactionPolicy compaction_policy = LEVELING;
+    int size_ratio = 2;
+    // Split runs into SSTs of this many bytes of pairs with disjoint key ranges, so a merge into a
+    // leveled level rewrites only the SSTs it overlaps. 0 keeps every run in one SST
+    int sst_file_size = 0;
+    // Merge runs on this many background threads. A flush then only adds its run to L1, and readers
+    // use the levels as they were until a merge is installed. 0 merges inside the flush
+    int compaction_threads = 0;
+    // Split a merge of large runs into up to this many key ranges merged on threads of their own, so
+    // a merge into a deep level uses more than one core. 1 merges on a single thread
+    int max_subcompactions = 1;
+};
 
 class Database {
     public:
@@ -13,35 +61,81 @@ class Database {
         string name;
 
         // Constructor
-        Database(string name, size_t table_size);
+        Database(string name, size_t table_size, DatabaseOptions options = DatabaseOptions());
 
         // Database API
         Database *open(string name);
         void close();
         int get(int key);
         void put(int key, int val);
+        // Pairs point into a buffer owned by the database and stay valid until the next scan
         vector<KV_Pair *> scan(int lowerbound, int upperbound);
+        // Scan into a vector owned by the caller, reusing it across scans avoids any allocation.
+        // Use this one when several threads scan at the same time
+        void scan(int lowerbound, int upperbound, vector<KV_Pair> &result);
         void delete_(int key);
         void update(int key, int value);
+        // Wait until the flush thread has moved every full memtable to SST, and merged the levels
+        // after it unless compaction threads do
+        void waitForFlushes();
 
         // Other helper functions
         vector <string *> listSSTs();
         // Function creates directory
         bool createDirectory(const char *path);
+        // Move the full memtable to SST and start a new one
+        void flushMemtable();
+        // Called by put when the memtable is full, flush it or hand it to the flush thread
+        void makeRoomForWrite();
+        // Main loop of the background flush thread
+        void flushImmutables();
+        // Merge the levels that need it on the flush thread like the compaction threads do, one
+        // merge at a time. sst_lock is only held exclusive to pick a merge and to install it
+        void compactLevels();
+        // True if more than one thread may use the database
+        bool isThreaded();
+        // Take or release table_lock, does nothing unless the database is threaded
+        void lockTable(bool exclusive);
+        void unlockTable();
+        // Take or release sst_lock, does nothing unless the database is threaded
+        void lockSSTs(bool exclusive);
+        void unlockSSTs();
         // Accessors for private data for testing purpose
         BufferPool* getBufferPool();
         // Accessors for private data for testing purpose
         SSTManager *getsstManager() {return sstManager;};
+        // NULL unless compaction_threads is set
+        CompactionScheduler *getCompactionScheduler() {return compactionScheduler;};
 
     private:
+        DatabaseOptions options;
         // Keep track of current memtable
         Memtable *table;
+        // Results of the scan that returns pointers
+        vector<KV_Pair> scan_buffer;
+        // Full memtables waiting to be flushed, oldest first. Read only until they are flushed
+        deque<Memtable *> immutables;
+        // Held shared while using the memtables and exclusive while swapping them
+        pthread_rwlock_t table_lock;
+        // Held shared while reading the SSTs and exclusive while flushes and merges change the levels
+        pthread_rwlock_t sst_lock;
+        // Background flush thread and its bookkeeping, guarded by flush_mutex
+        thread flush_thread;
+        mutex flush_mutex;
+        // Signals the flush thread that there is an immutable memtable or it should stop
+        condition_variable flush_cv;
+        // Signals stalled writers that an immutable memtable has been flushed
+        condition_variable stall_cv;
+        int pending_flushes;
+        bool stop_flush;
         // SST path
         string SST_PATH;
         // Buffer pool
         BufferPool *bufferpool;
         // SST Manager that manages the metadata of all SSTs
         SSTManager *sstManager;
+        // Merges runs in the background if compaction_threads is set, installs take sst_lock
+        CompactionScheduler *compactionScheduler;
 };
 
 #endif
\ No newline at end of file
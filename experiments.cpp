@@ -68,11 +68,13 @@ void performExperiment(Database *database, vector<int> data, string size) {
         cout << "Performing scan operations" << endl;
         // Since scan in step 1 is very costful, we only scan 1000 times to estimates the throughput
         // Record start time
+        // Reuse one result vector so scans do not allocate
+        vector<KV_Pair> scan_result;
         auto scan_start_time = chrono::high_resolution_clock::now();
         for (int j = 0; j < 1000; j++) {
             int key = randomNumber(0, volume);
             int range = randomNumber(0, 15);
-            database->scan(key, key + range);
+            database->scan(key, key + range, scan_result);
         }
         // Record time after completing operations for this volume
         auto scan_end_time = chrono::high_resolution_clock::now();
@@ -88,10 +90,846 @@ void performExperiment(Database *database, vector<int> data, string size) {
     }
 }
 
+// Experiment for put operation with a growing number of writer threads, then for get operation
+// with as many reader threads on the loaded database
+void performConcurrentExperiment(size_t table_size, int volume) {
+    for (int writers = 1; writers <= 16; writers *= 2) {
+        // Start every round from an empty database
+        system("rm -f -r ./SSTs/databaseConcurrent/*");
+        DatabaseOptions options;
+        options.concurrent = true;
+        Database *database = new Database("databaseConcurrent", table_size, options);
+        database->open("databaseConcurrent");
+        cout << "Performing put operations with " << writers << " writers" << endl;
+        // Record start time
+        auto put_start_time = chrono::high_resolution_clock::now();
+        vector<thread> threads;
+        for (int t = 0; t < writers; t++) {
+            // Each writer puts every writers-th key so all threads insert into the same key range
+            threads.push_back(thread([database, t, writers, volume]() {
+                for (int key = t; key < volume; key += writers) {
+                    database->put(key, key * 10);
+                }
+            }));
+        }
+        for (auto &writer : threads) {
+            writer.join();
+        }
+        // Record time after all writers completed
+        auto put_end_time = chrono::high_resolution_clock::now();
+        auto put_duration = chrono::duration_cast<std::chrono::milliseconds>(put_end_time - put_start_time).count();
+        // Calculate throughput in MB/sec
+        double put_throughput = (double(volume) * KV_PAIR_SIZE / MB) / (put_duration / 1000.0);
+        // Keep track of experiment
+        cout << volume << " Put Operations with " << writers << " writers completed in " << put_duration << "ms" << endl;
+        // Write the result for put to file
+        ofstream put_outputFile("concurrent_put_results.txt", ios::app);
+        put_outputFile << writers << "," << put_throughput << endl;
+        put_outputFile.close();
+        // Readers share the SSTs, most keys are no longer in the memtable
+        const int gets = 100000;
+        int readers = writers;
+        cout << "Performing get operations with " << readers << " readers" << endl;
+        auto get_start_time = chrono::high_resolution_clock::now();
+        threads.clear();
+        for (int t = 0; t < readers; t++) {
+            threads.push_back(thread([database, t, readers, volume]() {
+                mt19937 generator(t);
+                uniform_int_distribution<int> distribution(0, volume - 1);
+                for (int i = t; i < gets; i += readers) {
+                    database->get(distribution(generator));
+                }
+            }));
+        }
+        for (auto &reader : threads) {
+            reader.join();
+        }
+        auto get_end_time = chrono::high_resolution_clock::now();
+        auto get_duration = chrono::duration_cast<std::chrono::milliseconds>(get_end_time - get_start_time).count();
+        // Calculate throughput in operations/sec
+        double get_throughput = gets / (get_duration / 1000.0);
+        cout << gets << " Get Operations with " << readers << " readers completed in " << get_duration << "ms" << endl;
+        ofstream get_outputFile("concurrent_get_results.txt", ios::app);
+        get_outputFile << readers << "," << get_throughput << endl;
+        get_outputFile.close();
+        // Close the database
+        database->close();
+    }
+}
+
+// Experiment for put latency with and without a background flush thread
+void performLatencyExperiment(size_t table_size, int volume) {
+    for (int max_immutable_tables : {0, 1, 4}) {
+        // Start every round from an empty database
+        system("rm -f -r ./SSTs/databaseLatency/*");
+        DatabaseOptions options;
+        options.max_immutable_tables = max_immutable_tables;
+        Database *database = new Database("databaseLatency", table_size, options);
+        database->open("databaseLatency");
+        cout << "Performing put operations with " << max_immutable_tables << " immutable memtables" << endl;
+        // Time every single put
+        vector<long long> latencies(volume);
+        for (int key = 0; key < volume; key++) {
+            auto put_start_time = chrono::high_resolution_clock::now();
+            database->put(key, key * 10);
+            auto put_end_time = chrono::high_resolution_clock::now();
+            latencies[key] = chrono::duration_cast<std::chrono::nanoseconds>(put_end_time - put_start_time).count();
+        }
+        database->close();
+        // Report latency percentiles in microseconds
+        sort(latencies.begin(), latencies.end());
+        double p50 = latencies[volume / 2] / 1000.0;
+        double p99 = latencies[(size_t) (volume * 0.99)] / 1000.0;
+        double p999 = latencies[(size_t) (volume * 0.999)] / 1000.0;
+        double max_latency = latencies[volume - 1] / 1000.0;
+        cout << "p50 " << p50 << "us, p99 " << p99 << "us, p99.9 " << p999 << "us, max " << max_latency << "us" << endl;
+        // Write the result for put latency to file
+        ofstream latency_outputFile("put_latency_results.txt", ios::app);
+        latency_outputFile << max_immutable_tables << "," << p50 << "," << p99 << "," << p999 << "," << max_latency << endl;
+        latency_outputFile.close();
+    }
+}
+
+// Microbenchmark for memtable inserts, the old get then insert path against single walk upsert
+void performUpsertExperiment(int volume) {
+    // Keys in sequential and random order, the random order is the same for both paths
+    vector<int> sequential_keys(volume);
+    for (int i = 0; i < volume; i++) {
+        sequential_keys[i] = i;
+    }
+    vector<int> random_keys = sequential_keys;
+    shuffle(random_keys.begin(), random_keys.end(), mt19937(42));
+    vector<pair<string, vector<int> *>> orders = {{"sequential", &sequential_keys}, {"random", &random_keys}};
+
+    for (auto &order : orders) {
+        vector<int> &keys = *order.second;
+        // Current path of Database::put before single walk upsert: getNode, then insertNode
+        Memtable *old_table = new Memtable(NULL);
+        old_table->setSize(size_t(volume) * KV_PAIR_SIZE);
+        auto old_start_time = chrono::high_resolution_clock::now();
+        for (int key : keys) {
+            Node *node = old_table->getNode(old_table->root, key);
+            if (node != NULL) {
+                node->val = key * 10;
+            } else {
+                old_table->root = old_table->insertNode(old_table->root, key, key * 10);
+            }
+        }
+        auto old_end_time = chrono::high_resolution_clock::now();
+        delete old_table;
+
+        // Single walk upsert
+        Memtable *new_table = new Memtable(NULL);
+        new_table->setSize(size_t(volume) * KV_PAIR_SIZE);
+        auto new_start_time = chrono::high_resolution_clock::now();
+        for (int key : keys) {
+            new_table->upsert(key, key * 10);
+        }
+        auto new_end_time = chrono::high_resolution_clock::now();
+        delete new_table;
+
+        // Calculate cost per insert in ns
+        double old_ns = chrono::duration_cast<std::chrono::nanoseconds>(old_end_time - old_start_time).count() / double(volume);
+        double new_ns = chrono::duration_cast<std::chrono::nanoseconds>(new_end_time - new_start_time).count() / double(volume);
+        cout << volume << " " << order.first << " inserts: get + insertNode " << old_ns << "ns/op, upsert " << new_ns << "ns/op" << endl;
+        // Write the result for upsert to file
+        ofstream upsert_outputFile("upsert_results.txt", ios::app);
+        upsert_outputFile << order.first << "," << old_ns << "," << new_ns << endl;
+        upsert_outputFile.close();
+    }
+}
+
+// Experiment for the time Database::open needs to reload an existing database from its manifest
+void performStartupExperiment(size_t table_size, int volume) {
+    system("rm -f -r ./SSTs/databaseStartup/*");
+    Database *database = new Database("databaseStartup", table_size);
+    database->open("databaseStartup");
+    cout << "Loading " << (size_t(volume) * KV_PAIR_SIZE / MB) << "MB of data" << endl;
+    for (int key = 0; key < volume; key++) {
+        database->put(key, key * 10);
+    }
+    database->close();
+
+    // Reopen the database in a new object, like a restarted process
+    auto open_start_time = chrono::high_resolution_clock::now();
+    Database *reopened = new Database("databaseStartup", table_size);
+    reopened->open("databaseStartup");
+    auto open_end_time = chrono::high_resolution_clock::now();
+    double open_duration = chrono::duration_cast<std::chrono::microseconds>(open_end_time - open_start_time).count() / 1000.0;
+    cout << "Database::open completed in " << open_duration << "ms with " << reopened->getsstManager()->max_level << " levels" << endl;
+    // Check that the recovered levels answer queries
+    for (int i = 0; i < 1000; i++) {
+        int key = randomNumber(0, volume - 1);
+        if (reopened->get(key) != key * 10) {
+            cerr << "Key " << key << " was not recovered" << endl;
+            break;
+        }
+    }
+    reopened->close();
+    // Write the result for startup to file
+    ofstream startup_outputFile("startup_results.txt", ios::app);
+    startup_outputFile << (size_t(volume) * KV_PAIR_SIZE / MB) << "," << open_duration << endl;
+    startup_outputFile.close();
+}
+
+// Time the checks of a filter for the keys in it and for absent keys, report the false positive rate
+template <typename Contains>
+void measureFilter(string order, string name, double bits_per_key, Contains contains, vector<int> &keys, vector<int> &absent) {
+    // Every key in the filter has to pass
+    int misses = 0;
+    auto hit_start_time = chrono::high_resolution_clock::now();
+    for (int key : keys) {
+        misses += !contains(key);
+    }
+    auto hit_end_time = chrono::high_resolution_clock::now();
+    int false_positives = 0;
+    auto miss_start_time = chrono::high_resolution_clock::now();
+    for (int key : absent) {
+        false_positives += contains(key);
+    }
+    auto miss_end_time = chrono::high_resolution_clock::now();
+    if (misses > 0) {
+        cerr << name << " missed " << misses << " keys" << endl;
+    }
+    double fp_rate = double(false_positives) / absent.size();
+    double hit_ns = chrono::duration_cast<std::chrono::nanoseconds>(hit_end_time - hit_start_time).count() / double(keys.size());
+    double miss_ns = chrono::duration_cast<std::chrono::nanoseconds>(miss_end_time - miss_start_time).count() / double(absent.size());
+    cout << order << " keys, " << name << ": " << bits_per_key << " bits/key, false positive rate " << fp_rate
+         << ", " << hit_ns << "ns/op present, " << miss_ns << "ns/op absent" << endl;
+    // Write the result for filters to file
+    ofstream bloom_outputFile("bloom_results.txt", ios::app);
+    bloom_outputFile << order << "," << name << "," << bits_per_key << "," << fp_rate << "," << hit_ns << "," << miss_ns << endl;
+    bloom_outputFile.close();
+}
+
+// Microbenchmark for filters, the former filter of three std::hash ^ seed functions over a
+// vector<bool> against the cache line blocked filter with its SWAR and AVX2 probes and the
+// binary fuse filter, all with a budget of BITS_PER_ENTRY bits per key
+void performBloomExperiment(int volume) {
+    // Keys in the filter and absent keys, both sequential and random
+    vector<int> sequential_keys(volume), sequential_absent(volume);
+    for (int i = 0; i < volume; i++) {
+        sequential_keys[i] = i;
+        sequential_absent[i] = volume + i;
+    }
+    mt19937 gen(42);
+    vector<int> random_keys(volume), random_absent(volume);
+    for (int i = 0; i < volume; i++) {
+        random_keys[i] = int(gen() >> 1);
+        random_absent[i] = -int(gen() >> 1) - 1;
+    }
+    vector<pair<string, pair<vector<int> *, vector<int> *>>> orders = {
+        {"sequential", {&sequential_keys, &sequential_absent}}, {"random", {&random_keys, &random_absent}}};
+
+    const size_t seeds[3] = {0xEA529C2C, 0x9275AD99, 0xADFA52D9};
+    bool has_avx2 = BloomFilter::useAVX2;
+    for (auto &order : orders) {
+        vector<int> &keys = *order.second.first;
+        vector<int> &absent = *order.second.second;
+        // Former filter
+        int old_size = volume * BITS_PER_ENTRY;
+        vector<bool> old_filter(old_size);
+        for (int key : keys) {
+            for (size_t seed : seeds) {
+                old_filter[abs(int(hash<int>{}(key) ^ seed) % old_size)] = true;
+            }
+        }
+        measureFilter(order.first, "vector<bool>", BITS_PER_ENTRY, [&](int key) {
+            for (size_t seed : seeds) {
+                if (!old_filter[abs(int(hash<int>{}(key) ^ seed) % old_size)]) {
+                    return false;
+                }
+            }
+            return true;
+        }, keys, absent);
+        // Blocked filter
+        BloomFilter filter(volume, BITS_PER_ENTRY);
+        for (int key : keys) {
+            filter.add(key);
+        }
+        auto contains = [&](int key) {
+            return filter.mayContain(key);
+        };
+        double bloom_bits = filter.getMemoryUsage() * 8.0 / volume;
+        BloomFilter::useAVX2 = false;
+        measureFilter(order.first, "blocked SWAR", bloom_bits, contains, keys, absent);
+        if (has_avx2) {
+            BloomFilter::useAVX2 = true;
+            measureFilter(order.first, "blocked AVX2", bloom_bits, contains, keys, absent);
+        }
+        // Binary fuse filter, built from the keys in increasing order like an SST
+        vector<int> sorted_keys = keys;
+        sort(sorted_keys.begin(), sorted_keys.end());
+        sorted_keys.erase(unique(sorted_keys.begin(), sorted_keys.end()), sorted_keys.end());
+        BinaryFuseFilter fuse(sorted_keys.size(), BITS_PER_ENTRY);
+        for (int key : sorted_keys) {
+            fuse.add(key);
+        }
+        auto build_start_time = chrono::high_resolution_clock::now();
+        fuse.build();
+        auto build_end_time = chrono::high_resolution_clock::now();
+        cout << "binary fuse filter built in " << chrono::duration_cast<std::chrono::milliseconds>(build_end_time - build_start_time).count() << "ms" << endl;
+        measureFilter(order.first, "binary fuse", fuse.getMemoryUsage() * 8.0 / sorted_keys.size(), [&](int key) {
+            return fuse.mayContain(key);
+        }, sorted_keys, absent);
+    }
+}
+
+// Experiment for the filter memory allocation, a database with every level full answers gets for
+// absent keys with the same filter memory spread evenly or optimized over the levels
+void performFilterAllocationExperiment(size_t table_size, int flushes, int lookups) {
+    int volume = flushes * (table_size / KV_PAIR_SIZE);
+    // Even keys in random order, odd keys are absent but inside the key range of every level
+    vector<int> keys(volume);
+    for (int i = 0; i < volume; i++) {
+        keys[i] = 2 * i;
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(42));
+    vector<pair<string, FilterType>> filter_types = {{"bloom", BLOOM_FILTER}, {"binary fuse", BINARY_FUSE_FILTER}};
+    for (auto &filter_type : filter_types) {
+        for (bool optimize : {false, true}) {
+            system("rm -f -r ./SSTs/databaseFilters/*");
+            DatabaseOptions options;
+            options.filter_type = filter_type.second;
+            options.optimize_filter_memory = optimize;
+            Database *database = new Database("databaseFilters", table_size, options);
+            database->open("databaseFilters");
+            for (int key : keys) {
+                database->put(key, key);
+            }
+            string allocation = optimize ? "optimized" : "uniform";
+            auto get_start_time = chrono::high_resolution_clock::now();
+            for (int i = 0; i < lookups; i++) {
+                database->get(2 * randomNumber(0, volume - 1) + 1);
+            }
+            auto get_end_time = chrono::high_resolution_clock::now();
+            double get_ns = chrono::duration_cast<std::chrono::nanoseconds>(get_end_time - get_start_time).count() / double(lookups);
+            // Sum of the rates is the expected number of pages a get for an absent key reads
+            double expected = 0, observed = 0;
+            size_t memory = 0;
+            cout << filter_type.first << " filters, " << allocation << " allocation of " << options.filter_bits_per_key << " bits/key" << endl;
+            for (LevelFilterStats &stats : database->getsstManager()->getFilterStats()) {
+                cout << "  L" << stats.level << ": " << stats.numPairs << " keys, " << stats.allocatedBitsPerKey << " bits/key allocated, "
+                     << stats.bitsPerKey << " bits/key used, expected false positive rate " << stats.expectedFalsePositiveRate
+                     << ", observed " << stats.observedFalsePositiveRate << endl;
+                expected += stats.expectedFalsePositiveRate;
+                observed += stats.observedFalsePositiveRate;
+                for (SST *sst : database->getsstManager()->getSSTs(stats.level)) {
+                    memory += sst->getFilterMemory();
+                }
+            }
+            cout << "  filter memory " << memory / double(MB) << "MB, false positives per get expected " << expected
+                 << ", observed " << observed << ", " << get_ns << "ns/get" << endl;
+            // Write the result for the filter allocation to file
+            ofstream filters_outputFile("filter_allocation_results.txt", ios::app);
+            filters_outputFile << filter_type.first << "," << allocation << "," << memory << "," << expected << "," << observed << "," << get_ns << endl;
+            filters_outputFile.close();
+            database->close();
+            delete database;
+        }
+    }
+}
+
+// Experiment for short scans of 1 to 16 keys with and without range filters. Dense keys fill every
+// range, sparse keys 64 apart leave most ranges empty so the levels can be skipped
+void performRangeFilterExperiment(size_t table_size, int flushes, int scans) {
+    int volume = flushes * (table_size / KV_PAIR_SIZE);
+    vector<pair<string, int>> distributions = {{"dense", 1}, {"sparse", 64}};
+    for (auto &distribution : distributions) {
+        vector<int> keys(volume);
+        for (int i = 0; i < volume; i++) {
+            keys[i] = i * distribution.second;
+        }
+        shuffle(keys.begin(), keys.end(), mt19937(42));
+        for (double range_bits : {0.0, double(BITS_PER_ENTRY)}) {
+            system("rm -f -r ./SSTs/databaseRange/*");
+            DatabaseOptions options;
+            options.range_filter_bits_per_key = range_bits;
+            Database *database = new Database("databaseRange", table_size, options);
+            database->open("databaseRange");
+            for (int key : keys) {
+                database->put(key, key);
+            }
+            size_t memory = 0;
+            for (int level = 1; level <= database->getsstManager()->max_level; level++) {
+                for (SST *sst : database->getsstManager()->getSSTs(level)) {
+                    memory += sst->getRangeFilterMemory();
+                }
+            }
+            vector<KV_Pair> scan_result;
+            size_t found = 0;
+            mt19937 gen(7);
+            auto scan_start_time = chrono::high_resolution_clock::now();
+            for (int i = 0; i < scans; i++) {
+                int key = gen() % (volume * distribution.second);
+                database->scan(key, key + gen() % 16, scan_result);
+                found += scan_result.size();
+            }
+            auto scan_end_time = chrono::high_resolution_clock::now();
+            double scan_ns = chrono::duration_cast<std::chrono::nanoseconds>(scan_end_time - scan_start_time).count() / double(scans);
+            string filter = range_bits > 0 ? "range filters" : "no range filters";
+            cout << distribution.first << " keys, " << filter << " (" << memory / double(MB) << "MB): "
+                 << scan_ns << "ns/scan, " << double(found) / scans << " pairs/scan" << endl;
+            // Write the result for range filters to file
+            ofstream range_outputFile("range_filter_results.txt", ios::app);
+            range_outputFile << distribution.first << "," << range_bits << "," << memory << "," << scan_ns << endl;
+            range_outputFile.close();
+            database->close();
+            delete database;
+        }
+    }
+}
+
+// Microbenchmark for the fence key search, the former binary search over the key array against the
+// fence index with and without AVX2 and the learned index, for evenly spaced and random fences
+void performFenceExperiment(int lookups) {
+    mt19937 gen(42);
+    bool has_avx2 = FenceIndex::useAVX2;
+    for (string distribution : {"dense", "random"}) {
+        for (int size : {1000, 100000, 10000000}) {
+            vector<int> fences(size);
+            int key = numeric_limits<int>::min();
+            for (int i = 0; i < size; i++) {
+                fences[i] = key;
+                key += distribution == "dense" ? 400 : 1 + gen() % 400;
+            }
+            vector<int> queries(lookups);
+            for (int &query : queries) {
+                query = fences[gen() % size] + gen() % 400;
+            }
+            FenceIndex index;
+            index.build(fences);
+            LearnedIndex learned;
+            learned.build(fences);
+            cout << size << " " << distribution << " fences: fence index " << index.getMemoryUsage() << " bytes, learned index "
+                 << learned.getNumSegments() << " segments in " << learned.getMemoryUsage() << " bytes" << endl;
+            vector<pair<string, function<int(int)>>> searches = {
+                {"binary search", [&](int key) {
+                    // Former SST::binarySearchPage
+                    int left = 0, right = fences.size() - 1, result = -1;
+                    while (left <= right) {
+                        int mid = left + (right - left) / 2;
+                        if (fences[mid] <= key) {
+                            result = mid;
+                            left = mid + 1;
+                        } else {
+                            right = mid - 1;
+                        }
+                    }
+                    return result;
+                }},
+                {"fence index scalar", [&](int key) {
+                    FenceIndex::useAVX2 = false;
+                    return index.search(key);
+                }}};
+            if (has_avx2) {
+                searches.push_back({"fence index AVX2", [&](int key) {
+                    FenceIndex::useAVX2 = true;
+                    return index.search(key);
+                }});
+            }
+            searches.push_back({"learned index", [&](int key) {
+                FenceIndex::useAVX2 = has_avx2;
+                return learned.search(key);
+            }});
+            for (auto &search : searches) {
+                long long checksum = 0;
+                auto start_time = chrono::high_resolution_clock::now();
+                for (int query : queries) {
+                    checksum += search.second(query);
+                }
+                auto end_time = chrono::high_resolution_clock::now();
+                double ns = chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count() / double(lookups);
+                cout << "  " << search.first << ": " << ns << "ns/lookup (checksum " << checksum << ")" << endl;
+                // Write the result for fence search to file
+                ofstream fence_outputFile("fence_results.txt", ios::app);
+                fence_outputFile << distribution << "," << size << "," << search.first << "," << ns << endl;
+                fence_outputFile.close();
+            }
+        }
+    }
+    FenceIndex::useAVX2 = has_avx2;
+}
+
+// Microbenchmark for the search within a page, the former vector of pointers to the pairs of a
+// page with a binary search, and the binary search on the page itself, against the branchless
+// search with and without AVX2 on row and PAX pages.
+// As many pages as the buffer pool holds, half of the lookups are for absent keys
+void performPageSearchExperiment(int lookups) {
+    const int num_pages = 1024, pairs_per_page = PAIRS_PER_PAGE;
+    mt19937 gen(42);
+    vector<KV_Pair> pages(num_pages * pairs_per_page);
+    vector<char> pax_pages(num_pages * PAGE_SIZE);
+    for (int p = 0; p < num_pages; p++) {
+        int key = gen() % 1000;
+        for (int i = 0; i < pairs_per_page; i++) {
+            pages[p * pairs_per_page + i] = KV_Pair(key, i);
+            Page::put(&pax_pages[p * PAGE_SIZE], i, key, i, PAX_PAGE);
+            key += 2 + gen() % 8;
+        }
+    }
+    vector<pair<int, int>> queries(lookups);
+    for (auto &query : queries) {
+        query.first = gen() % num_pages;
+        query.second = pages[query.first * pairs_per_page + gen() % pairs_per_page].key + gen() % 2;
+    }
+    bool has_avx2 = PageSearch::useAVX2;
+    auto row_page = [&](int p) {
+        return Page(reinterpret_cast<const char *>(&pages[p * pairs_per_page]), pairs_per_page, ROW_PAGE);
+    };
+    auto pax_page = [&](int p) {
+        return Page(&pax_pages[p * PAGE_SIZE], pairs_per_page, PAX_PAGE);
+    };
+    vector<pair<string, function<bool(int, int, int &)>>> searches = {
+        {"vector of pointers", [&](int p, int key, int &value) {
+            // Former BufferPool::fetchPage and binarySearchKVPairs
+            vector<KV_Pair *> pairs;
+            for (int i = 0; i < pairs_per_page; i++) {
+                pairs.push_back(&pages[p * pairs_per_page + i]);
+            }
+            int low = 0, high = pairs.size() - 1;
+            while (low <= high) {
+                int mid = low + (high - low) / 2;
+                if (pairs[mid]->key == key) {
+                    value = pairs[mid]->val;
+                    return true;
+                } else if (pairs[mid]->key < key) {
+                    low = mid + 1;
+                } else {
+                    high = mid - 1;
+                }
+            }
+            return false;
+        }},
+        {"binary search", [&](int p, int key, int &value) {
+            // The former binary search on the page itself
+            KV_Pair *page = &pages[p * pairs_per_page];
+            int low = 0, high = pairs_per_page - 1;
+            while (low <= high) {
+                int mid = low + (high - low) / 2;
+                if (page[mid].key == key) {
+                    value = page[mid].val;
+                    return true;
+                } else if (page[mid].key < key) {
+                    low = mid + 1;
+                } else {
+                    high = mid - 1;
+                }
+            }
+            return false;
+        }},
+        {"branchless row", [&](int p, int key, int &value) {
+            PageSearch::useAVX2 = false;
+            return row_page(p).find(key, value);
+        }},
+        {"branchless PAX", [&](int p, int key, int &value) {
+            PageSearch::useAVX2 = false;
+            return pax_page(p).find(key, value);
+        }}};
+    if (has_avx2) {
+        searches.push_back({"branchless + AVX2 row", [&](int p, int key, int &value) {
+            PageSearch::useAVX2 = true;
+            return row_page(p).find(key, value);
+        }});
+        searches.push_back({"branchless + AVX2 PAX", [&](int p, int key, int &value) {
+            PageSearch::useAVX2 = true;
+            return pax_page(p).find(key, value);
+        }});
+    }
+    for (auto &search : searches) {
+        long long checksum = 0;
+        auto start_time = chrono::high_resolution_clock::now();
+        for (auto &query : queries) {
+            int value = 0;
+            checksum += search.second(query.first, query.second, value) ? value : -1;
+        }
+        auto end_time = chrono::high_resolution_clock::now();
+        double ns = chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time).count() / double(lookups);
+        cout << search.first << ": " << ns << "ns/lookup (checksum " << checksum << ")" << endl;
+        // Write the result for page search to file
+        ofstream page_outputFile("page_search_results.txt", ios::app);
+        page_outputFile << search.first << "," << ns << endl;
+        page_outputFile.close();
+    }
+    PageSearch::useAVX2 = has_avx2;
+}
+
+// Put the same keys into databases that store their pages differently and compare the bytes of
+// their SSTs, the time to put them, which includes the merges, and get and scan times once the data
+// is larger than the buffer pool. Dense keys are consecutive, sparse keys have random gaps. Values
+// are the keys, random or one of a few
+const char *pageFormatName(PageFormat format) {
+    return format == ROW_PAGE ? "row" : format == PAX_PAGE ? "PAX" : "packed";
+}
+
+void performPageFormatExperiment(size_t table_size, int flushes, int lookups) {
+    int volume = flushes * (table_size / KV_PAIR_SIZE);
+    vector<pair<string, DatabaseOptions>> configurations;
+    for (PageFormat format : {PAX_PAGE, PACKED_PAGE}) {
+        for (int min_level : {0, 3, 1}) {
+            DatabaseOptions options;
+            options.page_format = format;
+            options.compression = min_level == 0 ? NO_COMPRESSION : LZ_COMPRESSION;
+            options.compression_min_level = min_level;
+            string name = string(pageFormatName(format)) + " pages";
+            name += min_level == 0 ? "" : ", LZ from L" + to_string(min_level);
+            configurations.push_back({name, options});
+        }
+    }
+    for (string distribution : {"dense", "sparse", "few values"}) {
+        mt19937 gen(42);
+        vector<int> keys(volume), vals(volume);
+        for (int i = 0; i < volume; i++) {
+            keys[i] = distribution == "sparse" ? i * 64 + gen() % 64 : i;
+            vals[i] = distribution == "dense" ? i : distribution == "sparse" ? int(gen()) : int(gen() % 16);
+        }
+        vector<int> order(volume);
+        iota(order.begin(), order.end(), 0);
+        shuffle(order.begin(), order.end(), mt19937(7));
+        for (auto &configuration : configurations) {
+            system("rm -f -r ./SSTs/databasePages/*");
+            Database *database = new Database("databasePages", table_size, configuration.second);
+            database->open("databasePages");
+            auto put_start_time = chrono::high_resolution_clock::now();
+            for (int i : order) {
+                database->put(keys[i], vals[i]);
+            }
+            auto put_end_time = chrono::high_resolution_clock::now();
+            long long data_size = 0;
+            for (int level = 1; level <= database->getsstManager()->max_level; level++) {
+                for (SST *sst : database->getsstManager()->getSSTs(level)) {
+                    data_size += sst->filesize;
+                }
+            }
+            mt19937 query_gen(11);
+            long long checksum = 0;
+            auto get_start_time = chrono::high_resolution_clock::now();
+            for (int i = 0; i < lookups; i++) {
+                checksum += database->get(keys[query_gen() % volume]);
+            }
+            auto get_end_time = chrono::high_resolution_clock::now();
+            vector<KV_Pair> scan_result;
+            auto scan_start_time = chrono::high_resolution_clock::now();
+            for (int i = 0; i < lookups / 10; i++) {
+                int first = query_gen() % (volume - 1000);
+                database->scan(keys[first], keys[first + 999], scan_result);
+                checksum += scan_result.size();
+            }
+            auto scan_end_time = chrono::high_resolution_clock::now();
+            double put_s = chrono::duration_cast<std::chrono::milliseconds>(put_end_time - put_start_time).count() / 1000.0;
+            double get_ns = chrono::duration_cast<std::chrono::nanoseconds>(get_end_time - get_start_time).count() / double(lookups);
+            double scan_us = chrono::duration_cast<std::chrono::microseconds>(scan_end_time - scan_start_time).count() / double(lookups / 10);
+            cout << distribution << ", " << configuration.first << ": " << data_size / double(MB) << "MB of data, "
+                 << put_s << "s to put, " << get_ns << "ns/get, " << scan_us << "us/scan of 1000 keys (checksum " << checksum << ")" << endl;
+            // Write the result for page formats to file
+            ofstream pages_outputFile("page_format_results.txt", ios::app);
+            pages_outputFile << distribution << "," << configuration.first << "," << data_size << "," << put_s << ","
+                             << get_ns << "," << scan_us << endl;
+            pages_outputFile.close();
+            database->close();
+            delete database;
+        }
+    }
+}
+
+// Put the same keys into databases with different compaction policies and size ratios and compare
+// the time to put them, which includes the merges, the write amplification, the number of runs a
+// get may read and get and scan times. A third of the puts update keys that were put before
+const char *compactionPolicyName(CompactionPolicy policy) {
+    return policy == LEVELING ? "leveling" : policy == TIERING ? "tiering" : "lazy leveling";
+}
+
+void performCompactionPolicyExperiment(size_t table_size, int flushes, int lookups) {
+    int volume = flushes * (table_size / KV_PAIR_SIZE);
+    // Policy, size ratio and SST file size, 0 for runs in one SST
+    vector<tuple<CompactionPolicy, int, int>> configurations = {{LEVELING, 2, 0}, {LEVELING, 4, 0}, {LAZY_LEVELING, 4, 0},
+                                                                {TIERING, 4, 0}, {LEVELING, 10, 0}, {LAZY_LEVELING, 10, 0},
+                                                                {TIERING, 10, 0}, {LEVELING, 4, (int) table_size / 4},
+                                                                {LEVELING, 10, (int) table_size / 4}};
+    mt19937 gen(42);
+    vector<int> keys(volume);
+    for (int i = 0; i < volume; i++) {
+        keys[i] = i < volume / 3 * 2 ? i : gen() % (volume / 3 * 2);
+    }
+    shuffle(keys.begin(), keys.begin() + volume / 3 * 2, mt19937(7));
+    for (auto &configuration : configurations) {
+        system("rm -f -r ./SSTs/databaseCompaction/*");
+        DatabaseOptions options;
+        options.compaction_policy = get<0>(configuration);
+        options.size_ratio = get<1>(configuration);
+        options.sst_file_size = get<2>(configuration);
+        Database *database = new Database("databaseCompaction", table_size, options);
+        database->open("databaseCompaction");
+        auto put_start_time = chrono::high_resolution_clock::now();
+        for (int i = 0; i < volume; i++) {
+            database->put(keys[i], i);
+        }
+        auto put_end_time = chrono::high_resolution_clock::now();
+        SSTManager *manager = database->getsstManager();
+        int runs = 0;
+        for (int level = 1; level <= manager->max_level; level++) {
+            runs += manager->getRuns(level).size();
+        }
+        double write_amplification = double(manager->compacted_bytes) / manager->flushed_bytes;
+        mt19937 query_gen(11);
+        long long checksum = 0;
+        auto get_start_time = chrono::high_resolution_clock::now();
+        for (int i = 0; i < lookups; i++) {
+            checksum += database->get(query_gen() % (volume / 3 * 2));
+        }
+        auto get_end_time = chrono::high_resolution_clock::now();
+        vector<KV_Pair> scan_result;
+        auto scan_start_time = chrono::high_resolution_clock::now();
+        for (int i = 0; i < lookups / 10; i++) {
+            int first = query_gen() % (volume / 3 * 2 - 100);
+            database->scan(first, first + 99, scan_result);
+            checksum += scan_result.size();
+        }
+        auto scan_end_time = chrono::high_resolution_clock::now();
+        double put_s = chrono::duration_cast<std::chrono::milliseconds>(put_end_time - put_start_time).count() / 1000.0;
+        double get_ns = chrono::duration_cast<std::chrono::nanoseconds>(get_end_time - get_start_time).count() / double(lookups);
+        double scan_us = chrono::duration_cast<std::chrono::microseconds>(scan_end_time - scan_start_time).count() / double(lookups / 10);
+        string name = string(compactionPolicyName(get<0>(configuration))) + ", T=" + to_string(get<1>(configuration));
+        if (get<2>(configuration) > 0) {
+            name += ", SSTs of " + to_string(get<2>(configuration) / 1024) + "KB";
+        }
+        double largest_mb = manager->largest_compaction_bytes / double(1024 * 1024);
+        cout << name << ": " << put_s << "s to put, write amplification " << write_amplification << ", largest merge "
+             << largest_mb << "MB, " << manager->max_level << " levels with " << runs << " runs, " << get_ns << "ns/get, "
+             << scan_us << "us/scan of 100 keys (checksum " << checksum << ")" << endl;
+        // Write the result for compaction policies to file
+        ofstream compaction_outputFile("compaction_policy_results.txt", ios::app);
+        compaction_outputFile << name << "," << put_s << "," << write_amplification << "," << largest_mb << "," << runs << ","
+                              << get_ns << "," << scan_us << endl;
+        compaction_outputFile.close();
+        database->close();
+        delete database;
+    }
+}
+
+// Put latency with merges inside the flush against merges on compaction threads
+void performBackgroundCompactionExperiment(size_t table_size, int volume) {
+    // Immutable memtables and compaction threads
+    vector<pair<int, int>> configurations = {{0, 0}, {4, 0}, {4, 1}, {4, 2}, {4, 4}};
+    vector<int> keys(volume);
+    iota(keys.begin(), keys.end(), 0);
+    shuffle(keys.begin(), keys.end(), mt19937(5));
+    for (auto &configuration : configurations) {
+        system("rm -f -r ./SSTs/databaseBackground/*");
+        DatabaseOptions options;
+        options.max_immutable_tables = configuration.first;
+        options.compaction_threads = configuration.second;
+        options.size_ratio = 4;
+        Database *database = new Database("databaseBackground", table_size, options);
+        database->open("databaseBackground");
+        // Time every single put and watch the queue of the compaction threads
+        vector<long long> latencies(volume);
+        int max_queue_depth = 0;
+        auto put_start_time = chrono::high_resolution_clock::now();
+        for (int i = 0; i < volume; i++) {
+            auto start = chrono::high_resolution_clock::now();
+            database->put(keys[i], i);
+            auto end = chrono::high_resolution_clock::now();
+            latencies[i] = chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            if (database->getCompactionScheduler() != NULL && i % 4096 == 0) {
+                max_queue_depth = max(max_queue_depth, database->getCompactionScheduler()->getQueueDepth());
+            }
+        }
+        auto put_end_time = chrono::high_resolution_clock::now();
+        CompactionTotals totals;
+        if (database->getCompactionScheduler() != NULL) {
+            database->getCompactionScheduler()->waitForIdle();
+            totals = database->getCompactionScheduler()->getJobTotals();
+        }
+        auto idle_time = chrono::high_resolution_clock::now();
+        database->close();
+        delete database;
+        double merge_ms = totals.mergeMillis, max_merge_ms = totals.slowest.mergeMillis;
+        double install_ms = totals.installMillis, queue_ms = totals.queueMillis;
+        long long jobs = max(1LL, totals.jobs);
+        sort(latencies.begin(), latencies.end());
+        double put_s = chrono::duration_cast<std::chrono::milliseconds>(put_end_time - put_start_time).count() / 1000.0;
+        double idle_s = chrono::duration_cast<std::chrono::milliseconds>(idle_time - put_start_time).count() / 1000.0;
+        double p50 = latencies[volume / 2] / 1000.0;
+        double p99 = latencies[(size_t) (volume * 0.99)] / 1000.0;
+        double p999 = latencies[(size_t) (volume * 0.999)] / 1000.0;
+        double max_latency = latencies[volume - 1] / 1000.0;
+        cout << configuration.first << " immutable memtables, " << configuration.second << " compaction threads: " << put_s
+             << "s to put, " << idle_s << "s until merged, p50 " << p50 << "us, p99 " << p99 << "us, p99.9 " << p999 << "us, max "
+             << max_latency << "us" << endl;
+        if (totals.jobs != 0) {
+            cout << "    " << totals.jobs << " jobs, " << merge_ms / jobs << "ms to merge (max " << max_merge_ms << "ms), "
+                 << install_ms / jobs << "ms to install, " << queue_ms / jobs << "ms queued, max queue depth " << max_queue_depth << endl;
+        }
+        // Write the result for background compaction to file
+        ofstream background_outputFile("background_compaction_results.txt", ios::app);
+        background_outputFile << configuration.first << "," << configuration.second << "," << put_s << "," << idle_s << "," << p50 << ","
+                              << p99 << "," << p999 << "," << max_latency << "," << totals.jobs << "," << merge_ms / jobs << ","
+                              << install_ms / jobs << endl;
+        background_outputFile.close();
+    }
+}
+
+// Time of the merges of 63 flushes with a size ratio of 2 when each merge is split into up to 1 to 8
+// subcompactions. The 32nd flush merges L1 to L5 into L6 at once, the largest merge of the tree
+void performSubcompactionExperiment(size_t table_size, int flushes, int lookups) {
+    int volume = flushes * (table_size / KV_PAIR_SIZE);
+    vector<int> keys(volume);
+    iota(keys.begin(), keys.end(), 0);
+    shuffle(keys.begin(), keys.end(), mt19937(7));
+    cout << thread::hardware_concurrency() << " cores" << endl;
+    for (int subcompactions : {1, 2, 4, 8}) {
+        system("rm -f -r ./SSTs/databaseSubcompaction/*");
+        DatabaseOptions options;
+        options.max_subcompactions = subcompactions;
+        options.compaction_threads = 1;
+        options.max_immutable_tables = 4;
+        Database *database = new Database("databaseSubcompaction", table_size, options);
+        database->open("databaseSubcompaction");
+        auto put_start_time = chrono::high_resolution_clock::now();
+        for (int i = 0; i < volume; i++) {
+            database->put(keys[i], i);
+        }
+        database->getCompactionScheduler()->waitForIdle();
+        auto idle_time = chrono::high_resolution_clock::now();
+        // Merges run one at a time on the compaction thread, the largest one writes the whole tree
+        CompactionTotals totals = database->getCompactionScheduler()->getJobTotals();
+        double merge_ms = totals.mergeMillis, max_merge_ms = totals.slowest.mergeMillis;
+        long long max_merge_bytes = totals.slowest.outputBytes;
+        // Gets check that every subcompaction wrote the keys of its range
+        mt19937 gen(8);
+        uniform_int_distribution<int> dist(0, volume - 1);
+        long long checksum = 0;
+        for (int i = 0; i < lookups; i++) {
+            checksum += database->get(keys[dist(gen)]);
+        }
+        double idle_s = chrono::duration_cast<std::chrono::milliseconds>(idle_time - put_start_time).count() / 1000.0;
+        double max_merge_mb = max_merge_bytes / (double) MB;
+        cout << subcompactions << " subcompactions: " << idle_s << "s until merged, " << merge_ms / 1000.0
+             << "s merging, largest merge " << max_merge_mb << "MB in " << max_merge_ms << "ms (checksum " << checksum << ")" << endl;
+        // Write the result for subcompactions to file
+        ofstream subcompaction_outputFile("subcompaction_results.txt", ios::app);
+        subcompaction_outputFile << subcompactions << "," << idle_s << "," << merge_ms << "," << max_merge_mb << ","
+                                 << max_merge_ms << endl;
+        subcompaction_outputFile.close();
+        database->close();
+        delete database;
+    }
+}
+
 // Clear SST data
 void clearSST() {
     system("rm -f -r ./SSTs/database1MB/*");
     system("rm -f -r ./SSTs/database4MB/*");
+    system("rm -f -r ./SSTs/databaseConcurrent/*");
+    system("rm -f -r ./SSTs/databaseLatency/*");
+    system("rm -f -r ./SSTs/databaseStartup/*");
+    system("rm -f -r ./SSTs/databaseFilters/*");
+    system("rm -f -r ./SSTs/databaseRange/*");
+    system("rm -f -r ./SSTs/databasePages/*");
+    system("rm -f -r ./SSTs/databaseCompaction/*");
+    system("rm -f -r ./SSTs/databaseBackground/*");
+    system("rm -f -r ./SSTs/databaseSubcompaction/*");
 }
 
 int main(int argc, char* argv[]) {
@@ -99,6 +937,19 @@ int main(int argc, char* argv[]) {
     // a series of API command. In this way we can prevent collisions
     if (argc != 2) {
         cerr << "Please execute ./experinment {memtable size}. E.g. ./test 1 for memtable size of 1MB" << endl;
+        cerr << "Or ./experinment concurrent for put and get throughput with 1 to 16 writer and reader threads" << endl;
+        cerr << "Or ./experinment latency for put latency percentiles with a background flush thread" << endl;
+        cerr << "Or ./experinment upsert for the memtable insert microbenchmark" << endl;
+        cerr << "Or ./experinment startup for the time to reopen a database with 1GB of data" << endl;
+        cerr << "Or ./experinment bloom for the bloom filter microbenchmark" << endl;
+        cerr << "Or ./experinment filters for the filter memory allocation over the levels" << endl;
+        cerr << "Or ./experinment range for short scans with and without range filters" << endl;
+        cerr << "Or ./experinment fences for the fence key search microbenchmark" << endl;
+        cerr << "Or ./experinment page for the search within a page microbenchmark" << endl;
+        cerr << "Or ./experinment pages for the size and speed of PAX, packed and compressed pages" << endl;
+        cerr << "Or ./experinment compaction for leveling, tiering and lazy leveling with different size ratios" << endl;
+        cerr << "Or ./experinment background for put latency with merges on compaction threads" << endl;
+        cerr << "Or ./experinment subcompaction for merges split into key ranges on several threads" << endl;
         return 0;
     }
 
@@ -129,8 +980,45 @@ int main(int argc, char* argv[]) {
         performExperiment(database_4mb, data_volume, "4MB");
         // Close the database
         database_4mb->close();
+    } else if (size == "concurrent") {
+        // Put 64MB of data into a database with 4MB memtables
+        performConcurrentExperiment(4 * MB, (64 * MB) / KV_PAIR_SIZE);
+    } else if (size == "latency") {
+        // Put 64MB of data into a database with 4MB memtables
+        performLatencyExperiment(4 * MB, (64 * MB) / KV_PAIR_SIZE);
+    } else if (size == "upsert") {
+        // Insert as many keys as a 4MB memtable holds
+        performUpsertExperiment((4 * MB) / KV_PAIR_SIZE);
+    } else if (size == "startup") {
+        // Reopen a database holding 1GB of data
+        performStartupExperiment(4 * MB, (1024 * MB) / KV_PAIR_SIZE);
+    } else if (size == "bloom") {
+        // As many keys as a 128MB level holds, the filters do not fit in the CPU caches
+        performBloomExperiment((128 * MB) / KV_PAIR_SIZE);
+    } else if (size == "filters") {
+        // 63 flushes of 1MB memtables fill L1 to L6
+        performFilterAllocationExperiment(MB, 63, 1000000);
+    } else if (size == "range") {
+        // 63 flushes of 1MB memtables fill L1 to L6
+        performRangeFilterExperiment(MB, 63, 100000);
+    } else if (size == "fences") {
+        performFenceExperiment(10000000);
+    } else if (size == "page") {
+        performPageSearchExperiment(10000000);
+    } else if (size == "pages") {
+        // 63 flushes of 1MB memtables fill L1 to L6, far more than the buffer pool holds
+        performPageFormatExperiment(MB, 63, 1000000);
+    } else if (size == "compaction") {
+        // 63 flushes of 1MB memtables, L1 to L6 with a size ratio of 2
+        performCompactionPolicyExperiment(MB, 63, 1000000);
+    } else if (size == "background") {
+        // Put 128MB of data into a database with 1MB memtables
+        performBackgroundCompactionExperiment(MB, (128 * MB) / KV_PAIR_SIZE);
+    } else if (size == "subcompaction") {
+        // 63 flushes of 1MB memtables, the largest merge writes 32MB into L6
+        performSubcompactionExperiment(MB, 63, 1000000);
     } else {
-        cout << "please try size 1 or 4" << endl;
+        cout << "please try size 1 or 4, concurrent, latency, upsert, startup, bloom, filters, range, fences, page, pages, compaction, background or subcompaction" << endl;
     }
 
     return 0;
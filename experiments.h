@@ -1,6 +1,13 @@
 #include "database.h"
+#include "bloomfilter.h"
+#include "fusefilter.h"
 #include <chrono>
 #include <random>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <tuple>
 
 // Generates a random number between lowerbound and upperbound
 int randomNumber(int lowerbound, int upperbound);
\ No newline at end of file
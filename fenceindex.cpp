@@ -0,0 +1,108 @@
+#include "fenceindex.h"
+#include <algorithm>
+#include <limits>
+#include <immintrin.h>
+
+bool FenceIndex::useAVX2 = __builtin_cpu_supports("avx2");
+
+// Constructor
+FenceIndex::FenceIndex() {}
+
+const int32_t *FenceIndex::nodes() const {
+    // Round the start of the storage up to the next cache line
+    uintptr_t start = (reinterpret_cast<uintptr_t>(this->storage.data()) + 63) & ~uintptr_t(63);
+    return reinterpret_cast<const int32_t *>(start);
+}
+
+void FenceIndex::build(const vector<int> &fences) {
+    this->layerOffsets.clear();
+    this->layerSizes.clear();
+    if (fences.empty()) {
+        this->storage.clear();
+        return;
+    }
+    // Layers from the fence keys up, each holds the first key of every node below
+    vector<vector<int>> layers(1, fences);
+    while (layers.back().size() > FENCE_NODE_KEYS) {
+        const vector<int> &below = layers.back();
+        vector<int> layer;
+        for (size_t i = 0; i < below.size(); i += FENCE_NODE_KEYS) {
+            layer.push_back(below[i]);
+        }
+        layers.push_back(layer);
+    }
+    reverse(layers.begin(), layers.end());
+    // Nodes are padded with the largest key, a search clamps to the end of the layer
+    size_t total = 0;
+    for (vector<int> &layer : layers) {
+        this->layerOffsets.push_back(total);
+        this->layerSizes.push_back(layer.size());
+        total += (layer.size() + FENCE_NODE_KEYS - 1) / FENCE_NODE_KEYS * FENCE_NODE_KEYS;
+    }
+    this->storage.assign(total + FENCE_NODE_KEYS, numeric_limits<int>::max());
+    int32_t *nodes = const_cast<int32_t *>(this->nodes());
+    for (size_t l = 0; l < layers.size(); l++) {
+        copy(layers[l].begin(), layers[l].end(), nodes + this->layerOffsets[l]);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline int countNotGreaterAVX2(const int32_t *node, int key) {
+    // Keys larger than key set their lane in the masks
+    __m256i x = _mm256_set1_epi32(key);
+    __m256i low = _mm256_cmpgt_epi32(_mm256_load_si256(reinterpret_cast<const __m256i *>(node)), x);
+    __m256i high = _mm256_cmpgt_epi32(_mm256_load_si256(reinterpret_cast<const __m256i *>(node + 8)), x);
+    int mask = _mm256_movemask_ps(_mm256_castsi256_ps(low)) | (_mm256_movemask_ps(_mm256_castsi256_ps(high)) << 8);
+    return FENCE_NODE_KEYS - __builtin_popcount(mask);
+}
+
+static inline int countNotGreater(const int32_t *node, int key) {
+    // Count without branches, the keys of a node are sorted
+    int count = 0;
+    for (int i = 0; i < FENCE_NODE_KEYS; i++) {
+        count += node[i] <= key;
+    }
+    return count;
+}
+
+__attribute__((target("avx2")))
+static int searchAVX2(const int32_t *nodes, const size_t *offsets, const int *sizes, int numLayers, int key) {
+    int pos = 0;
+    for (int l = 0; l < numLayers; l++) {
+        // The node of the layer is the position found in the layer above
+        pos = pos * FENCE_NODE_KEYS + countNotGreaterAVX2(nodes + offsets[l] + size_t(pos) * FENCE_NODE_KEYS, key) - 1;
+        if (pos < 0) {
+            return -1;
+        }
+        pos = min(pos, sizes[l] - 1);
+    }
+    return pos;
+}
+
+static int searchScalar(const int32_t *nodes, const size_t *offsets, const int *sizes, int numLayers, int key) {
+    int pos = 0;
+    for (int l = 0; l < numLayers; l++) {
+        pos = pos * FENCE_NODE_KEYS + countNotGreater(nodes + offsets[l] + size_t(pos) * FENCE_NODE_KEYS, key) - 1;
+        if (pos < 0) {
+            return -1;
+        }
+        pos = min(pos, sizes[l] - 1);
+    }
+    return pos;
+}
+
+int FenceIndex::search(int key) const {
+    if (this->layerSizes.empty()) {
+        return -1;
+    }
+    // Only the root can have no key that is not larger, below it the first key of the node
+    // is the key found in the layer above
+    if (useAVX2) {
+        return searchAVX2(this->nodes(), this->layerOffsets.data(), this->layerSizes.data(), this->layerSizes.size(), key);
+    }
+    return searchScalar(this->nodes(), this->layerOffsets.data(), this->layerSizes.data(), this->layerSizes.size(), key);
+}
+
+size_t FenceIndex::getMemoryUsage() const {
+    return this->storage.size() * sizeof(int32_t);
+}
@@ -0,0 +1,42 @@
+#ifndef FENCE_INDEX_H
+#define FENCE_INDEX_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+// A node is one cache line of 16 keys
+#define FENCE_NODE_KEYS 16
+
+// Static B+-tree over the fence keys of an SST (S-tree). The bottom layer is the fence keys in
+// nodes of 16, every layer above holds the first key of each node of the layer below, up to a
+// single root node. A search compares the key with a whole node at once and moves to the child
+// of the last node key that is not larger, so it touches one cache line per layer instead of one
+// per step of a binary search. Nodes are compared with AVX2 where the CPU has it.
+class FenceIndex {
+public:
+    FenceIndex();
+    FenceIndex(const FenceIndex &other) = delete;
+    FenceIndex &operator=(const FenceIndex &other) = delete;
+
+    // Build the tree for increasing fence keys
+    void build(const vector<int> &fences);
+    // Index of the last fence that is not larger than key, -1 if every fence is larger
+    int search(int key) const;
+    size_t getMemoryUsage() const;
+    // Compare nodes with AVX2, defaults to whether the CPU supports it
+    static bool useAVX2;
+
+private:
+    // All layers, the root layer first and the fence keys last. One spare node so the
+    // first node can start on a cache line
+    vector<int32_t> storage;
+    // Offset of each layer from the first node and its number of keys, root layer first
+    vector<size_t> layerOffsets;
+    vector<int> layerSizes;
+
+    const int32_t *nodes() const;
+};
+
+#endif  // FENCE_INDEX_H
@@ -0,0 +1,43 @@
+#include "filter.h"
+#include "bloomfilter.h"
+#include "fusefilter.h"
+#include "prefixfilter.h"
+#include <cmath>
+#include <algorithm>
+
+Filter *Filter::create(FilterType type, int numKeys, double bitsPerKey) {
+    if (type == BINARY_FUSE_FILTER) {
+        return new BinaryFuseFilter(numKeys, bitsPerKey);
+    }
+    if (type == PREFIX_BLOOM_FILTER) {
+        return new PrefixBloomFilter(numKeys, bitsPerKey);
+    }
+    return new BloomFilter(numKeys, bitsPerKey);
+}
+
+// A bloom filter with the best number of probes has a rate of exp(-bits * ln2^2), a binary fuse
+// filter 2^-f for f bit fingerprints that take 1.125 * f bits per key
+double Filter::falsePositiveRateFor(FilterType type, double bitsPerKey) {
+    if (type == BINARY_FUSE_FILTER) {
+        return min(1.0, pow(2.0, -bitsPerKey / 1.125));
+    }
+    return min(1.0, exp(-bitsPerKey * log(2.0) * log(2.0)));
+}
+
+double Filter::bitsForFalsePositiveRate(FilterType type, double rate) {
+    if (rate >= 1.0) {
+        return 0.0;
+    }
+    if (type == BINARY_FUSE_FILTER) {
+        return -log2(rate) * 1.125;
+    }
+    return -log(rate) / (log(2.0) * log(2.0));
+}
+
+uint64_t Filter::hash(int key, uint64_t seed) {
+    // splitmix64 finalizer, every key bit affects every hash bit
+    uint64_t z = uint64_t(uint32_t(key)) + seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
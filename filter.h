@@ -0,0 +1,48 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// Kinds of filters an SST can use, stored in its filter block
+enum FilterType {
+    BLOOM_FILTER = 0,
+    BINARY_FUSE_FILTER = 1,
+    // Range filter over buckets of keys, kept next to the filter of each run
+    PREFIX_BLOOM_FILTER = 2
+};
+
+// Filter over the keys of an SST that answers whether a key may be in it. Filters are built
+// while the SST is written and never change afterwards.
+class Filter {
+public:
+    virtual ~Filter() {}
+
+    virtual FilterType getType() const = 0;
+    // Add a key, keys arrive in increasing order and each key is added once
+    virtual void add(int key) = 0;
+    // Called once after the last key, static filters are constructed here
+    virtual void build() {}
+    virtual bool mayContain(int key) const = 0;
+    // Bytes used to answer queries
+    virtual size_t getMemoryUsage() const = 0;
+    // Expected false positive rate for keys not in the filter, from the filter as it was built
+    virtual double falsePositiveRate() const = 0;
+    // Append the filter to the filter block of an SST, and restore it from there
+    virtual void serialize(string &out) const = 0;
+    virtual bool deserialize(const char *data, size_t size) = 0;
+
+    // Create a filter for numKeys keys that uses about bitsPerKey bits of memory per key
+    static Filter *create(FilterType type, int numKeys, double bitsPerKey);
+    // False positive rate of a filter with bitsPerKey bits per key and the bits per key for a rate,
+    // with bits as a continuous amount. A built filter may round its bits per key down
+    static double falsePositiveRateFor(FilterType type, double bitsPerKey);
+    static double bitsForFalsePositiveRate(FilterType type, double rate);
+    // Mix a key and a seed into 64 well distributed bits
+    static uint64_t hash(int key, uint64_t seed);
+};
+
+#endif  // FILTER_H
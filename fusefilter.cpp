@@ -0,0 +1,207 @@
+#include "fusefilter.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+int BinaryFuseFilter::maxAttempts = 100;
+
+// Constructor
+BinaryFuseFilter::BinaryFuseFilter(int numKeys, double bitsPerKey) {
+    this->keys.reserve(max(0, numKeys));
+    this->seed = 0;
+    this->fingerprintBits = fingerprintBitsFor(bitsPerKey);
+    this->setSize(0);
+}
+
+int BinaryFuseFilter::fingerprintBitsFor(double bitsPerKey) {
+    // The array has about 1.125 entries per key
+    return max(1, min(FUSE_MAX_FINGERPRINT_BITS, int(bitsPerKey / 1.125 + 1e-9)));
+}
+
+FilterType BinaryFuseFilter::getType() const {
+    return BINARY_FUSE_FILTER;
+}
+
+void BinaryFuseFilter::setSize(uint32_t numKeys) {
+    // Segment length and array size as in the reference implementation for 3 positions
+    int exponent = numKeys <= 1 ? 2 : int(floor(log(double(numKeys)) / log(3.33) + 2.25));
+    this->segmentLength = min(uint32_t(1) << max(exponent, 2), uint32_t(FUSE_MAX_SEGMENT_LENGTH));
+    int64_t capacity = 0;
+    if (numKeys > 1) {
+        double sizeFactor = max(1.125, 0.875 + 0.25 * log(1000000.0) / log(double(numKeys)));
+        capacity = llround(numKeys * sizeFactor);
+    }
+    int64_t segmentCount = (capacity + this->segmentLength - 1) / this->segmentLength - 2;
+    this->setSegmentCount(max(int64_t(1), segmentCount));
+}
+
+void BinaryFuseFilter::setSegmentCount(uint32_t segmentCount) {
+    this->segmentCount = segmentCount;
+    this->arrayLength = (segmentCount + 2) * this->segmentLength;
+    this->fingerprints.assign((uint64_t(this->arrayLength) * this->fingerprintBits + 7) / 8 + sizeof(uint32_t), 0);
+}
+
+void BinaryFuseFilter::positions(uint64_t h, uint32_t *pos) const {
+    // The first position lands in one of the segments, the next two in the following segments
+    uint64_t segmentCountLength = uint64_t(this->segmentCount) * this->segmentLength;
+    uint32_t mask = this->segmentLength - 1;
+    pos[0] = uint32_t((unsigned __int128) h * segmentCountLength >> 64);
+    pos[1] = (pos[0] + this->segmentLength) ^ uint32_t((h >> 18) & mask);
+    pos[2] = (pos[0] + 2 * this->segmentLength) ^ uint32_t(h & mask);
+}
+
+uint32_t BinaryFuseFilter::fingerprint(uint64_t h) const {
+    return uint32_t(h ^ (h >> 32)) & ((uint32_t(1) << this->fingerprintBits) - 1);
+}
+
+uint32_t BinaryFuseFilter::getFingerprint(uint32_t idx) const {
+    uint64_t bit = uint64_t(idx) * this->fingerprintBits;
+    uint32_t word;
+    memcpy(&word, this->fingerprints.data() + bit / 8, sizeof(word));
+    return (word >> (bit % 8)) & ((uint32_t(1) << this->fingerprintBits) - 1);
+}
+
+void BinaryFuseFilter::setFingerprint(uint32_t idx, uint32_t value) {
+    uint64_t bit = uint64_t(idx) * this->fingerprintBits;
+    uint32_t mask = ((uint32_t(1) << this->fingerprintBits) - 1) << (bit % 8);
+    uint32_t word;
+    memcpy(&word, this->fingerprints.data() + bit / 8, sizeof(word));
+    word = (word & ~mask) | (value << (bit % 8));
+    memcpy(this->fingerprints.data() + bit / 8, &word, sizeof(word));
+}
+
+void BinaryFuseFilter::add(int key) {
+    this->keys.push_back(key);
+}
+
+void BinaryFuseFilter::build() {
+    // A duplicate has the same three positions as its key, neither of them is ever peeled off
+    sort(this->keys.begin(), this->keys.end());
+    this->keys.erase(unique(this->keys.begin(), this->keys.end()), this->keys.end());
+    uint32_t size = this->keys.size();
+    this->setSize(size);
+    // Count of keys per position shifted by 2, the low 2 bits XOR which of its positions it is
+    vector<uint8_t> count;
+    vector<uint64_t> hashes;
+    vector<uint32_t> alone;
+    // Keys in the order they are peeled off and the position they were alone at
+    vector<uint64_t> order(size);
+    vector<uint8_t> found(size);
+    uint32_t pos[3];
+    bool peeledAll = false;
+    for (int attempt = 0; attempt < maxAttempts && !peeledAll; attempt++) {
+        // Try seeds until every key can be peeled off, which almost always works at once. A larger
+        // array leaves more positions with a single key
+        if (attempt > 0 && attempt % FUSE_SEEDS_PER_SIZE == 0) {
+            this->setSegmentCount(this->segmentCount + this->segmentCount / 8 + 1);
+        }
+        this->seed = Filter::hash(attempt, 0x5EED);
+        count.assign(this->arrayLength, 0);
+        hashes.assign(this->arrayLength, 0);
+        alone.resize(this->arrayLength);
+        bool overflow = false;
+        for (int key : this->keys) {
+            uint64_t h = Filter::hash(key, this->seed);
+            this->positions(h, pos);
+            for (int j = 0; j < 3; j++) {
+                count[pos[j]] += 4;
+                count[pos[j]] ^= j;
+                hashes[pos[j]] ^= h;
+                overflow |= count[pos[j]] < 4;
+            }
+        }
+        uint32_t queued = 0;
+        for (uint32_t i = 0; i < this->arrayLength && !overflow; i++) {
+            alone[queued] = i;
+            queued += (count[i] >> 2) == 1;
+        }
+        uint32_t peeled = 0;
+        while (queued > 0 && !overflow) {
+            uint32_t idx = alone[--queued];
+            if ((count[idx] >> 2) != 1) {
+                continue;
+            }
+            uint64_t h = hashes[idx];
+            order[peeled] = h;
+            found[peeled] = count[idx] & 3;
+            peeled++;
+            this->positions(h, pos);
+            for (int j = 0; j < 3; j++) {
+                if (j == found[peeled - 1]) {
+                    continue;
+                }
+                alone[queued] = pos[j];
+                queued += (count[pos[j]] >> 2) == 2;
+                count[pos[j]] -= 4;
+                count[pos[j]] ^= j;
+                hashes[pos[j]] ^= h;
+            }
+        }
+        peeledAll = peeled == size;
+    }
+    if (!peeledAll) {
+        cerr << "Failed to build binary fuse filter for " << size << " keys, every key passes" << endl;
+        // Fingerprints of 0 bits all match
+        this->fingerprintBits = 0;
+        this->setSegmentCount(this->segmentCount);
+        vector<int>().swap(this->keys);
+        return;
+    }
+    // Assign fingerprints in reverse peeling order, each key owns the position it was alone at
+    for (uint32_t i = size; i-- > 0;) {
+        uint64_t h = order[i];
+        this->positions(h, pos);
+        uint32_t value = this->fingerprint(h);
+        for (int j = 0; j < 3; j++) {
+            if (j != found[i]) {
+                value ^= this->getFingerprint(pos[j]);
+            }
+        }
+        this->setFingerprint(pos[found[i]], value);
+    }
+    vector<int>().swap(this->keys);
+}
+
+bool BinaryFuseFilter::mayContain(int key) const {
+    uint64_t h = Filter::hash(key, this->seed);
+    uint32_t pos[3];
+    this->positions(h, pos);
+    return (this->getFingerprint(pos[0]) ^ this->getFingerprint(pos[1]) ^ this->getFingerprint(pos[2])) == this->fingerprint(h);
+}
+
+double BinaryFuseFilter::falsePositiveRate() const {
+    return pow(2.0, -this->fingerprintBits);
+}
+
+size_t BinaryFuseFilter::getMemoryUsage() const {
+    return (uint64_t(this->arrayLength) * this->fingerprintBits + 7) / 8;
+}
+
+void BinaryFuseFilter::serialize(string &out) const {
+    uint64_t seed = this->seed;
+    uint32_t header[3] = { uint32_t(this->fingerprintBits), this->segmentLength, this->segmentCount };
+    out.append(reinterpret_cast<const char *>(&seed), sizeof(seed));
+    out.append(reinterpret_cast<const char *>(header), sizeof(header));
+    out.append(reinterpret_cast<const char *>(this->fingerprints.data()), this->getMemoryUsage());
+}
+
+bool BinaryFuseFilter::deserialize(const char *data, size_t size) {
+    uint32_t header[3];
+    if (size < sizeof(this->seed) + sizeof(header)) {
+        return false;
+    }
+    memcpy(&this->seed, data, sizeof(this->seed));
+    memcpy(header, data + sizeof(this->seed), sizeof(header));
+    this->fingerprintBits = header[0];
+    this->segmentLength = header[1];
+    this->segmentCount = header[2];
+    this->arrayLength = (this->segmentCount + 2) * this->segmentLength;
+    size_t bytes = this->getMemoryUsage();
+    if (size != sizeof(this->seed) + sizeof(header) + bytes) {
+        return false;
+    }
+    this->fingerprints.assign(bytes + sizeof(uint32_t), 0);
+    memcpy(this->fingerprints.data(), data + sizeof(this->seed) + sizeof(header), bytes);
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef FUSE_FILTER_H
+#define FUSE_FILTER_H
+
+#include <vector>
+#include "filter.h"
+
+using namespace std;
+#define FUSE_MAX_FINGERPRINT_BITS 16
+#define FUSE_MAX_SEGMENT_LENGTH 262144
+// Seeds tried for one array size, the array grows by an eighth after that many failed ones
+#define FUSE_SEEDS_PER_SIZE 10
+
+// Binary fuse filter with 3 hash positions (Graf and Lemire, 2022). Every key maps to three
+// fingerprints in neighbouring segments of an array whose XOR is the fingerprint of the key.
+// The array takes about 1.125 entries per key, so a filter with f bit fingerprints uses about
+// 1.125 * f bits per key for a false positive rate of 2^-f, less than a bloom filter needs for the
+// same rate. Building it needs all keys at once, they are kept until build. Duplicate keys are
+// dropped at build. If no seed lets every key be peeled off, the filter keeps no fingerprints and
+// every key passes, so a key that was added is never rejected.
+class BinaryFuseFilter : public Filter {
+public:
+    // Constructor, fingerprints get as many bits as fit in bitsPerKey
+    BinaryFuseFilter(int numKeys, double bitsPerKey);
+
+    FilterType getType() const;
+    void add(int key);
+    void build();
+    bool mayContain(int key) const;
+    size_t getMemoryUsage() const;
+    // 2^-fingerprintBits
+    double falsePositiveRate() const;
+    // Seed, fingerprint bits, segment length and count, then the packed fingerprints
+    void serialize(string &out) const;
+    bool deserialize(const char *data, size_t size);
+    // Seeds build tries before it gives up on the fingerprints, tests lower it to check that path
+    static int maxAttempts;
+
+private:
+    // Keys added so far, released by build
+    vector<int> keys;
+    uint64_t seed;
+    int fingerprintBits;
+    uint32_t segmentLength;
+    uint32_t segmentCount;
+    uint32_t arrayLength;
+    // Fingerprints packed with fingerprintBits bits each, followed by padding for 32 bit reads
+    vector<uint8_t> fingerprints;
+
+    // Fingerprint bits a filter with bitsPerKey bits per key uses
+    static int fingerprintBitsFor(double bitsPerKey);
+    // Size the segments and the array for a number of keys
+    void setSize(uint32_t numKeys);
+    // Set the number of segments and clear the fingerprints
+    void setSegmentCount(uint32_t segmentCount);
+    // The three array positions of a hashed key
+    void positions(uint64_t h, uint32_t *pos) const;
+    uint32_t fingerprint(uint64_t h) const;
+    uint32_t getFingerprint(uint32_t idx) const;
+    void setFingerprint(uint32_t idx, uint32_t value);
+};
+
+#endif  // FUSE_FILTER_H
@@ -5,12 +5,12 @@ const double HashTable::loadFactorThreshold = 0.75;
 HashTable::HashTable() : table(initialSize), numElements(0) {}
 
 void HashTable::resizeTable() {
-    int newSize = table.size() * 2;
+    size_t newSize = table.size() * 2;
     std::vector<std::list<HashElement>> newTable(newSize);
 
     for (const auto& bucket : table) {
         for (const auto& element : bucket) {
-            int newIndex = hashFunction(element.key1, element.key2) % newSize;
+            size_t newIndex = hashFunction(element.key1, element.key2) % newSize;
             newTable[newIndex].push_back(element);
         }
     }
@@ -18,19 +18,21 @@ void HashTable::resizeTable() {
     table = std::move(newTable);
 }
 
-int HashTable::hashFunction(int key1, int key2) {
-    // Hash key according to it's level and page number, where key1 is level and key2 is page number
-    int hash_key;
-    if (key1 >= key2) {
-        hash_key = key1 * (key1 + key2);
+size_t HashTable::hashFunction(int key1, int key2) {
+    // Hash key according to it's level and page number, where key1 is level and key2 is page number.
+    // Unsigned so the page number of a large SST cannot overflow into a negative index
+    size_t level = key1, page = key2;
+    size_t hash_key;
+    if (level >= page) {
+        hash_key = level * (level + page);
     } else {
-        hash_key = key1 + key2 * key2;
+        hash_key = level + page * page;
     } 
     return hash_key;
 }
 
 void HashTable::insert(int key1, int key2, int value) {
-    int index = hashFunction(key1, key2) % table.size();
+    size_t index = hashFunction(key1, key2) % table.size();
 
     // Check for duplicates and update value if keys already exist
     auto it = std::find_if(table[index].begin(), table[index].end(),
@@ -52,7 +54,7 @@ void HashTable::insert(int key1, int key2, int value) {
 }
 
 bool HashTable::get(int key1, int key2, int& value) {
-    int index = hashFunction(key1, key2) % table.size();
+    size_t index = hashFunction(key1, key2) % table.size();
     for (const auto& element : table[index]) {
         if (element.key1 == key1 && element.key2 == key2) {
             value = element.value;
@@ -63,7 +65,7 @@ bool HashTable::get(int key1, int key2, int& value) {
 }
 
 void HashTable::remove(int key1, int key2) {
-    int index = hashFunction(key1, key2) % table.size();
+    size_t index = hashFunction(key1, key2) % table.size();
     table[index].remove_if([key1, key2](const HashElement& elem) {
         return elem.key1 == key1 && elem.key2 == key2;
     });
@@ -25,7 +25,7 @@ private:
 
     void resizeTable();
 
-    int hashFunction(int key1, int key2);
+    size_t hashFunction(int key1, int key2);
 
 public:
     HashTable();
@@ -0,0 +1,12 @@
+#ifndef KVPAIR_H
+#define KVPAIR_H
+
+class KV_Pair {
+    public:
+        int key;
+        int val;
+        KV_Pair() {}
+        KV_Pair(int key, int val) : key(key), val(val) {}
+};
+
+#endif
@@ -0,0 +1,88 @@
+#include "learnedindex.h"
+#include <algorithm>
+#include <cmath>
+
+// Constructor
+LearnedIndex::LearnedIndex() {
+    this->fences = NULL;
+}
+
+double LearnedIndex::predict(const Segment &segment, int key) {
+    return segment.start + ((double) key - segment.firstKey) * segment.slope;
+}
+
+void LearnedIndex::build(const vector<int> &fences) {
+    this->fences = &fences;
+    this->segments.clear();
+    int size = fences.size();
+    int start = 0;
+    while (start < size) {
+        // Shrinking cone: the slopes that keep every fence so far within the error of the line
+        // through the first fence of the segment
+        double low = 0, high = INFINITY;
+        int end = start;
+        while (end + 1 < size) {
+            double dx = (double) fences[end + 1] - fences[start];
+            double dy = end + 1 - start;
+            double newLow = max(low, (dy - LEARNED_INDEX_EPSILON) / dx);
+            double newHigh = min(high, (dy + LEARNED_INDEX_EPSILON) / dx);
+            if (newLow > newHigh) {
+                break;
+            }
+            low = newLow;
+            high = newHigh;
+            end++;
+        }
+        Segment segment;
+        segment.start = start;
+        segment.end = end;
+        segment.firstKey = fences[start];
+        // Prefer the slope through the last fence, it is exact for evenly spaced fences
+        double through = end == start ? 0 : (end - start) / ((double) fences[end] - fences[start]);
+        segment.slope = through >= low && through <= high ? through : (low + high) / 2;
+        // Predictions are exact if every fence and the key before it land on the right position,
+        // the prediction grows with the key so the keys in between do as well
+        segment.exact = true;
+        for (int i = start; i <= end && segment.exact; i++) {
+            segment.exact = floor(predict(segment, fences[i])) == i
+                && (i == start || floor(predict(segment, fences[i] - 1)) == i - 1);
+        }
+        this->segments.push_back(segment);
+        start = end + 1;
+    }
+    vector<int> firstKeys;
+    for (Segment &segment : this->segments) {
+        firstKeys.push_back(segment.firstKey);
+    }
+    this->segmentIndex.build(firstKeys);
+}
+
+int LearnedIndex::search(int key) const {
+    int s = this->segmentIndex.search(key);
+    if (s < 0) {
+        return -1;
+    }
+    const Segment &segment = this->segments[s];
+    double prediction = max(double(segment.start), min(double(segment.end), predict(segment, key)));
+    int position = int(prediction);
+    if (segment.exact) {
+        return position;
+    }
+    // The answer is within the error of the prediction, count the fences that are not larger
+    const int *fences = this->fences->data();
+    int low = max(segment.start, position - LEARNED_INDEX_EPSILON - 1);
+    int high = min(segment.end, position + LEARNED_INDEX_EPSILON + 1);
+    int count = 0;
+    for (int i = low; i <= high; i++) {
+        count += fences[i] <= key;
+    }
+    return low + count - 1;
+}
+
+int LearnedIndex::getNumSegments() const {
+    return this->segments.size();
+}
+
+size_t LearnedIndex::getMemoryUsage() const {
+    return this->segments.size() * sizeof(Segment) + this->segmentIndex.getMemoryUsage();
+}
@@ -0,0 +1,49 @@
+#ifndef LEARNED_INDEX_H
+#define LEARNED_INDEX_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "fenceindex.h"
+
+using namespace std;
+// Largest distance between the predicted and the actual position of a fence key
+#define LEARNED_INDEX_EPSILON 8
+
+// Piecewise linear index over the fence keys of an SST (PGM index, Ferragina and Vinciguerra, 2020).
+// Each segment predicts the position of a fence key from the key with an error of at most
+// LEARNED_INDEX_EPSILON, so a search only looks at the fences around the prediction. Segments are
+// found in a fence index over their first keys. A segment whose prediction is exact for every key,
+// like the fences of a run of consecutive keys, answers without reading the fence keys at all.
+class LearnedIndex {
+public:
+    LearnedIndex();
+    LearnedIndex(const LearnedIndex &other) = delete;
+    LearnedIndex &operator=(const LearnedIndex &other) = delete;
+
+    // Fit the segments for increasing fence keys, the fences have to stay alive for search
+    void build(const vector<int> &fences);
+    // Index of the last fence that is not larger than key, -1 if every fence is larger
+    int search(int key) const;
+    int getNumSegments() const;
+    // Bytes of the segments and the index over them
+    size_t getMemoryUsage() const;
+
+private:
+    struct Segment {
+        // Position of the segment's first fence and of its last fence
+        int start;
+        int end;
+        int firstKey;
+        // Predictions of the positions of all keys of the segment are exact
+        bool exact;
+        double slope;
+    };
+    const vector<int> *fences;
+    vector<Segment> segments;
+    FenceIndex segmentIndex;
+
+    static double predict(const Segment &segment, int key);
+};
+
+#endif  // LEARNED_INDEX_H
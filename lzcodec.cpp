@@ -0,0 +1,166 @@
+#include "lzcodec.h"
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+static inline uint32_t read32(const char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t read64(const char *p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t hashPrefix(uint32_t prefix) {
+    return (prefix * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Write the 4 bit part of a length into the token and the rest as bytes of 255 and a final byte
+static inline char *writeLength(char *out, int length) {
+    if (length >= 15) {
+        for (length -= 15; length >= 255; length -= 255) {
+            *out++ = char(255);
+        }
+        *out++ = char(length);
+    }
+    return out;
+}
+
+// Read the rest of a length whose 4 bit part was 15, false if the block ends first
+static inline bool readLength(const uint8_t *&in, const uint8_t *end, int &length) {
+    if (length != 15) {
+        return true;
+    }
+    uint8_t byte;
+    do {
+        if (in == end) {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Copy length bytes in chunks of 8, which may write up to 7 bytes past the end and read as many
+// past the source. The source has to be at least 8 bytes before the destination
+static inline void copyChunks(char *dst, const char *src, int length) {
+    for (char *end = dst + length; dst < end; dst += 8, src += 8) {
+        memcpy(dst, src, 8);
+    }
+}
+
+static char *writeSequence(char *out, const char *literals, int numLiterals, int offset, int matchLength) {
+    char *token = out++;
+    *token = char(min(numLiterals, 15) << 4);
+    out = writeLength(out, numLiterals);
+    memcpy(out, literals, numLiterals);
+    out += numLiterals;
+    if (matchLength == 0) {
+        return out;
+    }
+    *out++ = char(offset);
+    *out++ = char(offset >> 8);
+    *token |= char(min(matchLength - LZ_MIN_MATCH, 15));
+    return writeLength(out, matchLength - LZ_MIN_MATCH);
+}
+
+int LZCodec::maxCompressedSize(int size) {
+    return LZ_MAX_COMPRESSED_SIZE(size);
+}
+
+int LZCodec::compress(const char *in, int size, char *out) {
+    // Last position each hashed prefix was seen at, plus one so 0 means never
+    int table[1 << LZ_HASH_BITS] = {};
+    char *start = out;
+    int pos = 0, anchor = 0;
+    while (pos + LZ_MIN_MATCH <= size) {
+        uint32_t prefix = read32(in + pos);
+        uint32_t h = hashPrefix(prefix);
+        int candidate = table[h] - 1;
+        table[h] = pos + 1;
+        if (candidate < 0 || pos - candidate > LZ_MAX_OFFSET || read32(in + candidate) != prefix) {
+            // Data without matches is skipped faster the longer it goes on
+            pos += 1 + ((pos - anchor) >> 6);
+            continue;
+        }
+        // Extend the match 8 bytes at a time, the first differing bit ends it
+        int length = LZ_MIN_MATCH;
+        while (pos + length + 8 <= size) {
+            uint64_t diff = read64(in + candidate + length) ^ read64(in + pos + length);
+            if (diff != 0) {
+                length += __builtin_ctzll(diff) / 8;
+                break;
+            }
+            length += 8;
+        }
+        if (pos + length + 8 > size) {
+            while (pos + length < size && in[candidate + length] == in[pos + length]) {
+                length++;
+            }
+        }
+        out = writeSequence(out, in + anchor, pos - anchor, pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+    out = writeSequence(out, in + anchor, size - anchor, 0, 0);
+    return out - start;
+}
+
+int LZCodec::decompress(const char *in, int size, char *out, int capacity) {
+    const uint8_t *ip = reinterpret_cast<const uint8_t *>(in);
+    const uint8_t *end = ip + size;
+    int written = 0;
+    while (ip < end) {
+        uint8_t token = *ip++;
+        int numLiterals = token >> 4;
+        if (!readLength(ip, end, numLiterals) || numLiterals > end - ip || numLiterals > capacity - written) {
+            return -1;
+        }
+        // Most sequences are short, a fixed size copy is cheaper while there is room to run over
+        if (end - ip >= numLiterals + 8 && capacity - written >= numLiterals + 8) {
+            copyChunks(out + written, reinterpret_cast<const char *>(ip), numLiterals);
+        } else {
+            memcpy(out + written, ip, numLiterals);
+        }
+        ip += numLiterals;
+        written += numLiterals;
+        // Only the last sequence has no match
+        if (ip == end) {
+            return written;
+        }
+        if (end - ip < 2) {
+            return -1;
+        }
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        int length = token & 15;
+        if (!readLength(ip, end, length)) {
+            return -1;
+        }
+        length += LZ_MIN_MATCH;
+        if (offset == 0 || offset > written || length > capacity - written) {
+            return -1;
+        }
+        // A match that overlaps the bytes it produces repeats them, so it is copied in chunks no
+        // longer than the offset
+        if (offset >= 8 && capacity - written >= length + 8) {
+            copyChunks(out + written, out + written - offset, length);
+            written += length;
+        } else if (offset >= length) {
+            memcpy(out + written, out + written - offset, length);
+            written += length;
+        } else {
+            for (int i = 0; i < length; i++, written++) {
+                out[written] = out[written - offset];
+            }
+        }
+    }
+    return -1;
+}
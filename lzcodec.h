@@ -0,0 +1,34 @@
+#ifndef LZ_CODEC_H
+#define LZ_CODEC_H
+
+// Compression of the data pages of an SST, stored in its footer
+enum CompressionType {
+    NO_COMPRESSION = 0,
+    LZ_COMPRESSION = 1
+};
+
+// Shortest match worth a sequence, and the hash table of 4 byte prefixes the compressor keeps
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+#define LZ_MAX_OFFSET 65535
+// Largest size a block of size bytes compresses to, only literals with a token and length bytes
+#define LZ_MAX_COMPRESSED_SIZE(size) ((size) + (size) / 255 + 16)
+
+// Byte oriented LZ77 codec in the block format of LZ4. A block is a series of sequences, each a
+// token byte with a literal length and a match length of 4 bits, longer lengths continued in
+// bytes of 255, the literals, and a 2 byte offset back to the match. The last sequence has only
+// literals. Compression finds matches with a single hash table probe per position, decompression
+// only copies bytes, so both run at memory speed and a data page is worth compressing on its own.
+class LZCodec {
+public:
+    // Largest size a block of size bytes compresses to
+    static int maxCompressedSize(int size);
+    // Compress size bytes from in to out, which has room for maxCompressedSize bytes. Return the
+    // compressed size
+    static int compress(const char *in, int size, char *out);
+    // Decompress a block of size bytes into at most capacity bytes at out. Return the decompressed
+    // size, -1 if the block is corrupt
+    static int decompress(const char *in, int size, char *out, int capacity);
+};
+
+#endif  // LZ_CODEC_H
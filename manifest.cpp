@@ -0,0 +1,158 @@
+#include "manifest.h"
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+
+// Constructor
+Manifest::Manifest(string &prefix) {
+    this->directory = prefix;
+    this->filepath = prefix + MANIFEST_FILE;
+    this->fd = open(this->filepath.c_str(), O_RDWR | O_CREAT, 0644);
+    if (this->fd == -1) {
+        cerr << "Failed to open manifest: " << this->filepath << endl;
+    }
+    this->filesize = lseek(this->fd, 0, SEEK_END);
+}
+
+// Destructor
+Manifest::~Manifest() {
+    close(this->fd);
+}
+
+uint32_t Manifest::checksum(const char *data, size_t length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+string Manifest::encode(vector<ManifestEntry> &entries) {
+    string payload;
+    uint32_t count = entries.size();
+    payload.append(reinterpret_cast<const char *>(&count), sizeof(count));
+    for (auto &entry : entries) {
+        int32_t fields[5] = { entry.level, entry.run, entry.dataSize, entry.minKey, entry.maxKey };
+        uint32_t nameLength = entry.file.size();
+        payload.append(reinterpret_cast<const char *>(fields), sizeof(fields));
+        payload.append(reinterpret_cast<const char *>(&nameLength), sizeof(nameLength));
+        payload.append(entry.file);
+    }
+    uint32_t header[2] = { (uint32_t) payload.size(), checksum(payload.data(), payload.size()) };
+    return string(reinterpret_cast<const char *>(header), sizeof(header)) + payload;
+}
+
+bool Manifest::decode(const char *payload, uint32_t length, vector<ManifestEntry> &entries) {
+    const char *end = payload + length;
+    uint32_t count;
+    if (length < sizeof(count)) {
+        return false;
+    }
+    memcpy(&count, payload, sizeof(count));
+    payload += sizeof(count);
+    entries.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t fields[5];
+        uint32_t nameLength;
+        if (end - payload < (long) (sizeof(fields) + sizeof(nameLength))) {
+            return false;
+        }
+        memcpy(fields, payload, sizeof(fields));
+        memcpy(&nameLength, payload + sizeof(fields), sizeof(nameLength));
+        payload += sizeof(fields) + sizeof(nameLength);
+        if (end - payload < (long) nameLength) {
+            return false;
+        }
+        ManifestEntry entry;
+        entry.level = fields[0];
+        entry.run = fields[1];
+        entry.dataSize = fields[2];
+        entry.minKey = fields[3];
+        entry.maxKey = fields[4];
+        entry.file.assign(payload, nameLength);
+        payload += nameLength;
+        entries.push_back(entry);
+    }
+    return true;
+}
+
+bool Manifest::syncDirectory() {
+    int dirfd = open(this->directory.c_str(), O_RDONLY | O_DIRECTORY);
+    bool synced = dirfd != -1 && fsync(dirfd) == 0;
+    if (dirfd != -1) {
+        close(dirfd);
+    }
+    return synced;
+}
+
+bool Manifest::append(vector<ManifestEntry> &entries) {
+    // New and relinked SSTs are only found under names that reached the disk
+    if (!this->syncDirectory()) {
+        cerr << "Failed to sync directory: " << this->directory << endl;
+        return false;
+    }
+    string record = encode(entries);
+    // A record larger than the limit is still appended a few times before the next rewrite
+    if (this->filesize + (off_t) record.size() > max((off_t) MANIFEST_MAX_SIZE, 4 * (off_t) record.size())) {
+        return this->rewrite(record);
+    }
+    if (pwrite(this->fd, record.data(), record.size(), this->filesize) != (ssize_t) record.size()
+        || fdatasync(this->fd) != 0) {
+        cerr << "Failed to append to manifest: " << this->filepath << endl;
+        return false;
+    }
+    this->filesize += record.size();
+    return true;
+}
+
+bool Manifest::rewrite(string &record) {
+    // Write the new manifest next to the old one and swap them, the rename is atomic
+    string temppath = this->filepath + ".tmp";
+    int tempfd = open(temppath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (tempfd == -1 || pwrite(tempfd, record.data(), record.size(), 0) != (ssize_t) record.size()
+        || fsync(tempfd) != 0 || rename(temppath.c_str(), this->filepath.c_str()) != 0 || !this->syncDirectory()) {
+        cerr << "Failed to rewrite manifest: " << this->filepath << endl;
+        if (tempfd != -1) {
+            close(tempfd);
+        }
+        return false;
+    }
+    close(this->fd);
+    this->fd = tempfd;
+    this->filesize = record.size();
+    return true;
+}
+
+bool Manifest::readLatest(vector<ManifestEntry> &entries) {
+    string data(this->filesize, '\0');
+    if (pread(this->fd, &data[0], data.size(), 0) != (ssize_t) data.size()) {
+        cerr << "Failed to read manifest: " << this->filepath << endl;
+        return false;
+    }
+    // Walk the records, the last one that is complete and intact wins
+    bool found = false;
+    size_t offset = 0;
+    uint32_t header[2];
+    vector<ManifestEntry> record;
+    while (offset + sizeof(header) <= data.size()) {
+        memcpy(header, data.data() + offset, sizeof(header));
+        const char *payload = data.data() + offset + sizeof(header);
+        if (header[0] > data.size() - offset - sizeof(header) || checksum(payload, header[0]) != header[1]
+            || !decode(payload, header[0], record)) {
+            break;
+        }
+        entries.swap(record);
+        found = true;
+        offset += sizeof(header) + header[0];
+    }
+    // Cut off a torn record so new records follow the last intact one
+    if (offset != data.size()) {
+        if (ftruncate(this->fd, offset) != 0) {
+            cerr << "Failed to truncate manifest: " << this->filepath << endl;
+        }
+        this->filesize = offset;
+    }
+    return found;
+}
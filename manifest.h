@@ -0,0 +1,64 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+
+using namespace std;
+#define MANIFEST_FILE "MANIFEST"
+// The manifest is rewritten with only the newest record once it grows beyond this size, or beyond
+// four records when they are larger
+#define MANIFEST_MAX_SIZE (64 << 10)
+
+// One SST as recorded in the manifest
+struct ManifestEntry {
+    int level;
+    // Position of the run in its level, newest first
+    int run;
+    // File name relative to the directory of the database
+    string file;
+    // Size of the data pages
+    int dataSize;
+    int minKey;
+    int maxKey;
+};
+
+// Log of the SSTs of a database. After every flush the SSTs of all levels are appended as one
+// record, so the newest record describes the whole LSM tree. Each record is written with a single
+// write and carries its length and a checksum, a record torn by a crash is ignored when reading.
+// The directory is synced before a record and the record before append returns, so files the
+// record names are on disk and files it no longer names can be removed once it returns.
+class Manifest {
+public:
+    // Constructor, opens or creates the manifest in the directory of the database
+    Manifest(string &prefix);
+    // Destructor
+    ~Manifest();
+
+    // Append the SSTs of all levels as a new record and sync it, return false if it is not on disk
+    bool append(vector<ManifestEntry> &entries);
+    // Read the newest complete record, return false if there is none
+    bool readLatest(vector<ManifestEntry> &entries);
+
+private:
+    string directory;
+    string filepath;
+    int fd;
+    // Bytes in the manifest so far
+    off_t filesize;
+
+    // Serialize a record: length, checksum, then the entries
+    static string encode(vector<ManifestEntry> &entries);
+    static bool decode(const char *payload, uint32_t length, vector<ManifestEntry> &entries);
+    static uint32_t checksum(const char *data, size_t length);
+    // Replace the manifest with a file holding only one record
+    bool rewrite(string &record);
+    // Sync the names of the files in the directory of the database
+    bool syncDirectory();
+};
+
+#endif  // MANIFEST_H
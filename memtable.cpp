@@ -1,27 +1,81 @@
 #include "memtable.h"
 
 
+// --- Arena ---
+Arena::Arena(size_t block_size) {
+    this->alloc_ptr = NULL;
+    this->alloc_remaining = 0;
+    this->block_size = block_size;
+    this->memory_usage = 0;
+}
+
+Arena::~Arena() {
+    for (char * block : this->blocks) {
+        delete[] block;
+    }
+}
+
+char * Arena::allocate(size_t bytes) {
+    // Keep every allocation pointer aligned
+    const size_t align = sizeof(void *);
+    bytes = (bytes + align - 1) & ~(align - 1);
+    if (bytes <= this->alloc_remaining) {
+        char * result = this->alloc_ptr;
+        this->alloc_ptr += bytes;
+        this->alloc_remaining -= bytes;
+        return result;
+    }
+    // Object larger than a quarter block get its own block so the current one is not wasted
+    if (bytes > this->block_size / 4) {
+        return allocateNewBlock(bytes);
+    }
+    this->alloc_ptr = allocateNewBlock(this->block_size);
+    this->alloc_remaining = this->block_size;
+    char * result = this->alloc_ptr;
+    this->alloc_ptr += bytes;
+    this->alloc_remaining -= bytes;
+    return result;
+}
+
+char * Arena::allocateNewBlock(size_t bytes) {
+    char * block = new char[bytes];
+    this->blocks.push_back(block);
+    this->memory_usage += bytes;
+    return block;
+}
+
+void Arena::setBlockSize(size_t block_size) {
+    this->block_size = block_size;
+}
+
+size_t Arena::getMemoryUsage() {
+    return this->memory_usage;
+}
+
+
 // --- Tree methods ---
-Node::Node(int key, int val) { // Node constructor
-    this->key = key;
-    this->val = val;
+Node::Node(int key, int val) : KV_Pair(key, val) { // Node constructor
     this->left = NULL;
     this->right = NULL;
     this->height = 1;
 }
 
-Memtable::Memtable(Node* root){ // Memtable constructor
+Memtable::Memtable(Node* root, bool concurrent){ // Memtable constructor
     this->root = root;
+    this->curr_size = 0;
+    this->max_size = 0;
+    this->skiplist = concurrent ? new SkipList(ARENA_BLOCK_SIZE) : NULL;
+    // Concurrent writers cannot share an append buffer, neither can an existing tree
+    this->append_mode = !concurrent && root == NULL;
+    this->append_buffer = NULL;
+    this->append_count = 0;
 }
 
-
-KV_Pair::KV_Pair() { // KV_Pair default constructor
+Memtable::~Memtable() { // Memtable destructor, nodes are freed together with the arena
+    this->root = NULL;
+    delete this->skiplist;
 }
 
-KV_Pair::KV_Pair(int key, int val) { // KV_Pair constructor
-    this->key = key;
-    this->val = val;
-}
 
 int max(int a, int b) {
   return (a > b) ? a : b;
@@ -68,7 +122,7 @@ int Memtable::getBalanceFactor(Node * node) {
 
 Node * Memtable::insertNode(Node * root, int key, int val) {
     if (root == NULL)
-        return new Node(key, val);
+        return new (this->arena.allocate(sizeof(Node))) Node(key, val);
 
     // insert node
     if (key < root->key) {
@@ -106,6 +160,55 @@ Node * Memtable::insertNode(Node * root, int key, int val) {
     return root;
 }
 
+bool Memtable::upsert(int key, int val) {
+    // Pairs still in the append buffer have to be in the tree first
+    if (this->append_mode) {
+        convertToTree();
+    }
+    // Links followed from the root, so a rotated subtree can be hooked back into its parent
+    Node ** path[MEMTABLE_MAX_HEIGHT];
+    int depth = 0;
+    Node ** link = &this->root;
+    while (*link != NULL) {
+        Node * cur = *link;
+        if (key == cur->key) {
+            // Key already in memtable, replace the old value with new value
+            cur->val = val;
+            return false;
+        }
+        path[depth++] = link;
+        link = (key < cur->key) ? &cur->left : &cur->right;
+    }
+    *link = new (this->arena.allocate(sizeof(Node))) Node(key, val);
+
+    // Walk back up, updating heights until a subtree keeps its height or gets rotated
+    for (int i = depth - 1; i >= 0; i--) {
+        Node * node = *path[i];
+        int old_height = node->height;
+        node->height = max(getNodeHeight(node->left), getNodeHeight(node->right)) + 1;
+        int balanceFactor = getBalanceFactor(node);
+        if (balanceFactor > 1) {
+            if (key > node->left->key) {
+                node->left = leftRotate(node->left);
+            }
+            *path[i] = rightRotate(node);
+            // A rotation after an insert restores the old height of the subtree
+            break;
+        }
+        if (balanceFactor < -1) {
+            if (key < node->right->key) {
+                node->right = rightRotate(node->right);
+            }
+            *path[i] = leftRotate(node);
+            break;
+        }
+        if (node->height == old_height) {
+            break;
+        }
+    }
+    return true;
+}
+
 Node * Memtable::getNode(Node* root, int key) {
     if (root == NULL)
         return NULL;
@@ -123,6 +226,12 @@ Node * Memtable::getNode(Node* root, int key) {
 // helperful function for memtable
 void Memtable::setSize(size_t size) {
     max_size = size;
+    // A memtable holds at most size / KV_PAIR_SIZE nodes, do not reserve more than that
+    size_t expected = (size / (2 * sizeof(int)) + 1) * sizeof(Node);
+    this->arena.setBlockSize(min(expected, (size_t) ARENA_BLOCK_SIZE));
+    if (this->skiplist != NULL) {
+        this->skiplist->setBlockSize(min(expected, (size_t) ARENA_BLOCK_SIZE));
+    }
 }
 
 // Get current size of memtable
@@ -135,41 +244,119 @@ void Memtable::increSize(size_t size) {
     this->curr_size += size;
 }
 
-// Scan the memtable to SST
-void Memtable::scanToFile(Node *cur, ofstream *MyFile) {
-    // Base case:
-    if (cur == NULL) {
-        return;
-    };
-    // Recursive scan
-    scanToFile(cur->left, MyFile);
-    MyFile->write( reinterpret_cast<const char *>(&cur->key), sizeof(int));
-    MyFile->write( reinterpret_cast<const char *>(&cur->val), sizeof(int));
-    scanToFile(cur->right, MyFile);
+// --- Append buffer ---
+bool Memtable::appendPut(int key, int val, bool &inserted) {
+    if (this->append_count == 0 || key > this->append_buffer[this->append_count - 1].key) {
+        // A memtable holds at most max_size / KV_PAIR_SIZE pairs before it is flushed
+        size_t capacity = (this->max_size + sizeof(KV_Pair) - 1) / sizeof(KV_Pair);
+        if (this->append_count == capacity) {
+            return false;
+        }
+        if (this->append_buffer == NULL) {
+            this->append_buffer = reinterpret_cast<KV_Pair *>(this->arena.allocate(capacity * sizeof(KV_Pair)));
+        }
+        this->append_buffer[this->append_count++] = KV_Pair(key, val);
+        inserted = true;
+        return true;
+    }
+    // Key is not larger than the last one, it can only stay if it is an update
+    size_t idx = appendLowerBound(key);
+    if (this->append_buffer[idx].key == key) {
+        this->append_buffer[idx].val = val;
+        inserted = false;
+        return true;
+    }
+    return false;
+}
+
+size_t Memtable::appendLowerBound(int key) {
+    size_t low = 0;
+    size_t high = this->append_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (this->append_buffer[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+void Memtable::convertToTree() {
+    this->append_mode = false;
+    this->root = buildTree(0, this->append_count);
+    this->append_count = 0;
+}
+
+Node * Memtable::buildTree(size_t low, size_t high) {
+    // The middle pair of a sorted range becomes the root, so the tree is balanced
+    if (low >= high) {
+        return NULL;
+    }
+    size_t mid = low + (high - low) / 2;
+    Node * node = new (this->arena.allocate(sizeof(Node))) Node(this->append_buffer[mid].key, this->append_buffer[mid].val);
+    node->left = buildTree(low, mid);
+    node->right = buildTree(mid + 1, high);
+    node->height = max(getNodeHeight(node->left), getNodeHeight(node->right)) + 1;
+    return node;
+}
+
+
+// --- Memtable operations ---
+bool Memtable::put(int key, int val) {
+    if (this->skiplist != NULL) {
+        return this->skiplist->insert(key, val);
+    }
+    if (this->append_mode) {
+        bool inserted;
+        if (appendPut(key, val, inserted)) {
+            return inserted;
+        }
+    }
+    return upsert(key, val);
 }
 
-// Helper function for binary search on the memtable
-vector<KV_Pair *> Memtable::scanMemtable(Node * cur, int lowerbound, int upperbound) {
-    vector<KV_Pair *> results;
-    // If memtable is empty
-    if (cur == NULL) {
-        return results;
+bool Memtable::get(int key, int &val) {
+    if (this->skiplist != NULL) {
+        return this->skiplist->get(key, val);
+    }
+    if (this->append_mode) {
+        size_t idx = appendLowerBound(key);
+        if (idx == this->append_count || this->append_buffer[idx].key != key) {
+            return false;
+        }
+        val = this->append_buffer[idx].val;
+        return true;
     }
-    // Scan left node if key value is greater than lowerbound
-    if (lowerbound < cur->key) {
-        vector<KV_Pair *> leftResults = scanMemtable(cur->left, lowerbound, upperbound);
-        results.insert(results.end(), leftResults.begin(), leftResults.end());
+    Node *node = getNode(this->root, key);
+    if (node == NULL) {
+        return false;
     }
-    // Scan current node if it's in range
-    if (lowerbound <= cur->key && cur->key <= upperbound) {
-        results.push_back(new KV_Pair(cur->key, cur->val));
+    val = node->val;
+    return true;
+}
+
+void Memtable::scan(int lowerbound, int upperbound, vector<KV_Pair> &results) {
+    MemtableIterator it(this);
+    for (it.seek(lowerbound); it.valid() && it.key() <= upperbound; it.next()) {
+        results.push_back(it.get());
     }
-    // Scan right node if key value is less than upperbound
-    if (cur->key < upperbound) {
-        vector<KV_Pair *> rightResults = scanMemtable(cur->right, lowerbound, upperbound);
-        results.insert(results.end(), rightResults.begin(), rightResults.end());
+}
+
+bool Memtable::isEmpty() {
+    if (this->skiplist != NULL) {
+        return this->skiplist->isEmpty();
     }
-    return results;
+    return this->root == NULL && this->append_count == 0;
+}
+
+bool Memtable::isAppendOnly() {
+    return this->append_mode;
+}
+
+bool Memtable::isConcurrent() {
+    return this->skiplist != NULL;
 }
 
 void Memtable::printTree(Node* root, int depth, char prefix) {
@@ -194,12 +381,97 @@ void Memtable::printTree(Node* root, int depth, char prefix) {
 }
 
 
+// --- Memtable iterator ---
+MemtableIterator::MemtableIterator(Memtable * table) {
+    this->table = table;
+    this->depth = 0;
+    this->skipnode = NULL;
+    this->append_idx = 0;
+}
 
+void MemtableIterator::pushLeft(Node * cur) {
+    while (cur != NULL) {
+        this->stack[this->depth++] = cur;
+        cur = cur->left;
+    }
+}
 
+void MemtableIterator::seek(int key) {
+    if (this->table->skiplist != NULL) {
+        this->skipnode = this->table->skiplist->seek(key);
+        return;
+    }
+    if (this->table->append_mode) {
+        this->append_idx = this->table->appendLowerBound(key);
+        return;
+    }
+    // Keep the nodes >= key on the search path, the last one pushed is the smallest of them
+    this->depth = 0;
+    Node * cur = this->table->root;
+    while (cur != NULL) {
+        if (cur->key >= key) {
+            this->stack[this->depth++] = cur;
+            cur = cur->left;
+        } else {
+            cur = cur->right;
+        }
+    }
+}
 
+void MemtableIterator::seekToFirst() {
+    if (this->table->skiplist != NULL) {
+        this->skipnode = this->table->skiplist->first();
+        return;
+    }
+    if (this->table->append_mode) {
+        this->append_idx = 0;
+        return;
+    }
+    this->depth = 0;
+    pushLeft(this->table->root);
+}
 
+bool MemtableIterator::valid() {
+    if (this->table->skiplist != NULL) {
+        return this->skipnode != NULL;
+    }
+    if (this->table->append_mode) {
+        return this->append_idx < this->table->append_count;
+    }
+    return this->depth > 0;
+}
 
+void MemtableIterator::next() {
+    if (this->table->skiplist != NULL) {
+        this->skipnode = this->skipnode->getNext(0);
+        return;
+    }
+    if (this->table->append_mode) {
+        this->append_idx++;
+        return;
+    }
+    // Successor is the smallest node of the right subtree, or the closest ancestor we went left from
+    Node * cur = this->stack[--this->depth];
+    pushLeft(cur->right);
+}
 
+int MemtableIterator::key() {
+    if (this->table->skiplist != NULL) {
+        return this->skipnode->key;
+    }
+    if (this->table->append_mode) {
+        return this->table->append_buffer[this->append_idx].key;
+    }
+    return this->stack[this->depth - 1]->key;
+}
 
-
-
+KV_Pair MemtableIterator::get() {
+    if (this->table->skiplist != NULL) {
+        // Writers holding the shared lock overwrite the value at the same time
+        return KV_Pair(this->skipnode->key, this->skipnode->getVal());
+    }
+    if (this->table->append_mode) {
+        return this->table->append_buffer[this->append_idx];
+    }
+    return *this->stack[this->depth - 1];
+}
@@ -13,55 +13,141 @@
 #include <cstring>
 #include <algorithm>
 #include <map>
+#include <new>
+#include <atomic>
+#include "kvpair.h"
+#include "skiplist.h"
 
 using namespace std;
 using std::string;
 
-class Node{
+// Default size of one arena block, memtables smaller than this reserve only what they need
+#define ARENA_BLOCK_SIZE (1 << 20)
+
+// Bump allocator that hands out memory from large contiguous blocks.
+// Nothing is freed individually, all blocks are released at once in the destructor.
+class Arena {
+    public:
+        Arena(size_t block_size = ARENA_BLOCK_SIZE);
+        ~Arena();
+        // Allocate bytes aligned to pointer size
+        char * allocate(size_t bytes);
+        // Change the size of blocks allocated from now on
+        void setBlockSize(size_t block_size);
+        // Total bytes reserved by the arena
+        size_t getMemoryUsage();
+
+    private:
+        vector<char *> blocks;
+        char * alloc_ptr;
+        size_t alloc_remaining;
+        size_t block_size;
+        size_t memory_usage;
+
+        char * allocateNewBlock(size_t bytes);
+};
+
+// Max height of the tree, an AVL tree of 2^31 nodes is less than 45 high
+#define MEMTABLE_MAX_HEIGHT 64
+
+// A tree node is a KV_Pair, so scans can hand out pairs without copying them
+class Node : public KV_Pair {
     public:
-        int key;
-        int val;
         int height;
         Node * left;
         Node * right;
         Node(int key, int value);
  };
 
-class KV_Pair {
-    public:
-        int key;
-        int val;
-        KV_Pair();
-        KV_Pair(int key, int val);
-};
-
 class Memtable{
     public:
         Node * root;
 
         // Tree methods
-        Memtable(Node * root);
+        // A concurrent memtable keeps its data in a lock-free skip list instead of the tree
+        Memtable(Node * root, bool concurrent = false);
+        // Release every node of the tree in one shot
+        ~Memtable();
         int getNodeHeight(Node * node);
         int getNodeNum(Node *root);
         Node * rightRotate(Node * y);
         Node * leftRotate(Node * x);
         int getBalanceFactor(Node * N);
         Node * insertNode(Node *root, int key, int val);
+        // Insert or overwrite a key in a single walk from the root, rebalance iteratively on the way back.
+        // Return true if the key is new to the tree
+        bool upsert(int key, int val);
         Node * getNode(Node* root, int key);
 
+        // Memtable operations, these work on the append buffer, the tree or the skip list depending on the mode
+        // Insert or overwrite a key, return true if the key is new to the memtable
+        bool put(int key, int val);
+        // Look up a key, return true and set val if it is found
+        bool get(int key, int &val);
+        // Append all pairs with lowerbound <= key <= upperbound to results in key order
+        void scan(int lowerbound, int upperbound, vector<KV_Pair> &results);
+        bool isEmpty();
+        bool isConcurrent();
+        // True while every key arrived in increasing order and the pairs are kept in the append buffer
+        bool isAppendOnly();
+
         // Other helper functions
         size_t getCurrentSize();
         void increSize(size_t size);
         void setSize(size_t size);
-        // Write memtable data to a sst file
-        void scanToFile(Node *cur, ofstream *MyFile);
-        // Scan operation for memtable
-        vector<KV_Pair *> scanMemtable(Node * cur, int lowerbound, int upperbound);
         void printTree(Node* root, int depth = 0, char prefix = 'R');
 
     private:
-        size_t curr_size;
+        friend class MemtableIterator;
+        // Updated by concurrent writers in concurrent mode
+        atomic<size_t> curr_size;
         size_t max_size;
+        // All nodes of the tree live in the arena
+        Arena arena;
+        // Data of a concurrent memtable, NULL for a tree memtable
+        SkipList * skiplist;
+        // Sorted pairs of a tree memtable as long as keys arrive in increasing order.
+        // The first out of order key moves them into the tree
+        bool append_mode;
+        KV_Pair * append_buffer;
+        size_t append_count;
+
+        // Put into the append buffer, return false if the key has to go to the tree instead
+        bool appendPut(int key, int val, bool &inserted);
+        // Index of the first pair in the append buffer with key >= target
+        size_t appendLowerBound(int key);
+        // Move the append buffer into a balanced tree
+        void convertToTree();
+        Node * buildTree(size_t low, size_t high);
+};
+
+// In-order iterator over a memtable that does not allocate, the tree path is kept in a fixed array.
+// Pairs are copied out of their nodes, writers of a concurrent memtable overwrite values in place.
+class MemtableIterator {
+    public:
+        MemtableIterator(Memtable * table);
+        // Position at the first pair with key >= target
+        void seek(int key);
+        void seekToFirst();
+        bool valid();
+        void next();
+        // Key and pair of the current node, only call when valid. The value of a skip list node
+        // is read with SkipNode::getVal
+        int key();
+        KV_Pair get();
+
+    private:
+        Memtable * table;
+        // Nodes whose left subtree is being visited, the top is the current node
+        Node * stack[MEMTABLE_MAX_HEIGHT];
+        int depth;
+        // Current node when the memtable is a skip list
+        SkipNode * skipnode;
+        // Current index when the memtable is append only
+        size_t append_idx;
+
+        // Push cur and its left spine
+        void pushLeft(Node * cur);
 };
 
 #endif
\ No newline at end of file
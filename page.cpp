@@ -0,0 +1,217 @@
+#include "page.h"
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#include <immintrin.h>
+
+using namespace std;
+
+bool Page::useAVX2 = __builtin_cpu_supports("avx2");
+
+// Header of a packed page. Key i is firstKey plus i gaps, each gap minGap plus its packed part,
+// and value i is minVal plus its packed part. All sums wrap around as unsigned ints, so any
+// increasing keys and any values fit
+struct PackedPageHeader {
+    int32_t firstKey;
+    uint32_t minGap;
+    int32_t minVal;
+    uint16_t numPairs;
+    uint8_t keyBits;
+    uint8_t valBits;
+};
+static_assert(sizeof(PackedPageHeader) == PACKED_PAGE_HEADER_SIZE, "packed page header size");
+
+// Bits to store any number up to max
+static int bitsFor(uint32_t max) {
+    return max == 0 ? 0 : 32 - __builtin_clz(max);
+}
+
+// Write n numbers with bits bits each, lowest bits first, return the number of bytes written
+static int packBits(const uint32_t *values, int n, int bits, char *out) {
+    uint64_t pending = 0;
+    int pendingBits = 0, bytes = 0;
+    for (int i = 0; i < n; i++) {
+        pending |= uint64_t(values[i]) << pendingBits;
+        pendingBits += bits;
+        while (pendingBits >= 8) {
+            out[bytes++] = char(pending);
+            pending >>= 8;
+            pendingBits -= 8;
+        }
+    }
+    if (pendingBits > 0) {
+        out[bytes++] = char(pending);
+    }
+    return bytes;
+}
+
+static void unpackBitsScalar(const char *in, int first, int n, int bits, uint32_t *out) {
+    uint64_t mask = (uint64_t(1) << bits) - 1;
+    for (int i = first; i < n; i++) {
+        uint64_t bit = uint64_t(i) * bits;
+        uint64_t word;
+        memcpy(&word, in + bit / 8, sizeof(word));
+        out[i] = uint32_t((word >> (bit % 8)) & mask);
+    }
+}
+
+__attribute__((target("avx2")))
+static void unpackBitsAVX2(const char *in, int n, int bits, uint32_t *out) {
+    // Each lane gathers the 4 bytes its number starts in, which hold all of it up to 25 bits
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i mask = _mm256_set1_epi32((1u << bits) - 1);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i bit = _mm256_mullo_epi32(_mm256_add_epi32(_mm256_set1_epi32(i), lanes), _mm256_set1_epi32(bits));
+        __m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int *>(in), _mm256_srli_epi32(bit, 3), 1);
+        words = _mm256_srlv_epi32(words, _mm256_and_si256(bit, _mm256_set1_epi32(7)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_and_si256(words, mask));
+    }
+    unpackBitsScalar(in, i, n, bits, out);
+}
+
+static void unpackBits(const char *in, int n, int bits, uint32_t *out) {
+    if (bits == 0) {
+        fill(out, out + n, 0);
+    } else if (Page::useAVX2 && bits <= 25) {
+        unpackBitsAVX2(in, n, bits, out);
+    } else {
+        unpackBitsScalar(in, 0, n, bits, out);
+    }
+}
+
+// Turn the packed parts of the gaps into keys, starting from the key before the first one
+static void sumGapsScalar(uint32_t *keys, int first, int n, uint32_t previous, uint32_t minGap) {
+    for (int i = first; i < n; i++) {
+        previous += minGap + keys[i];
+        keys[i] = previous;
+    }
+}
+
+__attribute__((target("avx2")))
+static void sumGapsAVX2(uint32_t *keys, int n, uint32_t previous, uint32_t minGap) {
+    // Prefix sum of 8 gaps in 3 steps within each half of the vector, then the low half is
+    // carried into the high half and the last key of the previous vector into all of them
+    __m256i carry = _mm256_set1_epi32(previous);
+    __m256i gap = _mm256_set1_epi32(minGap);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i)), gap);
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+        x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+        x = _mm256_add_epi32(x, _mm256_shuffle_epi32(_mm256_permute2x128_si256(x, x, 0x08), 0xFF));
+        x = _mm256_add_epi32(x, carry);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(keys + i), x);
+        carry = _mm256_permutevar8x32_epi32(x, _mm256_set1_epi32(7));
+    }
+    sumGapsScalar(keys, i, n, i == 0 ? previous : keys[i - 1], minGap);
+}
+
+Page::Page(const char *data, int numPairs, PageFormat format) {
+    this->keys = reinterpret_cast<const int32_t *>(data);
+    this->numPairs = numPairs;
+    if (format == PAX_PAGE) {
+        this->vals = this->keys + numPairs;
+        this->stride = 1;
+    } else {
+        this->vals = this->keys + 1;
+        this->stride = 2;
+    }
+}
+
+int Page::lowerBound(int key) const {
+    return PageSearch::lowerBound(this->keys, this->stride, this->numPairs, key);
+}
+
+int Page::upperBound(int key) const {
+    // Keys are unique, only an equal key has to be skipped
+    int idx = this->lowerBound(key);
+    return idx < this->numPairs && this->key(idx) == key ? idx + 1 : idx;
+}
+
+bool Page::find(int key, int &value) const {
+    int idx = this->lowerBound(key);
+    if (idx < this->numPairs && this->key(idx) == key) {
+        value = this->val(idx);
+        return true;
+    }
+    return false;
+}
+
+void Page::put(char *page, int idx, int key, int val, PageFormat format) {
+    if (format == PAX_PAGE) {
+        // Values start halfway until the page is finished
+        memcpy(page + idx * sizeof(int32_t), &key, sizeof(int32_t));
+        memcpy(page + PAGE_SIZE / 2 + idx * sizeof(int32_t), &val, sizeof(int32_t));
+    } else {
+        memcpy(page + idx * KV_PAIR_SIZE, &key, sizeof(int32_t));
+        memcpy(page + idx * KV_PAIR_SIZE + sizeof(int32_t), &val, sizeof(int32_t));
+    }
+}
+
+void Page::finish(char *page, int numPairs, PageFormat format) {
+    if (format == PAX_PAGE && numPairs < PAIRS_PER_PAGE) {
+        memmove(page + numPairs * sizeof(int32_t), page + PAGE_SIZE / 2, numPairs * sizeof(int32_t));
+    }
+}
+
+int Page::pack(const Page &page, char *out) {
+    int n = page.size();
+    uint32_t gaps[PAIRS_PER_PAGE], vals[PAIRS_PER_PAGE];
+    PackedPageHeader header;
+    header.firstKey = n == 0 ? 0 : page.key(0);
+    header.minGap = numeric_limits<uint32_t>::max();
+    header.minVal = numeric_limits<int32_t>::max();
+    for (int i = 0; i < n; i++) {
+        gaps[i] = i == 0 ? 0 : uint32_t(page.key(i)) - uint32_t(page.key(i - 1));
+        header.minGap = i == 0 ? header.minGap : min(header.minGap, gaps[i]);
+        header.minVal = min(header.minVal, page.val(i));
+    }
+    header.minGap = n <= 1 ? 0 : header.minGap;
+    // Only what a gap or value has above the smallest one is packed, the first key has no gap
+    uint32_t maxGap = 0, maxVal = 0;
+    for (int i = 0; i < n; i++) {
+        gaps[i] = i == 0 ? 0 : gaps[i] - header.minGap;
+        vals[i] = uint32_t(page.val(i)) - uint32_t(header.minVal);
+        maxGap = max(maxGap, gaps[i]);
+        maxVal = max(maxVal, vals[i]);
+    }
+    header.numPairs = n;
+    header.keyBits = bitsFor(maxGap);
+    header.valBits = bitsFor(maxVal);
+    memcpy(out, &header, sizeof(header));
+    int size = sizeof(header);
+    size += packBits(gaps, n, header.keyBits, out + size);
+    size += packBits(vals, n, header.valBits, out + size);
+    return size;
+}
+
+int Page::unpack(const char *in, int size, char *page) {
+    PackedPageHeader header;
+    if (size < (int) sizeof(header)) {
+        return -1;
+    }
+    memcpy(&header, in, sizeof(header));
+    int n = header.numPairs;
+    int keyBytes = (n * header.keyBits + 7) / 8;
+    int valBytes = (n * header.valBits + 7) / 8;
+    if (n > PAIRS_PER_PAGE || header.keyBits > 32 || header.valBits > 32
+        || size != (int) sizeof(header) + keyBytes + valBytes) {
+        return -1;
+    }
+    uint32_t *keys = reinterpret_cast<uint32_t *>(page);
+    uint32_t *vals = keys + n;
+    unpackBits(in + sizeof(header), n, header.keyBits, keys);
+    // The first key has a gap of 0, so the sum starts one smallest gap before it
+    uint32_t previous = uint32_t(header.firstKey) - header.minGap;
+    if (useAVX2) {
+        sumGapsAVX2(keys, n, previous, header.minGap);
+    } else {
+        sumGapsScalar(keys, 0, n, previous, header.minGap);
+    }
+    unpackBits(in + sizeof(header) + keyBytes, n, header.valBits, vals);
+    for (int i = 0; i < n; i++) {
+        vals[i] += uint32_t(header.minVal);
+    }
+    return n;
+}
@@ -0,0 +1,67 @@
+#ifndef PAGE_H
+#define PAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include "kvpair.h"
+#include "pagesearch.h"
+
+#define PAGE_SIZE 4096
+#define KV_PAIR_SIZE 8
+#define PAIRS_PER_PAGE (PAGE_SIZE / KV_PAIR_SIZE)
+// A packed page starts with a header, its pairs never take more than an unpacked page
+#define PACKED_PAGE_HEADER_SIZE 16
+#define PACKED_PAGE_MAX_SIZE (PACKED_PAGE_HEADER_SIZE + PAGE_SIZE)
+// Bytes past the end of a packed page the unpacking may read, but ignores
+#define PACKED_PAGE_PADDING 8
+
+// Layouts of the pairs in a data page, stored in the footer of an SST
+enum PageFormat {
+    // key, val, key, val, ...
+    ROW_PAGE = 0,
+    // All keys of the page, then all values. Searches touch half as many cache lines
+    PAX_PAGE = 1,
+    // Header, then the gaps between keys and the values bit packed with as few bits as the page
+    // needs. Pages take fewer bytes on disk and are unpacked to PAX pages when they are read
+    PACKED_PAGE = 2
+};
+
+// Read only view of the pairs of one data page, in whatever layout its SST uses. A page with n
+// pairs takes n * KV_PAIR_SIZE bytes in either layout, only the last page of an SST is not full,
+// so the number of pairs follows from the data size and pages need no header.
+class Page {
+public:
+    Page() : keys(NULL), vals(NULL), stride(1), numPairs(0) {}
+    Page(const char *data, int numPairs, PageFormat format);
+
+    int size() const { return this->numPairs; }
+    int key(int i) const { return this->keys[i * this->stride]; }
+    int val(int i) const { return this->vals[i * this->stride]; }
+    KV_Pair pair(int i) const { return KV_Pair(this->key(i), this->val(i)); }
+    // Index of the first pair whose key is not smaller than key, and of the first larger one
+    int lowerBound(int key) const;
+    int upperBound(int key) const;
+    // Set value and return true if the page has key
+    bool find(int key, int &value) const;
+
+    // Write pair idx of a page that is being filled, room for a full page is needed
+    static void put(char *page, int idx, int key, int val, PageFormat format);
+    // Close a page with numPairs pairs, a page that is not full moves its values behind its keys
+    static void finish(char *page, int numPairs, PageFormat format);
+    // Write the pairs of a page as a packed page, return its size in bytes
+    static int pack(const Page &page, char *out);
+    // Unpack a packed page of size bytes into a PAX page, the PACKED_PAGE_PADDING bytes after it
+    // have to be readable. Return the number of pairs, -1 if the page is corrupt
+    static int unpack(const char *in, int size, char *page);
+    // Unpack with AVX2, defaults to whether the CPU supports it
+    static bool useAVX2;
+
+private:
+    const int32_t *keys;
+    const int32_t *vals;
+    // Distance between consecutive keys in ints
+    int stride;
+    int numPairs;
+};
+
+#endif  // PAGE_H
@@ -0,0 +1,57 @@
+#include "pagesearch.h"
+#include <algorithm>
+#include <immintrin.h>
+
+using namespace std;
+
+bool PageSearch::useAVX2 = __builtin_cpu_supports("avx2");
+
+// Halve [base, base + length) until minLength keys are left, keys before base stay smaller
+// than key and keys after the range are not smaller. The comparison becomes a conditional move
+template <int STRIDE>
+static inline const int32_t *narrow(const int32_t *base, int &length, int key, int minLength) {
+    while (length > minLength) {
+        int half = length / 2;
+        // Load both keys the next step may compare while this comparison waits for memory
+        __builtin_prefetch(base + ((length - half) / 2 - 1) * STRIDE);
+        __builtin_prefetch(base + (half + (length - half) / 2 - 1) * STRIDE);
+        base = base[(half - 1) * STRIDE] < key ? base + half * STRIDE : base;
+        length -= half;
+    }
+    return base;
+}
+
+template <int STRIDE>
+__attribute__((target("avx2")))
+static int countSmallerAVX2(const int32_t *window, int key) {
+    // Eight ints per vector, interleaved keys are the even lanes
+    const int mask = STRIDE == 1 ? 0xFF : 0x55;
+    __m256i x = _mm256_set1_epi32(key);
+    int count = 0;
+    for (int i = 0; i < PAGE_SEARCH_WINDOW * STRIDE; i += 8) {
+        __m256i ints = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(window + i));
+        int smaller = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, ints)));
+        count += __builtin_popcount(smaller & mask);
+    }
+    return count;
+}
+
+template <int STRIDE>
+static int lowerBoundStride(const int32_t *keys, int numKeys, int key) {
+    if (numKeys <= 0) {
+        return 0;
+    }
+    int length = numKeys;
+    if (PageSearch::useAVX2 && numKeys >= PAGE_SEARCH_WINDOW) {
+        const int32_t *base = narrow<STRIDE>(keys, length, key, PAGE_SEARCH_WINDOW);
+        // The window may start before base to stay inside the page, those keys are smaller anyway
+        const int32_t *window = min(base, keys + (numKeys - PAGE_SEARCH_WINDOW) * STRIDE);
+        return (window - keys) / STRIDE + countSmallerAVX2<STRIDE>(window, key);
+    }
+    const int32_t *base = narrow<STRIDE>(keys, length, key, 1);
+    return (base - keys) / STRIDE + (*base < key);
+}
+
+int PageSearch::lowerBound(const int32_t *keys, int stride, int numKeys, int key) {
+    return stride == 1 ? lowerBoundStride<1>(keys, numKeys, key) : lowerBoundStride<2>(keys, numKeys, key);
+}
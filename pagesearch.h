@@ -0,0 +1,22 @@
+#ifndef PAGE_SEARCH_H
+#define PAGE_SEARCH_H
+
+#include <cstdint>
+
+// Keys the AVX2 kernel compares at once after the binary search
+#define PAGE_SEARCH_WINDOW 16
+
+// Search kernels over the sorted keys of a page as they lie in the buffer pool, either contiguous
+// or interleaved with the values. The search halves the range without branches until
+// PAGE_SEARCH_WINDOW keys are left, then compares the whole window at once with AVX2 where the
+// CPU has it, or keeps halving otherwise.
+class PageSearch {
+public:
+    // Index of the first key not smaller than key, numKeys if every key is smaller. Key i is at
+    // keys[i * stride], stride is 1 for contiguous keys and 2 for keys interleaved with values
+    static int lowerBound(const int32_t *keys, int stride, int numKeys, int key);
+    // Compare the window with AVX2, defaults to whether the CPU supports it
+    static bool useAVX2;
+};
+
+#endif  // PAGE_SEARCH_H
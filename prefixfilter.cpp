@@ -0,0 +1,76 @@
+#include "prefixfilter.h"
+#include <algorithm>
+
+// Constructor
+PrefixBloomFilter::PrefixBloomFilter(int numKeys, double bitsPerKey) {
+    this->bitsPerKey = bitsPerKey;
+    this->filter = new BloomFilter(0, bitsPerKey);
+    // Dense keys fill every bucket, sparser keys have more buckets and grow the vector
+    this->buckets.reserve((max(numKeys, 0) >> PREFIX_BUCKET_BITS) + 1);
+}
+
+PrefixBloomFilter::~PrefixBloomFilter() {
+    delete this->filter;
+}
+
+FilterType PrefixBloomFilter::getType() const {
+    return PREFIX_BLOOM_FILTER;
+}
+
+int PrefixBloomFilter::bucket(int key) {
+    // Arithmetic shift, negative keys get negative buckets in the same order
+    return key >> PREFIX_BUCKET_BITS;
+}
+
+void PrefixBloomFilter::add(int key) {
+    // Keys arrive in increasing order, so keys of a bucket follow each other
+    int b = bucket(key);
+    if (this->buckets.empty() || this->buckets.back() != b) {
+        this->buckets.push_back(b);
+    }
+}
+
+void PrefixBloomFilter::build() {
+    delete this->filter;
+    this->filter = new BloomFilter(this->buckets.size(), this->bitsPerKey);
+    for (int b : this->buckets) {
+        this->filter->add(b);
+    }
+    vector<int>().swap(this->buckets);
+}
+
+bool PrefixBloomFilter::mayContain(int key) const {
+    return this->filter->mayContain(bucket(key));
+}
+
+bool PrefixBloomFilter::mayContainRange(int lowerbound, int upperbound) const {
+    if (lowerbound > upperbound) {
+        return false;
+    }
+    int first = bucket(lowerbound), last = bucket(upperbound);
+    if ((long long) last - first >= PREFIX_MAX_PROBES) {
+        return true;
+    }
+    for (long long b = first; b <= last; b++) {
+        if (this->filter->mayContain(int(b))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t PrefixBloomFilter::getMemoryUsage() const {
+    return this->filter->getMemoryUsage();
+}
+
+double PrefixBloomFilter::falsePositiveRate() const {
+    return this->filter->falsePositiveRate();
+}
+
+void PrefixBloomFilter::serialize(string &out) const {
+    this->filter->serialize(out);
+}
+
+bool PrefixBloomFilter::deserialize(const char *data, size_t size) {
+    return this->filter->deserialize(data, size);
+}
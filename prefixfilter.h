@@ -0,0 +1,49 @@
+#ifndef PREFIX_FILTER_H
+#define PREFIX_FILTER_H
+
+#include <vector>
+#include "filter.h"
+#include "bloomfilter.h"
+
+using namespace std;
+// A bucket holds the keys that agree on everything but the low bits
+#define PREFIX_BUCKET_BITS 4
+// Longer ranges are not checked, they would probe too many buckets
+#define PREFIX_MAX_PROBES 4
+
+// Range filter over buckets of 2^PREFIX_BUCKET_BITS consecutive keys. The bloom filter holds the
+// bucket of every key, so a short range is empty if none of the buckets it touches is in the
+// filter. A scan of up to 16 keys touches at most 2 buckets. The buckets are collected until
+// build, so the filter is sized for the distinct buckets and dense keys take little memory.
+class PrefixBloomFilter : public Filter {
+public:
+    // Constructor for about numKeys keys, bitsPerKey bits for each distinct bucket
+    PrefixBloomFilter(int numKeys, double bitsPerKey);
+    ~PrefixBloomFilter();
+    PrefixBloomFilter(const PrefixBloomFilter &other) = delete;
+    PrefixBloomFilter &operator=(const PrefixBloomFilter &other) = delete;
+
+    FilterType getType() const;
+    void add(int key);
+    void build();
+    // True if the bucket of the key may have keys
+    bool mayContain(int key) const;
+    // True if [lowerbound, upperbound] may have a key, always for ranges over many buckets
+    bool mayContainRange(int lowerbound, int upperbound) const;
+    size_t getMemoryUsage() const;
+    // Rate for a bucket without keys
+    double falsePositiveRate() const;
+    // The bloom filter of the buckets
+    void serialize(string &out) const;
+    bool deserialize(const char *data, size_t size);
+
+private:
+    double bitsPerKey;
+    // Distinct buckets added so far, released by build
+    vector<int> buckets;
+    BloomFilter *filter;
+
+    static int bucket(int key);
+};
+
+#endif  // PREFIX_FILTER_H
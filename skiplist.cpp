@@ -0,0 +1,210 @@
+#include "skiplist.h"
+
+
+// --- Concurrent arena ---
+ConcurrentArena::ConcurrentArena(size_t block_size) {
+    this->block_size = block_size;
+    this->current.store(NULL);
+}
+
+ConcurrentArena::~ConcurrentArena() {
+    for (Block * block : this->blocks) {
+        delete[] block->data;
+        delete block;
+    }
+}
+
+ConcurrentArena::Block * ConcurrentArena::newBlock(size_t bytes) {
+    Block * block = new Block();
+    block->data = new char[bytes];
+    block->capacity = bytes;
+    block->used.store(0);
+    this->blocks.push_back(block);
+    return block;
+}
+
+char * ConcurrentArena::allocate(size_t bytes) {
+    // Keep every allocation pointer aligned
+    const size_t align = sizeof(void *);
+    bytes = (bytes + align - 1) & ~(align - 1);
+    while (true) {
+        Block * block = this->current.load(memory_order_acquire);
+        if (block != NULL) {
+            // Reserve the range with one atomic add, blocks are never freed so a stale block is harmless
+            size_t offset = block->used.fetch_add(bytes, memory_order_relaxed);
+            if (offset + bytes <= block->capacity) {
+                return block->data + offset;
+            }
+        }
+        // Block is used up, install a new one unless another thread already did
+        lock_guard<mutex> guard(this->block_mutex);
+        if (this->current.load(memory_order_acquire) == block) {
+            this->current.store(newBlock(max(this->block_size, bytes)), memory_order_release);
+        }
+    }
+}
+
+void ConcurrentArena::setBlockSize(size_t block_size) {
+    lock_guard<mutex> guard(this->block_mutex);
+    this->block_size = block_size;
+}
+
+
+// --- Skip list node ---
+SkipNode::SkipNode(int key, int val, int height) : KV_Pair(key, val) {
+    this->height = height;
+    for (int i = 0; i < height; i++) {
+        new (&this->next[i]) atomic<SkipNode *>(NULL);
+    }
+}
+
+int SkipNode::getVal() {
+    return __atomic_load_n(&this->val, __ATOMIC_ACQUIRE);
+}
+
+void SkipNode::setVal(int val) {
+    __atomic_store_n(&this->val, val, __ATOMIC_RELEASE);
+}
+
+SkipNode * SkipNode::getNext(int level) {
+    return this->next[level].load(memory_order_acquire);
+}
+
+void SkipNode::setNext(int level, SkipNode * node) {
+    this->next[level].store(node, memory_order_relaxed);
+}
+
+bool SkipNode::casNext(int level, SkipNode * expected, SkipNode * node) {
+    return this->next[level].compare_exchange_strong(expected, node, memory_order_release, memory_order_relaxed);
+}
+
+
+// --- Skip list ---
+SkipList::SkipList(size_t block_size) : arena(block_size) {
+    this->head = newNode(0, 0, SKIPLIST_MAX_HEIGHT);
+    this->max_height.store(1);
+}
+
+SkipNode * SkipList::newNode(int key, int val, int height) {
+    // The node is allocated with room for its whole tower of next pointers
+    size_t bytes = sizeof(SkipNode) + (height - 1) * sizeof(atomic<SkipNode *>);
+    return new (this->arena.allocate(bytes)) SkipNode(key, val, height);
+}
+
+int SkipList::randomHeight() {
+    // Per thread xorshift generator so writers do not contend on a shared seed
+    static thread_local uint32_t seed = 0;
+    if (seed == 0) {
+        seed = (uint32_t) (reinterpret_cast<uintptr_t>(&seed) >> 4) | 1;
+    }
+    int height = 1;
+    while (height < SKIPLIST_MAX_HEIGHT) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        if (seed % SKIPLIST_BRANCHING != 0) {
+            break;
+        }
+        height++;
+    }
+    return height;
+}
+
+void SkipList::findSpliceForLevel(int key, int level, SkipNode ** pred, SkipNode ** succ) {
+    SkipNode * before = *pred;
+    SkipNode * after = before->getNext(level);
+    while (after != NULL && after->key < key) {
+        before = after;
+        after = before->getNext(level);
+    }
+    *pred = before;
+    *succ = after;
+}
+
+void SkipList::findSplice(int key, SkipNode ** preds, SkipNode ** succs) {
+    SkipNode * before = this->head;
+    for (int level = this->max_height.load(memory_order_acquire) - 1; level >= 0; level--) {
+        SkipNode * after;
+        findSpliceForLevel(key, level, &before, &after);
+        preds[level] = before;
+        succs[level] = after;
+    }
+}
+
+bool SkipList::insert(int key, int val) {
+    SkipNode * preds[SKIPLIST_MAX_HEIGHT];
+    SkipNode * succs[SKIPLIST_MAX_HEIGHT];
+    int height = randomHeight();
+    // Raise the list height first so the splice below covers every level of the new node
+    int list_height = this->max_height.load(memory_order_relaxed);
+    while (height > list_height) {
+        if (this->max_height.compare_exchange_weak(list_height, height)) {
+            break;
+        }
+    }
+    findSplice(key, preds, succs);
+    // Key already exists, overwrite the value in place
+    if (succs[0] != NULL && succs[0]->key == key) {
+        succs[0]->setVal(val);
+        return false;
+    }
+    SkipNode * node = newNode(key, val, height);
+    // Link level 0 first, this is the point where the key becomes visible
+    while (true) {
+        node->setNext(0, succs[0]);
+        if (preds[0]->casNext(0, succs[0], node)) {
+            break;
+        }
+        // Another writer changed the splice, search again from the old predecessor
+        findSpliceForLevel(key, 0, &preds[0], &succs[0]);
+        if (succs[0] != NULL && succs[0]->key == key) {
+            // Lost the race against an insert of the same key, the unused node stays in the arena
+            succs[0]->setVal(val);
+            return false;
+        }
+    }
+    // Link the upper levels, these are only shortcuts for searching
+    for (int level = 1; level < height; level++) {
+        while (true) {
+            // The predecessor may lay after the node if another writer linked in between
+            if (succs[level] == NULL || succs[level]->key > key) {
+                node->setNext(level, succs[level]);
+                if (preds[level]->casNext(level, succs[level], node)) {
+                    break;
+                }
+            }
+            findSpliceForLevel(key, level, &preds[level], &succs[level]);
+        }
+    }
+    return true;
+}
+
+bool SkipList::get(int key, int &val) {
+    SkipNode * node = seek(key);
+    if (node != NULL && node->key == key) {
+        val = node->getVal();
+        return true;
+    }
+    return false;
+}
+
+SkipNode * SkipList::seek(int key) {
+    SkipNode * before = this->head;
+    SkipNode * after = NULL;
+    for (int level = this->max_height.load(memory_order_acquire) - 1; level >= 0; level--) {
+        findSpliceForLevel(key, level, &before, &after);
+    }
+    return after;
+}
+
+SkipNode * SkipList::first() {
+    return this->head->getNext(0);
+}
+
+bool SkipList::isEmpty() {
+    return first() == NULL;
+}
+
+void SkipList::setBlockSize(size_t block_size) {
+    this->arena.setBlockSize(block_size);
+}
@@ -0,0 +1,91 @@
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include "kvpair.h"
+
+using namespace std;
+
+// Max number of levels in the skip list, with a branching factor of 4
+// this comfortably indexes the largest memtables we configure
+#define SKIPLIST_MAX_HEIGHT 12
+#define SKIPLIST_BRANCHING 4
+
+// Arena that several threads may allocate from at the same time.
+// The common path is a single atomic add on the current block, a mutex is only
+// taken when the block runs out and a new one has to be installed.
+class ConcurrentArena {
+    public:
+        ConcurrentArena(size_t block_size);
+        ~ConcurrentArena();
+        // Allocate bytes aligned to pointer size
+        char * allocate(size_t bytes);
+        // Change the size of blocks allocated from now on
+        void setBlockSize(size_t block_size);
+
+    private:
+        struct Block {
+            char * data;
+            size_t capacity;
+            atomic<size_t> used;
+        };
+        atomic<Block *> current;
+        vector<Block *> blocks;
+        mutex block_mutex;
+        size_t block_size;
+
+        Block * newBlock(size_t bytes);
+};
+
+// A skip list node is a KV_Pair whose value may be overwritten by a concurrent writer, use getVal
+// and setVal.
+class SkipNode : public KV_Pair {
+    public:
+        int height;
+        // Tower of next pointers, the node is allocated with room for height entries
+        atomic<SkipNode *> next[1];
+
+        SkipNode(int key, int val, int height);
+        int getVal();
+        void setVal(int val);
+        SkipNode * getNext(int level);
+        void setNext(int level, SkipNode * node);
+        bool casNext(int level, SkipNode * expected, SkipNode * node);
+};
+
+// Sorted map from key to value that supports many concurrent writers.
+// Inserts link a node bottom-up with compare-and-swap, readers never lock.
+// Nodes are never removed, deletes are tombstone values written by the database.
+class SkipList {
+    public:
+        SkipList(size_t block_size);
+
+        // Insert or overwrite a key, return true if the key was not in the list before
+        bool insert(int key, int val);
+        // Look up a key, return true and set val if it is found
+        bool get(int key, int &val);
+        // First node with key >= target, NULL if there is none
+        SkipNode * seek(int key);
+        // Smallest node of the list, NULL if the list is empty
+        SkipNode * first();
+        bool isEmpty();
+        void setBlockSize(size_t block_size);
+
+    private:
+        ConcurrentArena arena;
+        SkipNode * head;
+        atomic<int> max_height;
+
+        SkipNode * newNode(int key, int val, int height);
+        int randomHeight();
+        // Find the nodes before and after key on every level below max_height
+        void findSplice(int key, SkipNode ** preds, SkipNode ** succs);
+        // Move forward on one level from pred until the next node is not smaller than key
+        void findSpliceForLevel(int key, int level, SkipNode ** pred, SkipNode ** succ);
+};
+
+#endif
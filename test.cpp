@@ -12,6 +12,21 @@ void clearSST(string step) {
         system("rm -f -r ./SSTs/database_step2/*");
     } else if (step == "3") {
         system("rm -f -r ./SSTs/database_step3/*");
+    } else if (step == "4") {
+        system("rm -f -r ./SSTs/database_step4/*");
+        system("rm -f -r ./SSTs/database_step4_background/*");
+        system("rm -f -r ./SSTs/database_step4_append/*");
+        system("rm -f -r ./SSTs/database_step4_sequential/*");
+        system("rm -f -r ./SSTs/database_step4_fuse/*");
+        system("rm -f -r ./SSTs/database_step4_range/*");
+        system("rm -f -r ./SSTs/database_step4_learned/*");
+        system("rm -f -r ./SSTs/database_step4_row/*");
+        system("rm -f -r ./SSTs/database_step4_packed/*");
+        system("rm -f -r ./SSTs/database_step4_compressed/*");
+        system("rm -f -r ./SSTs/database_step4_policy/*");
+        system("rm -f -r ./SSTs/database_step4_split/*");
+        system("rm -f -r ./SSTs/database_step4_compaction/*");
+        system("rm -f -r ./SSTs/database_step4_cascade/*");
     }
 }
 
@@ -236,6 +251,60 @@ void test_eviction_policy(Database *database) {
     }
 }
 
+// Test that a page that cannot be read is not kept, and that a fetch waits while every page is pinned
+void test_pinned_pages(Database *database) {
+    BufferPool *bufferpool = database->getBufferPool();
+    SSTManager *manager = database->getsstManager();
+    vector<pair<SST *, int>> pages;
+    for (int level = 1; level <= manager->max_level; level++) {
+        for (SST *sst : manager->getSSTs(level)) {
+            for (int page = 0; page < sst->getNumPages(); page++) {
+                pages.push_back(make_pair(sst, page));
+            }
+        }
+    }
+    if (pages.size() <= BUFFER_SIZE) {
+        cerr << "Test Failed: " << pages.size() << " pages are too few to pin every page of the buffer pool" << endl;
+        return;
+    }
+    SST *sst = pages[0].first;
+    Page page;
+    bufferpool->evictPages(sst, 0);
+    string filepath = sst->filepath;
+    sst->filepath = filepath + ".missing";
+    bool fetched = bufferpool->fetchPage(sst, 0, page);
+    sst->filepath = filepath;
+    int page_index;
+    if (fetched || bufferpool->getDictionary().get(sst->getFileId(), 0, page_index)) {
+        cerr << "Test Failed: a page that could not be read was kept in the buffer pool" << endl;
+    }
+    if (!bufferpool->fetchPage(sst, 0, page) || page.size() == 0 || page.pair(0).key != sst->getKeyArray()[0]) {
+        cerr << "Test Failed: page was not read again after a failed read" << endl;
+        return;
+    }
+    bufferpool->releasePage(sst, 0);
+    // Pin a page in every slot, another page has to wait for one of them
+    for (int i = 0; i < BUFFER_SIZE; i++) {
+        bufferpool->fetchPage(pages[i].first, pages[i].second, page);
+    }
+    atomic<bool> done(false);
+    thread reader([&]() {
+        Page last;
+        if (bufferpool->fetchPage(pages[BUFFER_SIZE].first, pages[BUFFER_SIZE].second, last)) {
+            bufferpool->releasePage(pages[BUFFER_SIZE].first, pages[BUFFER_SIZE].second);
+        }
+        done = true;
+    });
+    this_thread::sleep_for(chrono::milliseconds(100));
+    if (done) {
+        cerr << "Test Failed: a page was fetched while every page was pinned" << endl;
+    }
+    for (int i = 0; i < BUFFER_SIZE; i++) {
+        bufferpool->releasePage(pages[i].first, pages[i].second);
+    }
+    reader.join();
+}
+
 void test_for_self_made_hash_table() {
     HashTable hashTable;
 
@@ -307,13 +376,14 @@ void test_lsm_simple_merge(Database *database) {
         database->put(i, i * 10);
     }
     // Check if L2 is created with correct data
-    int fd = open(string("./SSTs/database_step3/L2").c_str(), O_RDONLY);
-    if (fd == -1) {
+    SSTFooter footer;
+    if (!SST::readFooter("./SSTs/database_step3/L2", footer)) {
         cerr << "Test Failed: failed to create file in next level" << endl;
+        return;
     }
-    // Check if file has correct filesize
-    int filesize = lseek(fd, 0, SEEK_END);
-    if (filesize != 2 * PAGE_SIZE) {
+    // Check if file has correct data size and fence keys persisted in its index block
+    if (footer.dataSize != 2 * PAGE_SIZE || footer.numFences != 2 || footer.minKey != 0
+        || footer.maxKey != (2 * PAGE_SIZE) / KV_PAIR_SIZE - 1) {
         cerr << "Test Failed: merged file does not have correct filesize" << endl;
     }
     // Check if file contains correct data
@@ -324,7 +394,6 @@ void test_lsm_simple_merge(Database *database) {
             return;
         }
     }
-    close(fd);
 }
 
 // Test tombstones merge correctly into sst
@@ -338,10 +407,12 @@ void test_tombstone_merge_to_sst(Database *database) {
     if (fd == -1) {
         cerr << "Test Failed: failed to convert tombstone value into sst" << endl;
     }
-    // Check the first KV Pair to see if the value is tombstone
-    int value;
-    pread(fd, &value, sizeof(int), sizeof(int));
-    if (value != numeric_limits<int>::min()) {
+    // Check the first KV Pair to see if the value is tombstone, the page is read in the layout of the SST
+    SSTFooter footer;
+    vector<char> data(PAGE_SIZE);
+    pread(fd, data.data(), PAGE_SIZE, 0);
+    if (!SST::readFooter("./SSTs/database_step3/L1", footer)
+        || Page(data.data(), PAIRS_PER_PAGE, PageFormat(footer.pageFormat)).val(0) != numeric_limits<int>::min()) {
         cerr << "Test Failed: failed to convert tombstone value into sst" << endl;
     }
     close(fd);
@@ -370,6 +441,25 @@ void test_delete_after_merge(Database *database) {
     }
 }
 
+// Test scan after delete, tombstones in a newer level must hide values in older levels
+void test_scan_after_delete(Database *database) {
+    // Keys of the first page are deleted in L1 but still have values in L2
+    vector<KV_Pair> result;
+    database->scan(0, (2 * PAGE_SIZE) / KV_PAIR_SIZE - 1, result);
+    if (int(result.size()) != PAGE_SIZE / KV_PAIR_SIZE) {
+        cerr << "Test Failed: scan after delete returned " << result.size() << " pairs" << endl;
+        return;
+    }
+    for (int i = 0; i < int(result.size()); i++) {
+        int key = PAGE_SIZE / KV_PAIR_SIZE + i;
+        if (!kvpairsEqual(result[i], KV_Pair(key, key * 10))) {
+            cerr << "Test Failed: scan after delete" << endl;
+            cerr << "Actual: (" << result[i].key << ", " << result[i].val << ") != Expected: (" << key << ", " << key * 10 << ")" << endl;
+            return;
+        }
+    }
+}
+
 // Test the ability of merging 2 Level2 SSTs into a Level3 SST
 void test_lsm_merge_twice(Database *database) {
     // From previous tests, we had one L1 sst and one L2 sst, add 1 more PAGE_SIZE data
@@ -394,15 +484,14 @@ void test_lsm_merge_twice(Database *database) {
 
 void test_delete_at_max_level(Database *database) {
     // Test if tombstone are cleared at the max level of LSM Tree
-    int fd = open(string("./SSTs/database_step3/L3").c_str(), O_RDONLY);
-    if (fd == -1) {
+    SSTFooter footer;
+    if (!SST::readFooter("./SSTs/database_step3/L3", footer)) {
         cerr << "Test Failed: failed to create file in next level" << endl;
+        return;
     }
-    int filesize = lseek(fd, 0, SEEK_END);
-    if (filesize != 8192) {
+    if (footer.dataSize != 8192) {
         cerr << "Test Failed: Tombstone are not cleared at the max level" << endl;
     }
-    close(fd);
 }
 
 void test_sst_bloom_filter_for_merged(Database *database) {
@@ -429,6 +518,1384 @@ void test_sst_bloom_filter_for_merged(Database *database) {
 }
 
 
+// Test function for step 4
+// Test several writers putting into a concurrent database at the same time
+void test_concurrent_put(Database *database) {
+    const int writers = 4;
+    // Enough data for several memtables so flushes happen while other writers insert
+    const int volume = (16 * PAGE_SIZE) / KV_PAIR_SIZE;
+    vector<thread> threads;
+    for (int t = 0; t < writers; t++) {
+        threads.push_back(thread([database, t, writers, volume]() {
+            for (int key = t; key < volume; key += writers) {
+                database->put(key, key * 10);
+            }
+        }));
+    }
+    for (auto &writer : threads) {
+        writer.join();
+    }
+    // Every key should be found no matter which writer put it
+    for (int key = 0; key < volume; key++) {
+        int value = database->get(key);
+        if (value != key * 10) {
+            cerr << "Test Failed: concurrent put lost key " << key << endl;
+            cerr << "Actual: " << value << " != Expected: " << key * 10 << endl;
+            return;
+        }
+    }
+    // Scan across memtable and SSTs should see every key once
+    vector<KV_Pair *> result = database->scan(0, volume - 1);
+    if (int(result.size()) != volume) {
+        cerr << "Test Failed: concurrent put scan returned " << result.size() << " pairs instead of " << volume << endl;
+    }
+}
+
+// Test several readers sharing the SSTs and the buffer pool while a writer flushes memtables
+void test_concurrent_get(Database *database) {
+    const int readers = 4;
+    const int volume = (16 * PAGE_SIZE) / KV_PAIR_SIZE;
+    atomic<int> wrong(0);
+    vector<thread> threads;
+    for (int t = 0; t < readers; t++) {
+        threads.push_back(thread([database, t, volume, &wrong]() {
+            vector<KV_Pair> result;
+            for (int key = t; key < volume; key += readers) {
+                wrong += database->get(key) != key * 10;
+                database->scan(key, key + 99, result);
+                wrong += result.empty() || result[0].key != key || result[0].val != key * 10;
+            }
+        }));
+    }
+    // New keys above the range of the readers fill memtables that are flushed meanwhile
+    for (int key = volume; key < 2 * volume; key++) {
+        database->put(key, key * 10);
+    }
+    for (auto &reader : threads) {
+        reader.join();
+    }
+    if (wrong > 0) {
+        cerr << "Test Failed: " << wrong << " concurrent reads were wrong" << endl;
+    }
+}
+
+
+// Test puts while full memtables are flushed by the background thread
+void test_background_flush(Database *database) {
+    // Enough data for several memtables so reads hit the immutable memtables and SSTs
+    const int volume = (16 * PAGE_SIZE) / KV_PAIR_SIZE;
+    for (int key = 0; key < volume; key++) {
+        database->put(key, key * 10);
+    }
+    // Overwrite some keys while older versions may still wait to be flushed
+    for (int key = 0; key < volume; key += 7) {
+        database->update(key, key * 20);
+    }
+    for (int key = 0; key < volume; key++) {
+        int expected = (key % 7 == 0) ? key * 20 : key * 10;
+        int value = database->get(key);
+        if (value != expected) {
+            cerr << "Test Failed: get during background flush" << endl;
+            cerr << "Actual: " << value << " != Expected: " << expected << endl;
+            return;
+        }
+    }
+    vector<KV_Pair *> result = database->scan(0, volume - 1);
+    if (int(result.size()) != volume || result[7]->val != 140) {
+        cerr << "Test Failed: scan during background flush returned " << result.size() << " pairs instead of " << volume << endl;
+    }
+    // Close waits for the flush thread, nothing should get lost
+    database->close();
+    database->open(database->name);
+    for (int key = 0; key < volume; key++) {
+        int expected = (key % 7 == 0) ? key * 20 : key * 10;
+        if (database->get(key) != expected) {
+            cerr << "Test Failed: key " << key << " lost after closing with pending flushes" << endl;
+            return;
+        }
+    }
+}
+
+// Test merges on the flush thread while a reader checks keys that never change
+void test_flush_thread_merges() {
+    system("rm -f -r ./SSTs/database_step4_flush/*");
+    DatabaseOptions options;
+    options.concurrent = true;
+    options.max_immutable_tables = 2;
+    Database *database = new Database("database_step4_flush", 4 * PAGE_SIZE, options);
+    database->open("database_step4_flush");
+    for (int key = -1000; key < 0; key++) {
+        database->put(key, key * 2);
+    }
+    atomic<bool> writing(true);
+    atomic<int> wrong(0);
+    thread reader([&]() {
+        vector<KV_Pair> result;
+        for (int i = 0; writing; i++) {
+            int key = -1 - i % 1000;
+            wrong += database->get(key) != key * 2;
+            database->scan(-1000, -1, result);
+            wrong += result.size() != 1000 || result[0].val != -2000;
+        }
+    });
+    // 16 memtables of random keys fill several levels
+    const int volume = (64 * PAGE_SIZE) / KV_PAIR_SIZE;
+    vector<int> keys(volume);
+    iota(keys.begin(), keys.end(), 0);
+    shuffle(keys.begin(), keys.end(), mt19937(47));
+    for (int key : keys) {
+        database->put(key, key * 10);
+    }
+    writing = false;
+    reader.join();
+    if (wrong > 0) {
+        cerr << "Test Failed: " << wrong << " reads during merges on the flush thread were wrong" << endl;
+    }
+    // The flush thread merged the levels after its flushes
+    database->waitForFlushes();
+    SSTManager *manager = database->getsstManager();
+    for (int level = 1; level <= manager->max_level; level++) {
+        if ((int) manager->getRuns(level).size() > manager->runLimit(level)) {
+            cerr << "Test Failed: flush thread left " << manager->getRuns(level).size() << " runs in L" << level << endl;
+        }
+    }
+    database->close();
+    delete database;
+}
+
+
+// Test the append buffer for increasing keys and appending SSTs with disjoint keys
+void test_sequential_append(Database *database) {
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    // Even keys arrive in order and stay in the append buffer, odd keys move them into the tree
+    for (int key = 0; key < pairs_per_table; key += 2) {
+        database->put(key, key * 10);
+    }
+    database->put(4, 45);
+    for (int key = 1; key < pairs_per_table; key += 2) {
+        database->put(key, key * 10);
+    }
+    // Memtable is flushed to L1, the next memtable has larger keys and is appended into L2
+    for (int key = pairs_per_table; key < 2 * pairs_per_table; key++) {
+        database->put(key, key * 10);
+    }
+    // Both runs keep a filter and a range filter
+    SSTFooter footer;
+    if (!SST::readFooter("./SSTs/database_step4_append/L2", footer) || footer.dataSize != 8 * PAGE_SIZE
+        || footer.numFences != 8 || footer.numFilters != 4 || footer.maxKey != 2 * pairs_per_table - 1) {
+        cerr << "Test Failed: SSTs with disjoint keys were not combined into L2" << endl;
+    }
+    for (int key = 0; key < 2 * pairs_per_table; key++) {
+        int expected = (key == 4) ? 45 : key * 10;
+        int value = database->get(key);
+        if (value != expected) {
+            cerr << "Test Failed: get after sequential append" << endl;
+            cerr << "Actual: " << value << " != Expected: " << expected << endl;
+            return;
+        }
+    }
+    vector<KV_Pair *> result = database->scan(pairs_per_table - 8, pairs_per_table + 7);
+    if (result.size() != 16 || result[0]->key != pairs_per_table - 8 || result[15]->key != pairs_per_table + 7) {
+        cerr << "Test Failed: scan across appended SSTs" << endl;
+    }
+}
+
+// Count the SST files in the directory of a database
+int countSSTFiles(string name) {
+    int count = 0;
+    DIR *dir = opendir(("./SSTs/" + name).c_str());
+    for (struct dirent *file = dir == NULL ? NULL : readdir(dir); file != NULL; file = readdir(dir)) {
+        count += file->d_name[0] == 'L';
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    return count;
+}
+
+// Test that SSTs are not combined when copying one of them fails, and both stay usable
+void test_failed_append(Database *database) {
+    SSTManager *manager = database->getsstManager();
+    string prefix = "./SSTs/" + database->name + "/";
+    const int pairs = 4 * PAIRS_PER_PAGE;
+    Memtable low(NULL), high(NULL);
+    for (int key = 0; key < pairs; key++) {
+        low.put(-2 * pairs + key, key);
+        low.increSize(KV_PAIR_SIZE);
+        high.put(-pairs + key, key);
+        high.increSize(KV_PAIR_SIZE);
+    }
+    SST *lowSST = manager->writeMemtable(&low, prefix)[0];
+    SST *highSST = manager->writeMemtable(&high, prefix)[0];
+    // The file of the SST with the larger keys cannot be read
+    string filepath = highSST->filepath;
+    highSST->filepath = prefix + "missing";
+    int files = countSSTFiles(database->name);
+    SST *concatenated = manager->concatSST(lowSST, highSST, 2, prefix, false);
+    highSST->filepath = filepath;
+    if (concatenated != NULL || countSSTFiles(database->name) != files) {
+        cerr << "Test Failed: SSTs were combined although an append failed" << endl;
+        return;
+    }
+    if (!lowSST->bloomFilterCheck(-2 * pairs) || !highSST->bloomFilterCheck(-1)) {
+        cerr << "Test Failed: a failed append took the filters of its inputs" << endl;
+    }
+    concatenated = manager->concatSST(lowSST, highSST, 2, prefix, false);
+    if (concatenated == NULL || concatenated->getNumPairs() != 2 * pairs || !concatenated->bloomFilterCheck(-1)) {
+        cerr << "Test Failed: SSTs were not combined after a failed append" << endl;
+    }
+    delete concatenated;
+    delete lowSST;
+    delete highSST;
+}
+
+// Test that tombstones of sequential keys are dropped when their SSTs reach the deepest level
+void test_sequential_tombstones() {
+    system("rm -f -r ./SSTs/database_step4_tombstones/*");
+    DatabaseOptions options;
+    options.optimize_filter_memory = false;
+    Database *database = new Database("database_step4_tombstones", 4 * PAGE_SIZE, options);
+    database->open("database_step4_tombstones");
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    for (int key = 0; key < 8 * pairs_per_table; key++) {
+        if (key % 4 == 0) {
+            database->delete_(key);
+        } else {
+            database->put(key, key);
+        }
+    }
+    SSTManager *manager = database->getsstManager();
+    int deepest = manager->max_level;
+    while (deepest > 1 && manager->getSSTs(deepest).empty()) {
+        deepest--;
+    }
+    for (SST *sst : manager->getSSTs(deepest)) {
+        if (sst->getNumTombstones() != 0) {
+            cerr << "Test Failed: L" << deepest << " kept " << sst->getNumTombstones() << " tombstones of sequential keys" << endl;
+        }
+    }
+    for (int key = 0; key < 8 * pairs_per_table; key++) {
+        int expected = key % 4 == 0 ? numeric_limits<int>::min() : key;
+        if (database->get(key) != expected) {
+            cerr << "Test Failed: get of sequential key " << key << " with tombstones" << endl;
+            break;
+        }
+    }
+    database->close();
+    delete database;
+}
+
+// Test that records larger than the size limit of the manifest are appended and not rewritten each time
+void test_manifest_large_records() {
+    system("mkdir -p ./SSTs/database_step4_manifest && rm -f ./SSTs/database_step4_manifest/*");
+    string prefix = "./SSTs/database_step4_manifest/";
+    vector<ManifestEntry> entries;
+    for (int i = 0; i < MANIFEST_MAX_SIZE / 16; i++) {
+        entries.push_back({1, i, "L1_" + to_string(i), PAGE_SIZE, i, i});
+    }
+    Manifest *manifest = new Manifest(prefix);
+    off_t sizes[8];
+    for (int i = 0; i < 8; i++) {
+        entries[0].minKey = i;
+        manifest->append(entries);
+        sizes[i] = ifstream(prefix + MANIFEST_FILE, ios::binary | ios::ate).tellg();
+    }
+    delete manifest;
+    if (sizes[1] != 2 * sizes[0] || sizes[3] != 4 * sizes[0] || sizes[4] != sizes[0]) {
+        cerr << "Test Failed: manifest of large records was rewritten after " << sizes[1] / sizes[0] << " records" << endl;
+    }
+    manifest = new Manifest(prefix);
+    vector<ManifestEntry> latest;
+    if (!manifest->readLatest(latest) || latest.size() != entries.size() || latest[0].minKey != 7) {
+        cerr << "Test Failed: newest large record was not read from the manifest" << endl;
+    }
+    delete manifest;
+    system("rm -f -r ./SSTs/database_step4_manifest");
+}
+
+// Test that a new Database object reloads the SSTs of a closed database from its manifest
+void test_recover_from_manifest() {
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    // A torn record at the end of the manifest, e.g. after a crash during a flush, is ignored
+    ofstream manifest("./SSTs/database_step4_append/MANIFEST", ios::app | ios::binary);
+    manifest << "torn";
+    manifest.close();
+    // Outputs of a merge and a move the manifest never recorded before a crash
+    ofstream("./SSTs/database_step4_append/L3_7") << "merged";
+    ofstream("./SSTs/database_step4_append/L2_5.tmp") << "moved";
+    DatabaseOptions options;
+    options.optimize_filter_memory = false;
+    Database *database = new Database("database_step4_append", 4 * PAGE_SIZE, options);
+    database->open("database_step4_append");
+    SST *sst = database->getsstManager()->getSST(2);
+    if (sst == NULL || sst->filesize != 8 * PAGE_SIZE || sst->getKeyArray().size() != 8) {
+        cerr << "Test Failed: L2 was not recovered from the manifest" << endl;
+        return;
+    }
+    if (access("./SSTs/database_step4_append/L3_7", F_OK) == 0 || access("./SSTs/database_step4_append/L2_5.tmp", F_OK) == 0) {
+        cerr << "Test Failed: files the manifest does not name were kept" << endl;
+    }
+    for (int key = 0; key < 2 * pairs_per_table; key++) {
+        int expected = (key == 4) ? 45 : key * 10;
+        int value = database->get(key);
+        if (value != expected) {
+            cerr << "Test Failed: get after recovery" << endl;
+            cerr << "Actual: " << value << " != Expected: " << expected << endl;
+            return;
+        }
+    }
+    // Flushes after recovery merge with the recovered levels
+    for (int key = 0; key < pairs_per_table; key++) {
+        database->put(key, key * 20);
+    }
+    database->put(2 * pairs_per_table, 0);
+    vector<KV_Pair> result;
+    database->scan(0, 2 * pairs_per_table, result);
+    if (int(result.size()) != 2 * pairs_per_table + 1 || result[1].val != 20
+        || result[pairs_per_table].val != pairs_per_table * 10) {
+        cerr << "Test Failed: scan after recovery" << endl;
+    }
+    database->close();
+}
+
+
+// Test SSTs with binary fuse filters through flush, merge and reopening the database
+void test_binary_fuse_filter(Database *database) {
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    // Three memtables of interleaved keys, the second one merges L1 into L2
+    for (int key = 0; key < 3 * pairs_per_table; key++) {
+        database->put(key * 7 % (3 * pairs_per_table) * 2, key);
+    }
+    database->close();
+    database->open("database_step4_fuse");
+    for (int level = 1; level <= 2; level++) {
+        SST *sst = database->getsstManager()->getSST(level);
+        if (sst == NULL) {
+            cerr << "Test Failed: no SST in L" << level << " with binary fuse filters" << endl;
+            return;
+        }
+        // Keys are even, odd keys are never in the SST
+        int false_positives = 0;
+        for (int key = 1; key < 6 * pairs_per_table; key += 2) {
+            false_positives += sst->bloomFilterCheck(key);
+        }
+        if (false_positives > 0.1 * 3 * pairs_per_table) {
+            cerr << "Test Failed: binary fuse filter of L" << level << " has " << false_positives << " false positives" << endl;
+        }
+    }
+    for (int key = 0; key < 3 * pairs_per_table; key++) {
+        int value = database->get(key * 7 % (3 * pairs_per_table) * 2);
+        if (value != key) {
+            cerr << "Test Failed: get with binary fuse filters" << endl;
+            cerr << "Actual: " << value << " != Expected: " << key << endl;
+            return;
+        }
+    }
+    // Reload the filters from the SST files
+    Database *reopened = new Database("database_step4_fuse", 4 * PAGE_SIZE);
+    reopened->open("database_step4_fuse");
+    for (int key = 0; key < 3 * pairs_per_table; key++) {
+        if (reopened->get(key * 7 % (3 * pairs_per_table) * 2) != key) {
+            cerr << "Test Failed: get with binary fuse filters after reopening" << endl;
+            return;
+        }
+    }
+    reopened->close();
+}
+
+// Test the blocked bloom filter with and without AVX2, its false positive rate and reloading it
+void test_bloom_filter() {
+    bool has_avx2 = BloomFilter::useAVX2;
+    const int num_keys = 20000;
+    mt19937 gen(13);
+    vector<int> keys(num_keys);
+    for (int &key : keys) {
+        key = gen();
+    }
+    set<int> added(keys.begin(), keys.end());
+    vector<int> absent;
+    while ((int) absent.size() < 10 * num_keys) {
+        int key = gen();
+        if (added.count(key) == 0) {
+            absent.push_back(key);
+        }
+    }
+    for (double bits : {3.0, 5.0, 10.0}) {
+        BloomFilter filter(num_keys, bits);
+        for (int key : keys) {
+            filter.add(key);
+        }
+        string serialized;
+        filter.serialize(serialized);
+        BloomFilter reloaded(0, bits);
+        if (!reloaded.deserialize(serialized.data(), serialized.size()) || reloaded.getMemoryUsage() != filter.getMemoryUsage()) {
+            cerr << "Test Failed: bloom filter of " << bits << " bits per key could not be reloaded" << endl;
+            return;
+        }
+        // Answers for the absent keys of the first path, the other path and the reloaded filter agree
+        vector<bool> answers;
+        for (bool avx2 : {false, has_avx2}) {
+            BloomFilter::useAVX2 = avx2;
+            for (int key : keys) {
+                if (!filter.mayContain(key) || !reloaded.mayContain(key)) {
+                    cerr << "Test Failed: bloom filter of " << bits << " bits per key rejects key " << key << " with AVX2 " << avx2 << endl;
+                    BloomFilter::useAVX2 = has_avx2;
+                    return;
+                }
+            }
+            for (size_t i = 0; i < absent.size(); i++) {
+                bool answer = filter.mayContain(absent[i]);
+                if (answers.size() < absent.size()) {
+                    answers.push_back(answer);
+                }
+                if (answer != answers[i] || reloaded.mayContain(absent[i]) != answer) {
+                    cerr << "Test Failed: bloom filter of " << bits << " bits per key answers differently for key " << absent[i]
+                         << " with AVX2 " << avx2 << endl;
+                    BloomFilter::useAVX2 = has_avx2;
+                    return;
+                }
+            }
+        }
+        BloomFilter::useAVX2 = has_avx2;
+        double observed = count(answers.begin(), answers.end(), true) / (double) absent.size();
+        double expected = filter.falsePositiveRate();
+        if (abs(observed - expected) > 0.2 * expected + 0.001) {
+            cerr << "Test Failed: bloom filter of " << bits << " bits per key has a false positive rate of " << observed
+                 << " instead of " << expected << endl;
+        }
+    }
+}
+
+// Test that a binary fuse filter never rejects a key it was built with, also for duplicate keys and
+// when no seed peels off every key
+void test_fuse_filter_build() {
+    const int num_keys = 10000;
+    BinaryFuseFilter filter(2 * num_keys, 8);
+    for (int i = 0; i < 2 * num_keys; i++) {
+        filter.add(i % num_keys * 3);
+    }
+    filter.build();
+    int false_positives = 0;
+    for (int i = 0; i < num_keys; i++) {
+        if (!filter.mayContain(i * 3)) {
+            cerr << "Test Failed: binary fuse filter of duplicate keys rejects key " << i * 3 << endl;
+            return;
+        }
+        false_positives += filter.mayContain(i * 3 + 1);
+    }
+    if (filter.falsePositiveRate() >= 1 || false_positives > 4 * filter.falsePositiveRate() * num_keys) {
+        cerr << "Test Failed: binary fuse filter of duplicate keys has " << false_positives << " false positives" << endl;
+    }
+    // Without a seed the filter keeps no fingerprints, every key passes also after reloading it
+    int max_attempts = BinaryFuseFilter::maxAttempts;
+    BinaryFuseFilter::maxAttempts = 0;
+    BinaryFuseFilter unpeeled(num_keys, 8);
+    for (int i = 0; i < num_keys; i++) {
+        unpeeled.add(i * 3);
+    }
+    unpeeled.build();
+    BinaryFuseFilter::maxAttempts = max_attempts;
+    string serialized;
+    unpeeled.serialize(serialized);
+    BinaryFuseFilter reloaded(0, 8);
+    if (!reloaded.deserialize(serialized.data(), serialized.size()) || unpeeled.falsePositiveRate() != 1) {
+        cerr << "Test Failed: binary fuse filter without fingerprints" << endl;
+        return;
+    }
+    for (int i = 0; i < num_keys; i++) {
+        if (!unpeeled.mayContain(i * 3) || !reloaded.mayContain(i * 3)) {
+            cerr << "Test Failed: binary fuse filter without fingerprints rejects key " << i * 3 << endl;
+            return;
+        }
+    }
+}
+
+// Test the filter memory allocation over the levels
+void test_filter_allocation() {
+    // A single level gets all the memory
+    vector<double> bits = SSTManager::allocateFilterBits(BLOOM_FILTER, BITS_PER_ENTRY, {1});
+    if (bits.size() != 1 || abs(bits[0] - BITS_PER_ENTRY) > 1e-6) {
+        cerr << "Test Failed: filter allocation for one level" << endl;
+        return;
+    }
+    for (FilterType type : {BLOOM_FILTER, BINARY_FUSE_FILTER}) {
+        vector<double> levelKeys = {1, 2, 4, 8, 16, 32};
+        bits = SSTManager::allocateFilterBits(type, BITS_PER_ENTRY, levelKeys);
+        // Same memory as BITS_PER_ENTRY on every level, fewer bits per key on larger levels
+        double memory = 0, totalKeys = 0, rates = 0;
+        for (size_t i = 0; i < levelKeys.size(); i++) {
+            memory += bits[i] * levelKeys[i];
+            totalKeys += levelKeys[i];
+            rates += Filter::falsePositiveRateFor(type, bits[i]);
+            if (i > 0 && bits[i] >= bits[i - 1]) {
+                cerr << "Test Failed: L" << i + 1 << " gets " << bits[i] << " bits/key, L" << i << " " << bits[i - 1] << endl;
+            }
+        }
+        if (abs(memory / totalKeys - BITS_PER_ENTRY) > 1e-3) {
+            cerr << "Test Failed: filter allocation uses " << memory / totalKeys << " bits/key" << endl;
+        }
+        double uniformRates = levelKeys.size() * Filter::falsePositiveRateFor(type, BITS_PER_ENTRY);
+        if (rates >= uniformRates) {
+            cerr << "Test Failed: allocated filters have false positive rates " << rates << " >= " << uniformRates << endl;
+        }
+    }
+}
+
+// Test that SSTs of sequential keys get the filter bits per key of their level like merged ones
+void test_sequential_filter_allocation() {
+    Database *database = new Database("database_step4_sequential", 4 * PAGE_SIZE);
+    database->open("database_step4_sequential");
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    for (int key = 0; key < 63 * pairs_per_table; key++) {
+        database->put(key, key);
+    }
+    double memory = 0, numPairs = 0;
+    for (LevelFilterStats &stats : database->getsstManager()->getFilterStats()) {
+        if (abs(stats.bitsPerKey - stats.allocatedBitsPerKey) > 0.5) {
+            cerr << "Test Failed: sequential keys in L" << stats.level << " have " << stats.bitsPerKey
+                 << " bits/key, allocated " << stats.allocatedBitsPerKey << endl;
+        }
+        memory += stats.bitsPerKey * stats.numPairs;
+        numPairs += stats.numPairs;
+    }
+    if (numPairs == 0 || memory / numPairs > BITS_PER_ENTRY * 1.1) {
+        cerr << "Test Failed: filters of sequential keys use " << memory / max(numPairs, 1.0) << " bits/key" << endl;
+    }
+    database->close();
+    delete database;
+}
+
+// Test range filters on sparse keys, short scans between keys skip the levels
+void test_range_filter(Database *database) {
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    // Keys are 64 apart in random order, so three of every four buckets of 16 keys are empty
+    vector<int> keys;
+    for (int i = 0; i < 3 * pairs_per_table; i++) {
+        keys.push_back(i * 64);
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(7));
+    for (int key : keys) {
+        database->put(key, key + 1);
+    }
+    // Reopen so the range filters are read from the SST files
+    database->close();
+    database->open(database->name);
+    for (int level = 1; level <= database->getsstManager()->max_level; level++) {
+        SST *sst = database->getsstManager()->getSST(level);
+        if (sst == NULL) {
+            continue;
+        }
+        int skipped = 0, ranges = 0;
+        for (int i = 0; i < 3 * pairs_per_table; i++) {
+            if (!sst->rangeFilterCheck(i * 64 + 16, i * 64 + 47)) {
+                skipped++;
+            }
+            ranges++;
+        }
+        if (skipped < 0.7 * ranges) {
+            cerr << "Test Failed: range filter of L" << level << " skipped " << skipped << " of " << ranges << " empty ranges" << endl;
+        }
+        if (sst->rangeFilterCheck(sst->getLastKey() + 1, sst->getLastKey() + 16)) {
+            cerr << "Test Failed: range after the last key of L" << level << " passed the range filter" << endl;
+        }
+    }
+    // Short scans return the keys in their range, whether levels were skipped or not
+    mt19937 gen(11);
+    for (int i = 0; i < 1000; i++) {
+        int lowerbound = gen() % (3 * pairs_per_table * 64);
+        int upperbound = lowerbound + gen() % 16;
+        vector<KV_Pair *> result = database->scan(lowerbound, upperbound);
+        int expected = (upperbound / 64) - ((lowerbound + 63) / 64) + 1;
+        if ((int) result.size() != expected || (expected == 1 && result[0]->val != result[0]->key + 1)) {
+            cerr << "Test Failed: scan of [" << lowerbound << ", " << upperbound << "] with range filters returned "
+                 << result.size() << " pairs instead of " << expected << endl;
+            return;
+        }
+    }
+}
+
+// Test the fence index against a search of the sorted fence keys, with and without AVX2
+void test_fence_index() {
+    bool has_avx2 = FenceIndex::useAVX2;
+    mt19937 gen(3);
+    for (int size : {1, 15, 16, 17, 256, 257, 5000}) {
+        // Increasing fences that include the smallest and largest key
+        vector<int> fences;
+        int key = numeric_limits<int>::min();
+        for (int i = 0; i < size; i++) {
+            fences.push_back(key);
+            key += 1 + gen() % 1000;
+        }
+        fences.back() = numeric_limits<int>::max();
+        FenceIndex index;
+        index.build(fences);
+        vector<int> queries = {numeric_limits<int>::min(), numeric_limits<int>::max(), 0};
+        for (int fence : fences) {
+            queries.push_back(fence);
+            queries.push_back(fence + 1);
+            queries.push_back(fence - 1);
+        }
+        for (bool avx2 : {false, has_avx2}) {
+            FenceIndex::useAVX2 = avx2;
+            for (int query : queries) {
+                int expected = upper_bound(fences.begin(), fences.end(), query) - fences.begin() - 1;
+                if (index.search(query) != expected) {
+                    cerr << "Test Failed: fence index of " << size << " fences found " << index.search(query)
+                         << " for " << query << " instead of " << expected << endl;
+                    FenceIndex::useAVX2 = has_avx2;
+                    return;
+                }
+            }
+        }
+    }
+    FenceIndex::useAVX2 = has_avx2;
+}
+
+// Test the learned index against a search of the sorted fence keys
+void test_learned_index() {
+    mt19937 gen(5);
+    vector<pair<string, function<int(int)>>> gaps = {
+        {"dense", [](int i) { return 512; }},
+        {"uniform", [&](int i) { return 1 + int(gen() % 1000); }},
+        {"skewed", [&](int i) { return i % 100 == 0 ? 1000000 : 1 + int(gen() % 4); }}};
+    for (auto &gap : gaps) {
+        for (int size : {1, 2, 17, 5000}) {
+            vector<int> fences;
+            int key = -1000000;
+            for (int i = 0; i < size; i++) {
+                fences.push_back(key);
+                key += gap.second(i);
+            }
+            LearnedIndex index;
+            index.build(fences);
+            // Evenly spaced fences fit one exact segment
+            if (gap.first == "dense" && index.getNumSegments() != 1) {
+                cerr << "Test Failed: learned index has " << index.getNumSegments() << " segments for dense fences" << endl;
+            }
+            vector<int> queries = {numeric_limits<int>::min(), numeric_limits<int>::max()};
+            for (int fence : fences) {
+                queries.push_back(fence);
+                queries.push_back(fence + 1);
+                queries.push_back(fence - 1);
+            }
+            for (int query : queries) {
+                int expected = upper_bound(fences.begin(), fences.end(), query) - fences.begin() - 1;
+                if (index.search(query) != expected) {
+                    cerr << "Test Failed: learned index of " << size << " " << gap.first << " fences found "
+                         << index.search(query) << " for " << query << " instead of " << expected << endl;
+                    return;
+                }
+            }
+        }
+    }
+}
+
+// Test get and scan on SSTs that find pages with the learned index
+void test_learned_index_database(Database *database) {
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    vector<int> keys;
+    for (int i = 0; i < 3 * pairs_per_table; i++) {
+        keys.push_back(i * 3);
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(9));
+    for (int key : keys) {
+        database->put(key, key + 1);
+    }
+    // Reopen so the learned index is built from the fence keys in the SST files
+    database->close();
+    database->open(database->name);
+    for (int i = 0; i < 3 * pairs_per_table; i++) {
+        if (database->get(i * 3) != i * 3 + 1 || database->get(i * 3 + 1) != numeric_limits<int>::min()) {
+            cerr << "Test Failed: get with the learned index for key " << i * 3 << endl;
+            return;
+        }
+    }
+    vector<KV_Pair *> result = database->scan(1000, 2000);
+    if (result.size() != 333 || result[0]->key != 1002 || result.back()->key != 1998) {
+        cerr << "Test Failed: scan with the learned index returned " << result.size() << " pairs" << endl;
+    }
+}
+
+// Test the page search against a search of the sorted keys, for pages in either layout and
+// with and without AVX2
+void test_page_search() {
+    bool has_avx2 = PageSearch::useAVX2;
+    mt19937 gen(13);
+    for (int num_pairs : {0, 1, 15, 16, 17, 100, 512}) {
+        vector<int> keys;
+        int key = numeric_limits<int>::min();
+        for (int i = 0; i < num_pairs; i++) {
+            keys.push_back(key);
+            key += 2 + gen() % 100;
+        }
+        vector<int> queries = {numeric_limits<int>::min(), numeric_limits<int>::max()};
+        for (int k : keys) {
+            queries.push_back(k);
+            queries.push_back(k + 1);
+        }
+        for (PageFormat format : {ROW_PAGE, PAX_PAGE}) {
+            vector<char> data(PAGE_SIZE);
+            for (int i = 0; i < num_pairs; i++) {
+                Page::put(data.data(), i, keys[i], i, format);
+            }
+            Page::finish(data.data(), num_pairs, format);
+            Page page(data.data(), num_pairs, format);
+            for (bool avx2 : {false, has_avx2}) {
+                PageSearch::useAVX2 = avx2;
+                for (int query : queries) {
+                    int expected = lower_bound(keys.begin(), keys.end(), query) - keys.begin();
+                    int value = -1;
+                    bool found = page.find(query, value);
+                    if (page.lowerBound(query) != expected || found != (expected < num_pairs && keys[expected] == query)
+                        || (found && value != expected) || (expected < num_pairs && page.val(expected) != expected)) {
+                        cerr << "Test Failed: search of a page in format " << format << " with " << num_pairs
+                             << " pairs for " << query << endl;
+                        PageSearch::useAVX2 = has_avx2;
+                        return;
+                    }
+                }
+            }
+        }
+    }
+    PageSearch::useAVX2 = has_avx2;
+}
+
+// Test a database whose SSTs have row pages, then reopened with PAX pages so the levels mix both
+// layouts until merges rewrite them
+void test_page_format(Database *database) {
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    vector<int> keys;
+    for (int i = 0; i < 3 * pairs_per_table + 100; i++) {
+        keys.push_back(i * 2);
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(21));
+    for (size_t i = 0; i < keys.size() / 2; i++) {
+        database->put(keys[i], keys[i] + 1);
+    }
+    database->close();
+    database->open(database->name);
+    SSTFooter footer;
+    if (!SST::readFooter("./SSTs/database_step4_row/L2", footer) || footer.pageFormat != ROW_PAGE) {
+        cerr << "Test Failed: SST was not written with row pages" << endl;
+    }
+    delete database;
+    // New SSTs are written with PAX pages, the loaded ones keep their layout
+    database = new Database("database_step4_row", 4 * PAGE_SIZE);
+    database->open("database_step4_row");
+    for (size_t i = keys.size() / 2; i < keys.size(); i++) {
+        database->put(keys[i], keys[i] + 1);
+    }
+    for (size_t i = 0; i < keys.size(); i += 7) {
+        int key = keys[i];
+        if (database->get(key) != key + 1 || database->get(key + 1) != numeric_limits<int>::min()) {
+            cerr << "Test Failed: get of key " << key << " from pages in both layouts" << endl;
+            return;
+        }
+    }
+    vector<KV_Pair *> result = database->scan(1001, 5001);
+    if (result.size() != 2000 || result[0]->key != 1002 || result.back()->key != 5000 || result.back()->val != 5001) {
+        cerr << "Test Failed: scan of pages in both layouts returned " << result.size() << " pairs" << endl;
+    }
+    database->close();
+    delete database;
+}
+
+// Test that packed pages unpack to the pairs they were packed from, with and without AVX2, for
+// dense and sparse keys, keys at the ends of the int range and tombstone values
+void test_packed_page() {
+    bool has_avx2 = Page::useAVX2;
+    mt19937 gen(17);
+    vector<function<int(int)>> gaps = {
+        [](int) { return 1; },
+        [](int) { return 3; },
+        [&](int) { return 1 + gen() % 5; },
+        [&](int) { return 1 + gen() % 100000; },
+        [&](int) { return 1 + gen() % 8000000; }};
+    for (size_t g = 0; g < gaps.size(); g++) {
+        for (int num_pairs : {1, 7, 8, 9, 100, 512}) {
+            vector<int> keys, vals;
+            // The largest gaps start at the smallest key so the keys span the whole int range
+            long long key = g == gaps.size() - 1 ? numeric_limits<int>::min() : gen() % 1000000;
+            for (int i = 0; i < num_pairs; i++) {
+                keys.push_back(int(key));
+                vals.push_back(i % 5 == 0 ? numeric_limits<int>::min() : int(key * 10));
+                key = min(key + gaps[g](i), (long long) numeric_limits<int>::max());
+            }
+            vector<char> data(PAGE_SIZE);
+            for (int i = 0; i < num_pairs; i++) {
+                Page::put(data.data(), i, keys[i], vals[i], PAX_PAGE);
+            }
+            Page::finish(data.data(), num_pairs, PAX_PAGE);
+            vector<char> packed(PACKED_PAGE_MAX_SIZE + PACKED_PAGE_PADDING);
+            int size = Page::pack(Page(data.data(), num_pairs, PAX_PAGE), packed.data());
+            for (bool avx2 : {false, has_avx2}) {
+                Page::useAVX2 = avx2;
+                vector<char> unpacked(PAGE_SIZE);
+                if (size > PACKED_PAGE_MAX_SIZE || Page::unpack(packed.data(), size, unpacked.data()) != num_pairs
+                    || Page::unpack(packed.data(), size - 1, unpacked.data()) != -1) {
+                    cerr << "Test Failed: packed page of " << num_pairs << " pairs with gaps " << g << endl;
+                    Page::useAVX2 = has_avx2;
+                    return;
+                }
+                Page page(unpacked.data(), num_pairs, PAX_PAGE);
+                for (int i = 0; i < num_pairs; i++) {
+                    if (page.key(i) != keys[i] || page.val(i) != vals[i]) {
+                        cerr << "Test Failed: packed page with gaps " << g << " unpacked pair " << i << " as ("
+                             << page.key(i) << "," << page.val(i) << ")" << endl;
+                        Page::useAVX2 = has_avx2;
+                        return;
+                    }
+                }
+            }
+        }
+    }
+    Page::useAVX2 = has_avx2;
+}
+
+// Test a database with packed pages, dense keys take a fraction of the bytes of unpacked pages
+void test_packed_pages(Database *database) {
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    const int num_keys = 7 * pairs_per_table + 100;
+    vector<int> keys;
+    for (int i = 0; i < num_keys; i++) {
+        keys.push_back(i * 2);
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(23));
+    for (int key : keys) {
+        database->put(key, key + 1);
+    }
+    for (int i = 0; i < num_keys; i += 100) {
+        database->delete_(i * 2);
+    }
+    // Reopen so the page offsets are read back from the SST files
+    database->close();
+    database->open(database->name);
+    int data_size = 0, num_pairs = 0;
+    for (int level = 1; level <= database->getsstManager()->max_level; level++) {
+        SST *sst = database->getsstManager()->getSST(level);
+        if (sst != NULL) {
+            data_size += sst->filesize;
+            num_pairs += sst->getNumPairs();
+        }
+    }
+    if (num_pairs == 0 || data_size * 2 > num_pairs * KV_PAIR_SIZE) {
+        cerr << "Test Failed: packed pages take " << data_size << " bytes for " << num_pairs << " pairs" << endl;
+    }
+    for (int i = 0; i < num_keys; i++) {
+        int expected = i % 100 == 0 ? numeric_limits<int>::min() : i * 2 + 1;
+        if (database->get(i * 2) != expected || database->get(i * 2 + 1) != numeric_limits<int>::min()) {
+            cerr << "Test Failed: get of key " << i * 2 << " from packed pages" << endl;
+            return;
+        }
+    }
+    // 20 of the keys from 1002 to 5002 are deleted
+    vector<KV_Pair *> result = database->scan(1001, 5003);
+    if (result.size() != 1981 || result[0]->key != 1002 || result.back()->key != 5002 || result.back()->val != 5003) {
+        cerr << "Test Failed: scan of packed pages returned " << result.size() << " pairs" << endl;
+    }
+}
+
+// Test that the LZ codec restores what it compressed, for data without matches, long runs that
+// overlap their own output and lengths that take extra bytes, and that it rejects cut off blocks
+void test_lz_codec() {
+    mt19937 gen(19);
+    vector<string> inputs = {"", "a", "abcd", string(10000, 'x'), "abcabcabcabcabcabcabcabcabcabcabcabc"};
+    string random_bytes, ints, text;
+    for (int i = 0; i < 5000; i++) {
+        random_bytes.push_back(char(gen()));
+    }
+    for (int i = 0; i < 1024; i++) {
+        int value = i % 7 == 0 ? numeric_limits<int>::min() : int(gen() % 16);
+        ints.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    for (int i = 0; i < 300; i++) {
+        text += "key " + to_string(gen() % 50) + " value " + random_bytes.substr(gen() % 4000, gen() % 300) + "\n";
+    }
+    inputs.push_back(random_bytes);
+    inputs.push_back(ints);
+    inputs.push_back(text);
+    for (string &input : inputs) {
+        vector<char> compressed(LZCodec::maxCompressedSize(input.size()));
+        int size = LZCodec::compress(input.data(), input.size(), compressed.data());
+        vector<char> output(input.size() + 1);
+        int restored = LZCodec::decompress(compressed.data(), size, output.data(), input.size());
+        if (size > LZCodec::maxCompressedSize(input.size()) || restored != (int) input.size()
+            || string(output.data(), restored) != input) {
+            cerr << "Test Failed: LZ codec did not restore " << input.size() << " bytes" << endl;
+            return;
+        }
+        if (size > 1 && LZCodec::decompress(compressed.data(), size - 1, output.data(), input.size()) != -1) {
+            cerr << "Test Failed: LZ codec decompressed a cut off block of " << input.size() << " bytes" << endl;
+            return;
+        }
+    }
+    vector<char> compressed(LZCodec::maxCompressedSize(inputs[3].size()));
+    if (LZCodec::compress(inputs[3].data(), inputs[3].size(), compressed.data()) > 100) {
+        cerr << "Test Failed: LZ codec did not compress a run of 10000 bytes" << endl;
+    }
+}
+
+// Test a database that compresses the pages of L2 and deeper levels, with PAX and packed pages
+void test_compressed_pages(PageFormat format) {
+    system("rm -f -r ./SSTs/database_step4_compressed/*");
+    DatabaseOptions options;
+    options.page_format = format;
+    options.compression = LZ_COMPRESSION;
+    options.compression_min_level = 2;
+    Database *database = new Database("database_step4_compressed", 4 * PAGE_SIZE, options);
+    database->open("database_step4_compressed");
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    // 6 full memtables and the one close flushes fill L1 to L3
+    const int num_keys = 7 * pairs_per_table - 100;
+    vector<int> keys;
+    for (int i = 0; i < num_keys; i++) {
+        keys.push_back(i * 2);
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(29));
+    // Few distinct values compress well
+    for (int key : keys) {
+        database->put(key, key % 10);
+    }
+    database->close();
+    database->open(database->name);
+    SSTFooter footer;
+    if (!SST::readFooter("./SSTs/database_step4_compressed/L1", footer) || footer.compression != NO_COMPRESSION
+        || !SST::readFooter("./SSTs/database_step4_compressed/L3", footer) || footer.compression != LZ_COMPRESSION
+        || footer.dataSize >= footer.numPairs * KV_PAIR_SIZE) {
+        cerr << "Test Failed: pages of format " << format << " were not compressed from L2 on" << endl;
+    }
+    for (int i = 0; i < num_keys; i++) {
+        if (database->get(i * 2) != (i * 2) % 10 || database->get(i * 2 + 1) != numeric_limits<int>::min()) {
+            cerr << "Test Failed: get of key " << i * 2 << " from compressed pages of format " << format << endl;
+            return;
+        }
+    }
+    vector<KV_Pair *> result = database->scan(1001, 5001);
+    if (result.size() != 2000 || result[0]->key != 1002 || result.back()->key != 5000 || result.back()->val != 0) {
+        cerr << "Test Failed: scan of compressed pages of format " << format << " returned " << result.size() << " pairs" << endl;
+    }
+    // Sequential keys reach the levels by appending SSTs, which get the compression of the level too
+    for (int key = 2 * num_keys; key < 2 * num_keys + 8 * pairs_per_table; key++) {
+        database->put(key, key % 10);
+    }
+    SSTManager *manager = database->getsstManager();
+    for (int level = 1; level <= manager->max_level; level++) {
+        for (SST *sst : manager->getSSTs(level)) {
+            if (sst->compression != (level >= 2 ? LZ_COMPRESSION : NO_COMPRESSION)) {
+                cerr << "Test Failed: appended SST of format " << format << " in L" << level << " has compression " << sst->compression << endl;
+            }
+        }
+    }
+    database->close();
+    delete database;
+}
+
+// Test a compaction policy with a size ratio of 4 on 22 memtables of puts, updates and deletes,
+// return the bytes the merges wrote
+long long test_compaction_policy(CompactionPolicy policy, int sst_file_size) {
+    system("rm -f -r ./SSTs/database_step4_policy/*");
+    const int size_ratio = 4;
+    DatabaseOptions options;
+    options.compaction_policy = policy;
+    options.size_ratio = size_ratio;
+    options.sst_file_size = sst_file_size;
+    Database *database = new Database("database_step4_policy", 4 * PAGE_SIZE, options);
+    database->open("database_step4_policy");
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    // 16 memtables of new keys, then 6 of updates and deletes of some of them
+    const int num_keys = 16 * pairs_per_table;
+    map<int, int> expected;
+    vector<int> keys(num_keys);
+    iota(keys.begin(), keys.end(), 0);
+    shuffle(keys.begin(), keys.end(), mt19937(31));
+    for (int key : keys) {
+        database->put(key, key);
+        expected[key] = key;
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(37));
+    for (int i = 0; i < 6 * pairs_per_table; i++) {
+        int val = i % 3 == 0 ? numeric_limits<int>::min() : -keys[i];
+        database->put(keys[i], val);
+        expected[keys[i]] = val;
+    }
+    // Tiered levels hold up to T - 1 runs, leveled ones a single run within their capacity
+    SSTManager *manager = database->getsstManager();
+    for (int level = 1; level <= manager->max_level; level++) {
+        const vector<Run> &runs = manager->getRuns(level);
+        bool leveled = policy == LEVELING || (policy == LAZY_LEVELING && level == manager->max_level);
+        long long capacity = (size_ratio - 1) * pairs_per_table * (long long) pow(size_ratio, level - 1);
+        if ((int) runs.size() > (leveled ? 1 : size_ratio - 1) || (leveled && !runs.empty() && SSTManager::getNumPairs(runs[0]) > capacity)) {
+            cerr << "Test Failed: policy " << policy << " left " << runs.size() << " runs in L" << level << endl;
+        }
+        // SSTs of a run have disjoint key ranges in key order and hold at most sst_file_size bytes of pairs
+        for (const Run &run : runs) {
+            for (size_t i = 0; i < run.size(); i++) {
+                if ((i > 0 && run[i - 1]->getLastKey() >= run[i]->getFirstKey())
+                    || (sst_file_size > 0 && run[i]->getNumPairs() * KV_PAIR_SIZE > sst_file_size)) {
+                    cerr << "Test Failed: SST " << run[i]->filepath << " of a run of L" << level << " with policy " << policy << endl;
+                }
+            }
+            if (sst_file_size == 0 && run.size() != 1) {
+                cerr << "Test Failed: run of L" << level << " was split into " << run.size() << " SSTs" << endl;
+            }
+        }
+    }
+    // The deepest level of lazy leveling moves part of its run on once split, L1 only counts in base 4
+    // while all merges take whole levels
+    if (policy != LEVELING && sst_file_size == 0 && manager->getRuns(1).size() != 2) {
+        cerr << "Test Failed: policy " << policy << " left " << manager->getRuns(1).size() << " runs in L1 instead of 2" << endl;
+    }
+    long long compacted = manager->compacted_bytes;
+    // The newest pair of every key wins, from whichever run it is in
+    for (int round = 0; round < 2; round++) {
+        for (auto &pair : expected) {
+            if (database->get(pair.first) != pair.second) {
+                cerr << "Test Failed: get of key " << pair.first << " with policy " << policy << endl;
+                break;
+            }
+        }
+        vector<KV_Pair> result;
+        database->scan(1000, 9000, result);
+        size_t live = 0;
+        for (int key = 1000; key <= 9000; key++) {
+            live += expected[key] != numeric_limits<int>::min();
+        }
+        if (result.size() != live || result[0].val != expected[result[0].key]) {
+            cerr << "Test Failed: scan with policy " << policy << " returned " << result.size() << " of " << live << " pairs" << endl;
+        }
+        // Runs of every level are recovered from the manifest in their order
+        database->close();
+        delete database;
+        database = new Database("database_step4_policy", 4 * PAGE_SIZE, options);
+        database->open("database_step4_policy");
+    }
+    database->close();
+    delete database;
+    return compacted;
+}
+
+// Test the compaction policies with runs in one SST and split into SSTs of 2 pages, more runs per
+// level write less
+void test_compaction_policies() {
+    for (int sst_file_size : {0, 2 * PAGE_SIZE}) {
+        long long leveling = test_compaction_policy(LEVELING, sst_file_size);
+        long long tiering = test_compaction_policy(TIERING, sst_file_size);
+        long long lazy_leveling = test_compaction_policy(LAZY_LEVELING, sst_file_size);
+        if (tiering >= lazy_leveling || lazy_leveling >= leveling) {
+            cerr << "Test Failed: merges wrote " << leveling << " bytes with leveling, " << lazy_leveling
+                 << " with lazy leveling and " << tiering << " with tiering" << endl;
+        }
+    }
+}
+
+// Test that split leveled levels only rewrite the SSTs a merge overlaps
+void test_partial_compaction() {
+    system("rm -f -r ./SSTs/database_step4_split/*");
+    DatabaseOptions options;
+    options.size_ratio = 4;
+    options.sst_file_size = 2 * PAGE_SIZE;
+    Database *database = new Database("database_step4_split", 4 * PAGE_SIZE, options);
+    database->open("database_step4_split");
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    // Runs of increasing keys never overlap, every SST moves down without being rewritten
+    const int num_keys = 24 * pairs_per_table;
+    for (int key = 0; key < num_keys; key++) {
+        database->put(key, key);
+    }
+    SSTManager *manager = database->getsstManager();
+    if (manager->compacted_bytes != 0 || manager->max_level < 3) {
+        cerr << "Test Failed: increasing keys compacted " << manager->compacted_bytes << " bytes into "
+             << manager->max_level << " levels" << endl;
+    }
+    // Memtables of updates to a narrow range rewrite the few SSTs of that range on their way down,
+    // the SSTs of other keys stay as they are
+    vector<SST *> outside;
+    for (int level = 1; level <= manager->max_level; level++) {
+        for (SST *sst : manager->getSSTs(level)) {
+            if (sst->getLastKey() < 5000 || sst->getFirstKey() >= 8000) {
+                outside.push_back(sst);
+            }
+        }
+    }
+    for (int i = 0; i < 8 * pairs_per_table; i++) {
+        int key = 5000 + i % 3000;
+        database->put(key, -key);
+    }
+    set<SST *> remaining;
+    for (int level = 1; level <= manager->max_level; level++) {
+        for (SST *sst : manager->getSSTs(level)) {
+            remaining.insert(sst);
+        }
+    }
+    for (SST *sst : outside) {
+        if (remaining.count(sst) == 0) {
+            cerr << "Test Failed: updates to keys 5000 to 7999 rewrote an SST of keys " << sst->getFirstKey()
+                 << " to " << sst->getLastKey() << endl;
+            break;
+        }
+    }
+    if (manager->compacted_bytes == 0) {
+        cerr << "Test Failed: updates to keys 5000 to 7999 were never merged" << endl;
+    }
+    for (int round = 0; round < 2; round++) {
+        for (int key = 0; key < num_keys; key++) {
+            int val = key >= 5000 && key < 8000 ? -key : key;
+            if (database->get(key) != val) {
+                cerr << "Test Failed: get of key " << key << " from split levels" << endl;
+                break;
+            }
+        }
+        vector<KV_Pair> result;
+        database->scan(4000, 20000, result);
+        if (result.size() != 16001 || result[1000].val != -5000 || result[4000].val != 8000) {
+            cerr << "Test Failed: scan of split levels returned " << result.size() << " pairs" << endl;
+        }
+        database->close();
+        delete database;
+        database = new Database("database_step4_split", 4 * PAGE_SIZE, options);
+        database->open("database_step4_split");
+    }
+    database->close();
+    delete database;
+}
+
+// Test that a memtable that fills L1 and L2 is merged with both of them in one pass into L3
+void test_multi_level_merge() {
+    system("rm -f -r ./SSTs/database_step4_cascade/*");
+    Database *database = new Database("database_step4_cascade", 4 * PAGE_SIZE);
+    database->open("database_step4_cascade");
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    vector<int> keys(4 * pairs_per_table);
+    iota(keys.begin(), keys.end(), 0);
+    shuffle(keys.begin(), keys.end(), mt19937(47));
+    // Two memtables move to L2, the third one has new keys and deletes half as many keys of L2
+    for (int i = 0; i < 2 * pairs_per_table; i++) {
+        database->put(keys[i], keys[i]);
+    }
+    for (int i = 0; i < pairs_per_table / 2; i++) {
+        database->put(keys[2 * pairs_per_table + i], keys[2 * pairs_per_table + i]);
+        database->delete_(keys[i]);
+    }
+    SSTManager *manager = database->getsstManager();
+    long long compacted = manager->compacted_bytes;
+    for (int i = 2 * pairs_per_table + pairs_per_table / 2; i < 3 * pairs_per_table + pairs_per_table / 2; i++) {
+        database->put(keys[i], keys[i]);
+    }
+    // Only L3 is written, without the deleted keys and their tombstones
+    long long live = 3 * pairs_per_table;
+    if (manager->compacted_bytes - compacted != live * KV_PAIR_SIZE || !manager->getRuns(1).empty() || !manager->getRuns(2).empty()
+        || manager->getRuns(3).size() != 1 || SSTManager::getNumPairs(manager->getRuns(3)[0]) != live) {
+        cerr << "Test Failed: merging L1 and L2 into L3 wrote " << manager->compacted_bytes - compacted << " bytes instead of "
+             << live * KV_PAIR_SIZE << endl;
+    }
+    for (int i = 0; i < 3 * pairs_per_table + pairs_per_table / 2; i++) {
+        int expected = i < pairs_per_table / 2 ? numeric_limits<int>::min() : keys[i];
+        if (database->get(keys[i]) != expected) {
+            cerr << "Test Failed: get of key " << keys[i] << " after merging L1 and L2 into L3" << endl;
+            break;
+        }
+    }
+    database->close();
+    delete database;
+}
+
+// Test merges split into subcompactions over key ranges, the merged runs keep their SSTs in key order
+void test_subcompactions(int sst_file_size) {
+    system("rm -f -r ./SSTs/database_step4_subcompaction/*");
+    DatabaseOptions options;
+    options.sst_file_size = sst_file_size;
+    options.max_subcompactions = 4;
+    const int pairs_per_table = SUBCOMPACTION_MIN_PAIRS;
+    Database *database = new Database("database_step4_subcompaction", pairs_per_table * KV_PAIR_SIZE, options);
+    database->open("database_step4_subcompaction");
+    // 4 memtables of new keys, then one of updates and deletes of some of them
+    const int num_keys = 4 * pairs_per_table;
+    vector<int> expected(num_keys);
+    vector<int> keys(num_keys);
+    iota(keys.begin(), keys.end(), 0);
+    iota(expected.begin(), expected.end(), 0);
+    shuffle(keys.begin(), keys.end(), mt19937(53));
+    for (int key : keys) {
+        database->put(key, key);
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(59));
+    for (int i = 0; i < pairs_per_table; i++) {
+        expected[keys[i]] = i % 3 == 0 ? numeric_limits<int>::min() : -keys[i];
+        database->put(keys[i], expected[keys[i]]);
+    }
+    SSTManager *manager = database->getsstManager();
+    size_t most_ssts = 0;
+    for (int level = 1; level <= manager->max_level; level++) {
+        for (const Run &run : manager->getRuns(level)) {
+            most_ssts = max(most_ssts, run.size());
+            for (size_t i = 0; i < run.size(); i++) {
+                if (run[i]->getNumPairs() == 0 || (i > 0 && run[i - 1]->getLastKey() >= run[i]->getFirstKey())
+                    || (sst_file_size > 0 && run[i]->getNumPairs() * KV_PAIR_SIZE > sst_file_size)) {
+                    cerr << "Test Failed: subcompactions left SST " << i << " of a run of L" << level << " out of order" << endl;
+                }
+            }
+        }
+    }
+    // Without sst_file_size a run has one SST per subcompaction
+    if (sst_file_size == 0 && most_ssts < 2) {
+        cerr << "Test Failed: merges of " << num_keys << " pairs were not split into subcompactions" << endl;
+    }
+    for (int round = 0; round < 2; round++) {
+        for (int key = 0; key < num_keys; key++) {
+            if (database->get(key) != expected[key]) {
+                cerr << "Test Failed: get of key " << key << " after subcompactions" << endl;
+                break;
+            }
+        }
+        vector<KV_Pair> result;
+        database->scan(0, num_keys - 1, result);
+        size_t live = 0;
+        bool ordered = true;
+        for (int key = 0; key < num_keys; key++) {
+            if (expected[key] != numeric_limits<int>::min()) {
+                ordered = ordered && live < result.size() && result[live].key == key && result[live].val == expected[key];
+                live++;
+            }
+        }
+        if (!ordered || result.size() != live) {
+            cerr << "Test Failed: scan after subcompactions returned " << result.size() << " of " << live << " pairs" << endl;
+        }
+        database->close();
+        delete database;
+        database = new Database("database_step4_subcompaction", pairs_per_table * KV_PAIR_SIZE, options);
+        database->open("database_step4_subcompaction");
+    }
+    database->close();
+    delete database;
+}
+
+// Test merges on compaction threads while a reader checks keys that never change and the levels
+// are replaced under it
+// Test that the scheduler keeps the stats of only the recent jobs but counts every job in the totals
+void test_compaction_history() {
+    system("rm -f -r ./SSTs/database_step4_history/*");
+    DatabaseOptions options;
+    options.max_immutable_tables = 2;
+    options.compaction_threads = 1;
+    Database *database = new Database("database_step4_history", PAGE_SIZE, options);
+    database->open("database_step4_history");
+    // Updates of a few pages of keys, every flush is merged before the next one so it is one more job
+    const int pairs_per_table = PAGE_SIZE / KV_PAIR_SIZE;
+    CompactionScheduler *scheduler = database->getCompactionScheduler();
+    for (int i = 0; i < COMPACTION_STATS_HISTORY + 64; i++) {
+        for (int j = 0; j < pairs_per_table; j++) {
+            database->put(j + (i % 4) * pairs_per_table, i);
+        }
+        database->waitForFlushes();
+        scheduler->waitForIdle();
+    }
+    vector<CompactionStats> stats = scheduler->getJobStats();
+    CompactionTotals totals = scheduler->getJobTotals();
+    long long written = 0;
+    for (CompactionStats &job : stats) {
+        written += job.outputBytes;
+    }
+    if (totals.jobs <= COMPACTION_STATS_HISTORY || stats.size() != COMPACTION_STATS_HISTORY || written >= totals.outputBytes
+        || totals.outputBytes != database->getsstManager()->compacted_bytes) {
+        cerr << "Test Failed: " << stats.size() << " stats kept of " << totals.jobs << " background merges" << endl;
+    }
+    database->close();
+    delete database;
+    system("rm -f -r ./SSTs/database_step4_history");
+}
+
+void test_background_compaction(CompactionPolicy policy, int sst_file_size) {
+    system("rm -f -r ./SSTs/database_step4_compaction/*");
+    DatabaseOptions options;
+    options.compaction_policy = policy;
+    options.size_ratio = 4;
+    options.sst_file_size = sst_file_size;
+    options.concurrent = true;
+    options.max_immutable_tables = 2;
+    options.compaction_threads = 2;
+    Database *database = new Database("database_step4_compaction", 4 * PAGE_SIZE, options);
+    database->open("database_step4_compaction");
+    const int pairs_per_table = (4 * PAGE_SIZE) / KV_PAIR_SIZE;
+    for (int key = -1000; key < 0; key++) {
+        database->put(key, key * 2);
+    }
+    atomic<bool> writing(true);
+    atomic<int> wrong(0);
+    thread reader([&]() {
+        vector<KV_Pair> result;
+        for (int i = 0; writing; i++) {
+            int key = -1 - i % 1000;
+            wrong += database->get(key) != key * 2;
+            database->scan(-1000, -1, result);
+            wrong += result.size() != 1000 || result[0].val != -2000;
+        }
+    });
+    // 16 memtables of new keys, then 6 of updates and deletes of some of them
+    const int num_keys = 16 * pairs_per_table;
+    map<int, int> expected;
+    vector<int> keys(num_keys);
+    iota(keys.begin(), keys.end(), 0);
+    shuffle(keys.begin(), keys.end(), mt19937(41));
+    for (int key : keys) {
+        database->put(key, key);
+        expected[key] = key;
+    }
+    shuffle(keys.begin(), keys.end(), mt19937(43));
+    for (int i = 0; i < 6 * pairs_per_table; i++) {
+        int val = i % 3 == 0 ? numeric_limits<int>::min() : -keys[i];
+        database->put(keys[i], val);
+        expected[keys[i]] = val;
+    }
+    writing = false;
+    reader.join();
+    if (wrong > 0) {
+        cerr << "Test Failed: " << wrong << " reads during background merges with policy " << policy << " were wrong" << endl;
+    }
+    // Once the flushes and merges are done every level is within its number of runs
+    database->waitForFlushes();
+    CompactionScheduler *scheduler = database->getCompactionScheduler();
+    scheduler->waitForIdle();
+    SSTManager *manager = database->getsstManager();
+    int numSSTs = 0;
+    for (int level = 1; level <= manager->max_level; level++) {
+        if ((int) manager->getRuns(level).size() > manager->runLimit(level)) {
+            cerr << "Test Failed: background merges left " << manager->getRuns(level).size() << " runs in L" << level << endl;
+        }
+        numSSTs += manager->getSSTs(level).size();
+    }
+    // Inputs of the merges are removed once the manifest records their outputs
+    if (countSSTFiles("database_step4_compaction") != numSSTs) {
+        cerr << "Test Failed: background merges with policy " << policy << " left SST files behind" << endl;
+    }
+    // Only the recent jobs are kept, the totals count every job
+    vector<CompactionStats> stats = scheduler->getJobStats();
+    CompactionTotals totals = scheduler->getJobTotals();
+    for (CompactionStats &job : stats) {
+        if (job.outputLevel < job.levelnum || job.outputLevel > job.levelnum + 1 || job.mergeMillis < 0 || job.installMillis < 0
+            || job.mergeMillis > totals.slowest.mergeMillis) {
+            cerr << "Test Failed: stats of the merge of L" << job.levelnum << " into L" << job.outputLevel << endl;
+        }
+    }
+    if (totals.jobs == 0 || (long long) stats.size() != min(totals.jobs, (long long) COMPACTION_STATS_HISTORY)
+        || totals.outputBytes != manager->compacted_bytes || scheduler->getQueueDepth() != 0 || scheduler->getRunningJobs() != 0) {
+        cerr << "Test Failed: " << totals.jobs << " background merges wrote " << totals.outputBytes << " of " << manager->compacted_bytes << " bytes" << endl;
+    }
+    for (int round = 0; round < 2; round++) {
+        for (auto &pair : expected) {
+            if (database->get(pair.first) != pair.second) {
+                cerr << "Test Failed: get of key " << pair.first << " after background merges with policy " << policy << endl;
+                break;
+            }
+        }
+        database->close();
+        delete database;
+        database = new Database("database_step4_compaction", 4 * PAGE_SIZE, options);
+        database->open("database_step4_compaction");
+    }
+    database->close();
+    delete database;
+}
+
 int main(int argc, char* argv[]) {
     // By performing the unittest, we will open the database and operate
     // a series of API command. In this way we can prevent collisions when
@@ -497,6 +1964,8 @@ int main(int argc, char* argv[]) {
         test_buffer_pool(database_step2);
         // Test eviction policy
         test_eviction_policy(database_step2);
+        // Test failed reads and pinned pages in the buffer pool
+        test_pinned_pages(database_step2);
 
         // Close database
         database_step2->close();
@@ -513,6 +1982,8 @@ int main(int argc, char* argv[]) {
         test_tombstone_merge_to_sst(database_step3);
         // Test delete API after merge ssts
         test_delete_after_merge(database_step3);
+        // Test scan does not return deleted keys
+        test_scan_after_delete(database_step3);
         // Test LSM Tree to be merged twice
         test_lsm_merge_twice(database_step3);
         // Test tombstone are cleared at max level of LSM Tree
@@ -522,8 +1993,138 @@ int main(int argc, char* argv[]) {
 
         // CLose the database
         database_step3->close();
+    } else if (step_num == "4") {
+        // Test for step 4
+        DatabaseOptions options;
+        options.concurrent = true;
+        Database *database_step4 = new Database("database_step4", 4 * PAGE_SIZE, options);
+        database_step4->open("database_step4");
+
+        // Test concurrent writers
+        test_concurrent_put(database_step4);
+
+        // Test concurrent readers
+        test_concurrent_get(database_step4);
+
+        // Close database
+        database_step4->close();
+
+        // Open a database that flushes full memtables in the background
+        DatabaseOptions background_options;
+        background_options.max_immutable_tables = 2;
+        Database *database_step4_background = new Database("database_step4_background", 4 * PAGE_SIZE, background_options);
+        database_step4_background->open("database_step4_background");
+
+        // Test immutable memtables and background flush
+        test_background_flush(database_step4_background);
+
+        // Close database
+        database_step4_background->close();
+
+        // Test merges on the flush thread while readers use the levels
+        test_flush_thread_merges();
+
+        // Open a database for sequential keys, every level gets the same filter bits per key so
+        // SSTs can be appended to the next level as they are
+        DatabaseOptions append_options;
+        append_options.optimize_filter_memory = false;
+        Database *database_step4_append = new Database("database_step4_append", 4 * PAGE_SIZE, append_options);
+        database_step4_append->open("database_step4_append");
+
+        // Test append buffer and appending SSTs
+        test_sequential_append(database_step4_append);
+
+        // Test a failed append of SSTs
+        test_failed_append(database_step4_append);
+
+        // Test tombstones of sequential keys
+        test_sequential_tombstones();
+
+        // Close database
+        database_step4_append->close();
+
+        // Test reopening the closed database in a new Database object
+        test_recover_from_manifest();
+        test_manifest_large_records();
+
+        // Open a database whose SSTs use binary fuse filters
+        DatabaseOptions fuse_options;
+        fuse_options.filter_type = BINARY_FUSE_FILTER;
+        Database *database_step4_fuse = new Database("database_step4_fuse", 4 * PAGE_SIZE, fuse_options);
+        database_step4_fuse->open("database_step4_fuse");
+
+        // Test the blocked bloom filter
+        test_bloom_filter();
+
+        // Test binary fuse filters
+        test_binary_fuse_filter(database_step4_fuse);
+        test_fuse_filter_build();
+
+        // Test dividing the filter memory among the levels
+        test_filter_allocation();
+        test_sequential_filter_allocation();
+
+        // Open a database for short scans over sparse keys
+        Database *database_step4_range = new Database("database_step4_range", 4 * PAGE_SIZE);
+        database_step4_range->open("database_step4_range");
+
+        // Test range filters
+        test_range_filter(database_step4_range);
+
+        // Test the search tree over the fence keys
+        test_fence_index();
+
+        // Test the search within a page
+        test_page_search();
+
+        // Test the learned index over the fence keys
+        test_learned_index();
+        DatabaseOptions learned_options;
+        learned_options.learned_index = true;
+        Database *database_step4_learned = new Database("database_step4_learned", 4 * PAGE_SIZE, learned_options);
+        database_step4_learned->open("database_step4_learned");
+        test_learned_index_database(database_step4_learned);
+
+        // Test the row page layout next to PAX pages
+        DatabaseOptions row_options;
+        row_options.page_format = ROW_PAGE;
+        Database *database_step4_row = new Database("database_step4_row", 4 * PAGE_SIZE, row_options);
+        database_step4_row->open("database_step4_row");
+        test_page_format(database_step4_row);
+
+        // Test packed pages
+        test_packed_page();
+        DatabaseOptions packed_options;
+        packed_options.page_format = PACKED_PAGE;
+        Database *database_step4_packed = new Database("database_step4_packed", 4 * PAGE_SIZE, packed_options);
+        database_step4_packed->open("database_step4_packed");
+        test_packed_pages(database_step4_packed);
+
+        // Test page compression
+        test_lz_codec();
+        test_compressed_pages(PAX_PAGE);
+        test_compressed_pages(PACKED_PAGE);
+
+        // Test leveling, tiering and lazy leveling
+        test_compaction_policies();
+
+        // Test SSTs of a key range with partial compaction
+        test_partial_compaction();
+
+        // Test merging several levels in one pass
+        test_multi_level_merge();
+
+        // Test merges split into subcompactions
+        test_subcompactions(0);
+        test_subcompactions(16 * PAGE_SIZE);
+
+        // Test merges on compaction threads
+        test_background_compaction(LEVELING, 0);
+        test_background_compaction(TIERING, 0);
+        test_background_compaction(LEVELING, 2 * PAGE_SIZE);
+        test_compaction_history();
     } else {
-        cerr << "Please enter a valid step number from 1 to 3" << endl;
+        cerr << "Please enter a valid step number from 1 to 4" << endl;
         return 1;
     }
     return 0;
@@ -2,5 +2,17 @@
 #define TEST_H
 
 #include "database.h"
+#include "bloomfilter.h"
+#include "fusefilter.h"
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <atomic>
+#include <set>
+#include <numeric>
+#include <dirent.h>
+#include <unistd.h>
 
 #endif
\ No newline at end of file